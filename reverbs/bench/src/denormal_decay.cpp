@@ -0,0 +1,168 @@
+//
+//  denormal_decay.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+//  Feeds an impulse into the FDN and the ISM and measures the cost of every
+//  block while the reverb decays to silence, with and without flush-to-zero.
+//  Without it the cost rises once the tails become subnormal.
+//
+
+#include "reverbs/fdnverb/include/FDN.hpp"
+#include "reverbs/ismverb/include/ISMverb.hpp"
+#include "reverbs/include/Denormals.hpp"
+
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+struct Segment
+{
+    double fdn_sum = 0.0;
+    double fdn_max = 0.0;
+    double ism_sum = 0.0;
+    double ism_max = 0.0;
+    float peak = 0.f;
+    unsigned n_blocks = 0;
+};
+
+static std::vector< Segment > run( unsigned sample_rate, unsigned block_size, float seconds, float t60, unsigned long blocks_per_segment )
+{
+    const unsigned n_rev_sources = 8;
+    
+    SSRverb::FDN fdn( sample_rate, 24, n_rev_sources );
+    SSRverb::ISMverb ism( 5.f, 7.f, 3.2f, 4, sample_rate, block_size );
+    
+    // Short decays, so the tails pass 1e-38 within the run. At 0.4 s that is after about 5 s.
+    for ( unsigned band = 0; band < 3; band++ ) {
+        fdn.set_t60( t60, band );
+        ism.set_t60( t60, band );
+    }
+    fdn.set_co_freqs( ISM_CO_FREQS );
+    
+    // Keep processing the decaying tail.
+    fdn.set_idle_detection( false );
+    ism.set_idle_detection( false );
+    
+    std::vector< float > input( block_size, 0.f );
+    float** outputs = new float*[n_rev_sources];
+    for ( unsigned out = 0; out < n_rev_sources; out++ ) {
+        outputs[out] = new float[block_size];
+    }
+    
+    const unsigned long n_blocks = (unsigned long)( seconds * sample_rate / block_size );
+    std::vector< Segment > segments( n_blocks / blocks_per_segment + 1 );
+    
+    std::chrono::steady_clock::time_point start;
+    std::chrono::duration< double, std::micro > elapsed;
+    
+    for ( unsigned long blk = 0; blk < n_blocks; blk++ )
+    {
+        input[0] = blk == 0 ? 1.f : 0.f;
+        Segment& segment = segments[blk / blocks_per_segment];
+        
+        start = std::chrono::steady_clock::now();
+        fdn.process( input.data(), outputs, block_size );
+        elapsed = std::chrono::steady_clock::now() - start;
+        segment.fdn_sum += elapsed.count();
+        segment.fdn_max = std::max( segment.fdn_max, elapsed.count() );
+        
+        for ( unsigned out = 0; out < n_rev_sources; out++ ) {
+            for ( unsigned idx = 0; idx < block_size; idx++ ) {
+                segment.peak = std::max( segment.peak, fabsf( outputs[out][idx] ) );
+            }
+        }
+        
+        start = std::chrono::steady_clock::now();
+        ism.process( input.data(), outputs, block_size );
+        elapsed = std::chrono::steady_clock::now() - start;
+        segment.ism_sum += elapsed.count();
+        segment.ism_max = std::max( segment.ism_max, elapsed.count() );
+        
+        segment.n_blocks++;
+    }
+    
+    for ( unsigned out = 0; out < n_rev_sources; out++ ) {
+        delete [] outputs[out];
+    }
+    delete [] outputs;
+    
+    // Drop the trailing segment if it got no blocks.
+    if ( segments.size() > 1 && segments.back().n_blocks == 0 ) segments.pop_back();
+    return segments;
+}
+
+static double ratio( double end, double start )
+{
+    return start > 0.0 ? end / start : 0.0;
+}
+
+int main( int argc, char** argv )
+{
+    unsigned sample_rate = 44100;
+    unsigned block_size = 64;
+    float seconds = 10.f;
+    float t60 = .4f;
+    
+    for ( int arg = 1; arg < argc; arg++ )
+    {
+        if ( !strcmp( argv[arg], "--sample-rate" ) && arg+1 < argc ) sample_rate = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--block-size" ) && arg+1 < argc ) block_size = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--seconds" ) && arg+1 < argc ) seconds = atof( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--t60" ) && arg+1 < argc ) t60 = atof( argv[++arg] );
+        else {
+            printf( "Usage: %s [--sample-rate <Hz>] [--block-size <frames>] [--seconds <s>] [--t60 <s>]\n", argv[0] );
+            return 1;
+        }
+    }
+    
+    const unsigned long blocks_per_segment = std::max( 1ul, (unsigned long)( .5f * sample_rate / block_size ) );
+    
+    printf( "# Decay to silence, %u Hz, %u frames per block, T60 %.2f s\n", sample_rate, block_size, t60 );
+    
+    std::vector< Segment > with_ftz;
+    {
+        SSRverb::DenormalGuard denormal_guard;
+        with_ftz = run( sample_rate, block_size, seconds, t60, blocks_per_segment );
+    }
+    std::vector< Segment > without_ftz = run( sample_rate, block_size, seconds, t60, blocks_per_segment );
+    
+    // Peak is the FDN output level without flush-to-zero, subnormal below 1.2e-38.
+    printf( "time_s,peak,fdn_mean_us,fdn_max_us,ism_mean_us,ism_max_us,fdn_noftz_mean_us,fdn_noftz_max_us,ism_noftz_mean_us,ism_noftz_max_us\n" );
+    for ( unsigned seg = 0; seg < std::min( with_ftz.size(), without_ftz.size() ); seg++ )
+    {
+        const Segment& ftz = with_ftz[seg];
+        const Segment& noftz = without_ftz[seg];
+        printf( "%.2f,%.3g,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n"
+               , seg * blocks_per_segment * block_size / double(sample_rate)
+               , noftz.peak
+               , ftz.fdn_sum / ftz.n_blocks
+               , ftz.fdn_max
+               , ftz.ism_sum / ftz.n_blocks
+               , ftz.ism_max
+               , noftz.fdn_sum / noftz.n_blocks
+               , noftz.fdn_max
+               , noftz.ism_sum / noftz.n_blocks
+               , noftz.ism_max
+               );
+    }
+    
+    // Mean cost at the end of the decay relative to the beginning.
+    const Segment* first[2] = { &with_ftz.front(), &without_ftz.front() };
+    const Segment* last[2] = { &with_ftz.back(), &without_ftz.back() };
+    printf( "# FDN cost end/start: %.2f with FTZ/DAZ, %.2f without\n"
+           , ratio( last[0]->fdn_sum / last[0]->n_blocks, first[0]->fdn_sum / first[0]->n_blocks )
+           , ratio( last[1]->fdn_sum / last[1]->n_blocks, first[1]->fdn_sum / first[1]->n_blocks )
+           );
+    printf( "# ISM cost end/start: %.2f with FTZ/DAZ, %.2f without\n"
+           , ratio( last[0]->ism_sum / last[0]->n_blocks, first[0]->ism_sum / first[0]->n_blocks )
+           , ratio( last[1]->ism_sum / last[1]->n_blocks, first[1]->ism_sum / first[1]->n_blocks )
+           );
+    
+    return 0;
+}
@@ -0,0 +1,237 @@
+//
+//  engine_rtf.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+//  Measures the processing cost of every engine without JACK. By default
+//  each parameter is swept on its own around a base configuration, --full
+//  sweeps all combinations. Input noise, delays and impulse responses use
+//  fixed seeds, so results are comparable across commits.
+//
+
+#include "reverbs/fdnverb/include/FDN.hpp"
+#include "reverbs/fdnverb/include/DynamicFDNEngine.hpp"
+#include "reverbs/ismverb/include/ISMverb.hpp"
+#include "reverbs/randomizer/include/ConvolutionEngine.hpp"
+#include "reverbs/include/Denormals.hpp"
+
+#include <chrono>
+#include <random>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <math.h>
+
+const unsigned BENCH_SEED = 1;
+
+struct Config
+{
+    std::string engine;
+    unsigned n_fbpaths;
+    unsigned ism_order;
+    unsigned n_sources;
+    unsigned block_size;
+    unsigned sample_rate;
+    
+    bool operator==( const Config& other ) const
+    {
+        return engine == other.engine && n_fbpaths == other.n_fbpaths && ism_order == other.ism_order
+            && n_sources == other.n_sources && block_size == other.block_size && sample_rate == other.sample_rate;
+    }
+};
+
+struct Sweep
+{
+    std::vector< unsigned > n_fbpaths;
+    std::vector< unsigned > ism_orders;
+    std::vector< unsigned > n_sources;
+    std::vector< unsigned > block_sizes;
+    std::vector< unsigned > sample_rates;
+};
+
+static std::unique_ptr< SSRverb::ReverbEngine > make_engine( const Config& config )
+{
+    std::unique_ptr< SSRverb::ReverbEngine > engine;
+    
+    if ( config.engine == "fdn" )
+    {
+        SSRverb::FDN* fdn = new SSRverb::FDN( config.sample_rate, config.n_fbpaths, config.n_sources );
+        fdn->set_seed( BENCH_SEED );
+        fdn->set_co_freqs( ISM_CO_FREQS );
+        fdn->set_idle_detection( false );
+        engine.reset( fdn );
+    }
+    else if ( config.engine == "ism" )
+    {
+        SSRverb::ISMverb* ism = new SSRverb::ISMverb( 5.f, 7.f, 3.2f, config.ism_order, config.sample_rate, config.block_size );
+        ism->set_idle_detection( false );
+        engine.reset( ism );
+    }
+    else if ( config.engine == "dfdn" )
+    {
+        // Processing of DynamicFDN::render_audio, without the JACK client around it.
+        SSRverb::DynamicFDNEngine* dfdn = new SSRverb::DynamicFDNEngine( config.sample_rate, config.block_size );
+        dfdn->set_seed( BENCH_SEED );
+        dfdn->set_governor( false );
+        engine.reset( dfdn );
+    }
+    else if ( config.engine == "conv" )
+    {
+        // One second of exponentially decaying noise per channel, like the Randomizer output.
+        const unsigned long ir_length = config.sample_rate;
+        std::mt19937 generator( BENCH_SEED );
+        std::uniform_real_distribution< float > noise( -1.f, 1.f );
+        
+        std::vector< std::vector< float > > irs( config.n_sources, std::vector< float >( ir_length ) );
+        std::vector< float* > ir_ptrs( config.n_sources );
+        for ( unsigned src = 0; src < config.n_sources; src++ ) {
+            for ( unsigned long idx = 0; idx < ir_length; idx++ ) {
+                irs[src][idx] = noise( generator ) * expf( -6.9f * idx / ir_length );
+            }
+            ir_ptrs[src] = irs[src].data();
+        }
+        engine.reset( new SSRverb::ConvolutionEngine( ir_ptrs.data(), config.n_sources, ir_length, config.block_size ) );
+    }
+    
+    if ( engine ) {
+        engine->set_t60( 2.f, 0 );
+        engine->set_t60( 1.f, 1 );
+        engine->set_t60( .2f, 2 );
+        engine->prepare( config.sample_rate, config.block_size );
+    }
+    return engine;
+}
+
+static void measure( const Config& config, float seconds )
+{
+    std::unique_ptr< SSRverb::ReverbEngine > engine = make_engine( config );
+    if ( !engine ) return;
+    
+    const unsigned block_size = config.block_size;
+    const unsigned n_outputs = engine->get_n_outputs();
+    
+    // One second of noise, reused cyclically.
+    std::mt19937 generator( BENCH_SEED );
+    std::uniform_real_distribution< float > noise( -.5f, .5f );
+    const unsigned long noise_blocks = std::max( 1u, config.sample_rate / block_size );
+    std::vector< float > input( noise_blocks * block_size );
+    for ( unsigned long idx = 0; idx < input.size(); idx++ ) input[idx] = noise( generator );
+    
+    std::vector< float > samples( n_outputs * block_size );
+    std::vector< float* > outputs( n_outputs );
+    for ( unsigned out = 0; out < n_outputs; out++ ) outputs[out] = samples.data() + out * block_size;
+    
+    const unsigned long n_blocks = std::max( 1ul, (unsigned long)( seconds * config.sample_rate / block_size ) );
+    const unsigned long n_warmup = std::max( 1ul, n_blocks / 8 );
+    
+    SSRverb::DenormalGuard denormal_guard;
+    
+    for ( unsigned long blk = 0; blk < n_warmup; blk++ ) {
+        engine->process( input.data() + ( blk % noise_blocks ) * block_size, outputs.data(), block_size );
+    }
+    
+    std::chrono::steady_clock::time_point start;
+    std::chrono::duration< double, std::nano > elapsed;
+    double total_ns = 0.0, peak_ns = 0.0;
+    
+    for ( unsigned long blk = 0; blk < n_blocks; blk++ )
+    {
+        start = std::chrono::steady_clock::now();
+        engine->process( input.data() + ( blk % noise_blocks ) * block_size, outputs.data(), block_size );
+        elapsed = std::chrono::steady_clock::now() - start;
+        
+        total_ns += elapsed.count();
+        peak_ns = std::max( peak_ns, elapsed.count() );
+    }
+    
+    const double n_frames = double( n_blocks ) * block_size;
+    const double audio_ns = n_frames / config.sample_rate * 1e9;
+    const double block_ns = double( block_size ) / config.sample_rate * 1e9;
+    
+    printf( "%s,%u,%u,%u,%u,%u,%.2f,%.5f,%.2f,%.4f\n"
+           , config.engine.c_str(), config.n_fbpaths, config.ism_order, n_outputs
+           , block_size, config.sample_rate
+           , total_ns / n_frames, total_ns / audio_ns, peak_ns / 1000.0, peak_ns / block_ns );
+    fflush( stdout );
+}
+
+static void add_config( std::vector< Config >& configs, const Config& config )
+{
+    if ( std::find( configs.begin(), configs.end(), config ) == configs.end() ) configs.push_back( config );
+}
+
+// Base configuration first, then every parameter varied on its own.
+static void add_sweep( std::vector< Config >& configs, const Config& base, const Sweep& sweep, bool full )
+{
+    if ( full )
+    {
+        Config config = base;
+        for ( unsigned paths : sweep.n_fbpaths ) for ( unsigned order : sweep.ism_orders )
+        for ( unsigned srcs : sweep.n_sources ) for ( unsigned block : sweep.block_sizes )
+        for ( unsigned rate : sweep.sample_rates )
+        {
+            config.n_fbpaths = paths;
+            config.ism_order = order;
+            config.n_sources = srcs;
+            config.block_size = block;
+            config.sample_rate = rate;
+            add_config( configs, config );
+        }
+        return;
+    }
+    
+    Config config;
+    add_config( configs, base );
+    for ( unsigned paths : sweep.n_fbpaths ) { config = base; config.n_fbpaths = paths; add_config( configs, config ); }
+    for ( unsigned order : sweep.ism_orders ) { config = base; config.ism_order = order; add_config( configs, config ); }
+    for ( unsigned srcs : sweep.n_sources ) { config = base; config.n_sources = srcs; add_config( configs, config ); }
+    for ( unsigned block : sweep.block_sizes ) { config = base; config.block_size = block; add_config( configs, config ); }
+    for ( unsigned rate : sweep.sample_rates ) { config = base; config.sample_rate = rate; add_config( configs, config ); }
+}
+
+int main( int argc, char** argv )
+{
+    float seconds = 2.f;
+    bool full = false;
+    std::string engine_filter;
+    
+    for ( int arg = 1; arg < argc; arg++ )
+    {
+        if ( !strcmp( argv[arg], "--full" ) ) full = true;
+        else if ( !strcmp( argv[arg], "--engine" ) && arg+1 < argc ) engine_filter = argv[++arg];
+        else if ( !strcmp( argv[arg], "--seconds" ) && arg+1 < argc ) seconds = atof( argv[++arg] );
+        else {
+            printf( "Usage: %s [--engine <fdn|ism|dfdn|conv>] [--seconds <s>] [--full]\n", argv[0] );
+            return 1;
+        }
+    }
+    
+    const std::vector< unsigned > block_sizes{ 32, 64, 128, 256, 512, 1024, 2048 };
+    const std::vector< unsigned > sample_rates{ 44100, 48000, 96000 };
+    
+    std::vector< Config > configs;
+    
+    // Engines with fixed parameters keep them in the sweep lists.
+    add_sweep( configs, { "fdn", 24, 0, 8, 64, 44100 }
+              , { { 8, 16, 24, 32 }, { 0 }, { 2, 4, 8, 16 }, block_sizes, sample_rates }, full );
+    add_sweep( configs, { "ism", 0, 4, 8, 64, 44100 }
+              , { { 0 }, { 1, 2, 3, 4, 5, 6, 7, 8 }, { 8 }, block_sizes, sample_rates }, full );
+    add_sweep( configs, { "dfdn", 24, 4, 8, 64, 44100 }
+              , { { 24 }, { 4 }, { 8 }, block_sizes, sample_rates }, full );
+    add_sweep( configs, { "conv", 0, 0, 8, 256, 44100 }
+              , { { 0 }, { 0 }, { 2, 4, 8, 16 }, block_sizes, sample_rates }, full );
+    
+    printf( "engine,n_fbpaths,ism_order,n_sources,block_size,sample_rate,ns_per_sample,rtf,peak_cycle_us,peak_load\n" );
+    
+    for ( unsigned cfg = 0; cfg < configs.size(); cfg++ ) {
+        if ( !engine_filter.empty() && configs[cfg].engine != engine_filter ) continue;
+        measure( configs[cfg], seconds );
+    }
+    
+    return 0;
+}
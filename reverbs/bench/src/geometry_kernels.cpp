@@ -0,0 +1,278 @@
+//
+//  geometry_kernels.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+//  Measures the control-rate geometry run on every move of the tracked source
+//  for reflection orders 1 to 12: Room::mirror_point, Room::extract_order,
+//  Plane3D::get_connection, Vector3D::distance_to and azimuth_to, and the whole
+//  tap update of ISMverb, next to the re-panning after a head rotation which
+//  skips the geometry and the update for four receivers sharing one mirror
+//  pass. On Linux cycles, instructions and cache misses are
+//  read through perf_event_open when the kernel permits it.
+//
+
+#include "reverbs/ismverb/include/ISMverb.hpp"
+#include "reverbs/include/Room.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+// Keeps the longest order 12 path within the delay lines of ISMverb.
+const float ROOM_SIZE[3]{ 4.f, 5.f, 3.f };
+const unsigned N_POSITIONS = 64;
+
+// Results are written here, so the measured kernels are not optimized away.
+static volatile float sink;
+
+/**
+ Hardware counters of the calling thread. Counters the CPU, the kernel or
+ the permissions (see /proc/sys/kernel/perf_event_paranoid) do not provide
+ are left out.
+ */
+class PerfCounters
+{
+public:
+    static const unsigned N_COUNTERS = 3;
+    
+    PerfCounters( bool enabled )
+    {
+        for ( unsigned cnt = 0; cnt < N_COUNTERS; cnt++ ) _fds[cnt] = -1;
+#ifdef __linux__
+        if ( !enabled ) return;
+        
+        const uint64_t configs[N_COUNTERS]{
+              PERF_COUNT_HW_CPU_CYCLES
+            , PERF_COUNT_HW_INSTRUCTIONS
+            , PERF_COUNT_HW_CACHE_MISSES
+        };
+        
+        for ( unsigned cnt = 0; cnt < N_COUNTERS; cnt++ )
+        {
+            perf_event_attr attr;
+            memset( &attr, 0, sizeof(attr) );
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[cnt];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            
+            _fds[cnt] = int( syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 ) );
+        }
+#endif
+    }
+    
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for ( unsigned cnt = 0; cnt < N_COUNTERS; cnt++ ) {
+            if ( _fds[cnt] >= 0 ) close( _fds[cnt] );
+        }
+#endif
+    }
+    
+    bool is_available( unsigned counter ) { return _fds[counter] >= 0; }
+    
+    void start()
+    {
+#ifdef __linux__
+        for ( unsigned cnt = 0; cnt < N_COUNTERS; cnt++ ) {
+            if ( _fds[cnt] < 0 ) continue;
+            ioctl( _fds[cnt], PERF_EVENT_IOC_RESET, 0 );
+            ioctl( _fds[cnt], PERF_EVENT_IOC_ENABLE, 0 );
+        }
+#endif
+    }
+    
+    void stop( uint64_t* values )
+    {
+        for ( unsigned cnt = 0; cnt < N_COUNTERS; cnt++ )
+        {
+            values[cnt] = 0;
+#ifdef __linux__
+            if ( _fds[cnt] < 0 ) continue;
+            ioctl( _fds[cnt], PERF_EVENT_IOC_DISABLE, 0 );
+            if ( read( _fds[cnt], &values[cnt], sizeof(uint64_t) ) != sizeof(uint64_t) ) values[cnt] = 0;
+#endif
+        }
+    }
+    
+private:
+    int _fds[N_COUNTERS];
+};
+
+/**
+ Calls kernel( call_idx ) repeatedly for about the given time and prints one
+ CSV line. n_images is the number of image sources handled in one call.
+ */
+template < typename Kernel >
+static void measure(  const char* name, unsigned order, unsigned n_images, Kernel kernel
+                    , float seconds, PerfCounters& counters )
+{
+    typedef std::chrono::steady_clock clock;
+    std::chrono::duration< double > elapsed;
+    
+    // Double the calls until a tenth of the time is filled. Doubles as warm up.
+    unsigned long n_calls = 1;
+    while ( true )
+    {
+        clock::time_point start = clock::now();
+        for ( unsigned long call = 0; call < n_calls; call++ ) kernel( call );
+        elapsed = clock::now() - start;
+        
+        if ( elapsed.count() >= seconds / 10.0 || n_calls >= ( 1ul << 40 ) ) break;
+        n_calls *= 2;
+    }
+    n_calls = std::max( 1ul, (unsigned long)( n_calls * seconds / std::max( elapsed.count(), 1e-9 ) ) );
+    
+    uint64_t values[PerfCounters::N_COUNTERS];
+    counters.start();
+    clock::time_point start = clock::now();
+    for ( unsigned long call = 0; call < n_calls; call++ ) kernel( call );
+    elapsed = clock::now() - start;
+    counters.stop( values );
+    
+    const double ns_per_call = elapsed.count() * 1e9 / n_calls;
+    
+    printf( "%s,%u,%u,%.1f,%.4g", name, order, n_images, ns_per_call, n_images / ns_per_call * 1e9 );
+    for ( unsigned cnt = 0; cnt < PerfCounters::N_COUNTERS; cnt++ ) {
+        if ( counters.is_available( cnt ) ) printf( ",%.1f", double( values[cnt] ) / n_calls );
+        else printf( "," );
+    }
+    printf( "\n" );
+    fflush( stdout );
+}
+
+static void run_order( unsigned order, float seconds, PerfCounters& counters )
+{
+    SSRverb::Room room( ROOM_SIZE[0], ROOM_SIZE[1], ROOM_SIZE[2] );
+    const unsigned n_images = SSRverb::Room::get_n_mirr_src( order );
+    const SSRverb::Vector3D receiver( ROOM_SIZE[0] * .5f, ROOM_SIZE[1] * .5f, 1.7f );
+    
+    // The tracked source walks in a circle around the receiver.
+    std::vector< SSRverb::Vector3D > positions( N_POSITIONS );
+    for ( unsigned pos = 0; pos < N_POSITIONS; pos++ ) {
+        const float angle = 2.f * M_PI * pos / N_POSITIONS;
+        positions[pos] = SSRverb::Vector3D(  receiver[0] + 1.5f * cosf( angle )
+                                           , receiver[1] + 1.5f * sinf( angle ), 1.7f );
+    }
+    
+    SSRverb::Room::MirroedSources mirrored = SSRverb::Room::prepare_mirror_vector( order );
+    std::vector< SSRverb::Vector3D > images( n_images );
+    
+    measure( "mirror_point", order, n_images, [&]( unsigned long call )
+    {
+        room.mirror_point( positions[call % N_POSITIONS], order, mirrored );
+    }, seconds, counters );
+    
+    measure( "extract_order", order, n_images, [&]( unsigned long call )
+    {
+        SSRverb::Vector3D* one_order = images.data();
+        for ( unsigned ord = 1; ord <= order; ord++ ) {
+            SSRverb::Room::extract_order( ord, mirrored, order, one_order );
+            one_order += SSRverb::Room::get_n_mirr_src( ord ) - SSRverb::Room::get_n_mirr_src( ord-1 );
+        }
+    }, seconds, counters );
+    
+    measure( "get_connection", order, n_images, [&]( unsigned long call )
+    {
+        float sum = 0.f;
+        for ( unsigned img = 0; img < n_images; img++ ) {
+            sum += room[img % SSRverb::Room::N_WALLS]->get_connection( images[img] )[0];
+        }
+        sink = sum;
+    }, seconds, counters );
+    
+    measure( "distance_to", order, n_images, [&]( unsigned long call )
+    {
+        float sum = 0.f;
+        for ( unsigned img = 0; img < n_images; img++ ) sum += images[img].distance_to( receiver );
+        sink = sum;
+    }, seconds, counters );
+    
+    measure( "azimuth_to", order, n_images, [&]( unsigned long call )
+    {
+        SSRverb::Vector3D observer = receiver;
+        float sum = 0.f;
+        for ( unsigned img = 0; img < n_images; img++ ) sum += observer.azimuth_to( images[img] );
+        sink = sum;
+    }, seconds, counters );
+    
+    SSRverb::Room::dispose_mirror_vector( mirrored, order );
+    
+    // Everything above plus distributing the taps to the reverb sources.
+    SSRverb::ISMverb ism( ROOM_SIZE[0], ROOM_SIZE[1], ROOM_SIZE[2], order, 44100, 64 );
+    ism.set_receiver( receiver );
+    
+    measure( "update_delays", order, n_images, [&]( unsigned long call )
+    {
+        ism.set_source( positions[call % N_POSITIONS] );
+        ism.update_taps();
+    }, seconds, counters );
+    
+    // Only the receiver turns, e.g. after a head tracker.
+    measure( "rotate_taps", order, n_images, [&]( unsigned long call )
+    {
+        ism.set_receiver_orientation( 2.f * M_PI * ( call % N_POSITIONS ) / N_POSITIONS );
+        ism.update_rotation();
+    }, seconds, counters );
+    
+    // Four listeners around the center, compare with four times update_delays.
+    SSRverb::ISMverb zones( ROOM_SIZE[0], ROOM_SIZE[1], ROOM_SIZE[2], order, 44100, 64, 4 );
+    for ( unsigned rcv = 0; rcv < 4; rcv++ ) {
+        const float angle = 2.f * M_PI * rcv / 4;
+        zones.set_receiver( rcv, SSRverb::Vector3D( receiver[0] + .5f * cosf( angle ), receiver[1] + .5f * sinf( angle ), 1.7f ) );
+    }
+    
+    measure( "update_delays_4_receivers", order, n_images, [&]( unsigned long call )
+    {
+        zones.set_source( positions[call % N_POSITIONS] );
+        zones.update_taps();
+    }, seconds, counters );
+}
+
+int main( int argc, char** argv )
+{
+    float seconds = .2f;
+    unsigned max_order = 12;
+    bool use_counters = true;
+    
+    for ( int arg = 1; arg < argc; arg++ )
+    {
+        if ( !strcmp( argv[arg], "--seconds" ) && arg+1 < argc ) seconds = atof( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--max-order" ) && arg+1 < argc ) max_order = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--no-counters" ) ) use_counters = false;
+        else {
+            printf( "Usage: %s [--seconds <s per measurement>] [--max-order <n>] [--no-counters]\n", argv[0] );
+            return 1;
+        }
+    }
+    
+    PerfCounters counters( use_counters );
+    if ( use_counters && !counters.is_available( 0 ) ) {
+        fprintf( stderr, "Hardware counters not available, see /proc/sys/kernel/perf_event_paranoid.\n" );
+    }
+    
+    printf( "kernel,order,n_images,ns_per_call,images_per_s,cycles_per_call,instructions_per_call,cache_misses_per_call\n" );
+    
+    for ( unsigned order = 1; order <= max_order; order++ ) {
+        run_order( order, seconds, counters );
+    }
+    
+    return 0;
+}
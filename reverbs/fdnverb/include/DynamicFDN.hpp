@@ -9,18 +9,25 @@
 #ifndef DynamicFDN_hpp
 #define DynamicFDN_hpp
 
-#include <stdio.h>
-#include <atomic>
+#include <vector>
 
 #include "reverbs/include/ReverbBase.hpp"
-#include "reverbs/fdnverb/include/FDN.hpp"
-#include "reverbs/ismverb/include/ISMverb.hpp"
+#include "reverbs/fdnverb/include/DynamicFDNEngine.hpp"
 
 namespace SSRverb {
 
+/**
+@class DynamicFDN
+JACK client running a DynamicFDNEngine, tracking its source in the SSR.
+*/
 class DynamicFDN : public SSRverb::ReverbBase
 {
 public:
+    typedef DynamicFDNEngine::QualityLevel QualityLevel;
+    typedef DynamicFDNEngine::QualityStep QualityStep;
+    
+    static const unsigned n_quality_levels = DynamicFDNEngine::n_quality_levels;
+    
     DynamicFDN(  unsigned n_rev_sources = 8 );
     ~DynamicFDN();
     
@@ -28,6 +35,7 @@ public:
     
     void set_src_pos( Vector3D new_pos );
     void set_rec_pos( Vector3D new_pos );
+    void set_rec_orientation( float azimuth );
 
     void set_tracked_source( unsigned source_id, float x, float y );
     
@@ -43,29 +51,32 @@ public:
     void set_tracking( bool status );
     bool get_tracking();
     
-    void render_audio(
-                      jack_nframes_t n_frames
-                      , laproque::sample_t **in_buffers
-                      , laproque::sample_t **out_buffers
-                        );
+    /** @brief Enables the load governor, see DynamicFDNEngine::set_governor(). */
+    void set_governor( bool status );
+    bool get_governor();
     
-private:
-       
-    FDN _fdn;
-    ISMverb _ism;
+    /** @brief Sets the quality level manually. Only applied while the governor is disabled. */
+    void set_quality_level( unsigned level );
+    
+    /** @returns Current quality level. 0 is the highest quality. */
+    unsigned get_quality_level();
     
-    float** _internal_buffers;
+    /** @returns Settings of a quality level. */
+    QualityLevel get_quality_settings( unsigned level );
     
-    unsigned _n_remaining;
-    unsigned _n_ready;
+    /** @returns Maximum number of ISM delay taps of the current quality level. */
+    unsigned get_tap_budget();
     
-    static const unsigned _n_bands = 3;
-    float _t60_times[_n_bands];
+    /** @returns Peak processing load of the last measurement window. */
+    float get_load();
+    
+    /** @returns The most recent quality level changes, oldest first. */
+    std::vector< QualityStep > get_quality_history();
+    
+private:
+    DynamicFDNEngine _dynamic_fdn;
     
-    std::atomic<float> _fdn_ism_mix{0.5f};
-    std::atomic<float> _ism_gain{1.0f};
-    std::atomic<float> _fdn_gain{1.0f};
-    std::atomic<float> _gain{1.0f};
+    void _end_cycle( DeadlineWatchdog::Overrun* record );
 };
 
 } // SSRverb namspace
@@ -0,0 +1,221 @@
+//
+//  DynamicFDNEngine.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef DynamicFDNEngine_hpp
+#define DynamicFDNEngine_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "reverbs/include/ReverbEngine.hpp"
+#include "reverbs/include/DeadlineWatchdog.hpp"
+#include "reverbs/fdnverb/include/FDN.hpp"
+#include "reverbs/ismverb/include/ISMverb.hpp"
+
+namespace SSRverb {
+
+/**
+@class DynamicFDNEngine
+Combination of an ISM for the early reflections and an FDN for the late
+reverberation, with a load governor trading quality for processing time.
+*/
+class DynamicFDNEngine : public ReverbEngine
+{
+public:
+    /** @brief Settings of one quality level of the governor. */
+    struct QualityLevel
+    {
+        unsigned n_fbpaths;
+        unsigned ism_order;
+    };
+    
+    /** @brief One change of the quality level. */
+    struct QualityStep
+    {
+        /** Seconds since construction. */
+        double time;
+        unsigned from;
+        unsigned to;
+        /** Processing load which triggered the step. */
+        float load;
+    };
+    
+    static const unsigned n_quality_levels = 3;
+    
+    /**
+    @param sample_rate Sample rate used in processing.
+    @param block_size Maximum number of frames processed at once.
+    @param n_rev_sources Number of output channels.
+    */
+    DynamicFDNEngine( unsigned sample_rate, unsigned block_size, unsigned n_rev_sources = 8 );
+    ~DynamicFDNEngine();
+    
+    void prepare( unsigned sample_rate, unsigned max_block_size );
+    void process( float* input, float** outputs, unsigned n_frames );
+    unsigned get_n_outputs();
+    
+    void set_src_pos( Vector3D new_pos );
+    void set_rec_pos( Vector3D new_pos );
+    void set_rec_orientation( float azimuth );
+    
+    /** @brief Sets the SSR ID of the source tracked by the ISM. */
+    void set_tracked_source( unsigned source_id );
+    
+    void set_gain( float new_gain );
+    void set_fdn_ism_mix( float new_mix );
+    void set_ism_gain( float new_gain );
+    void set_fdn_gain( float new_gain );
+    
+    void set_t60( float t60_value, unsigned band_idx );
+    void set_co_freqs( std::vector< float > co_freqs );
+    void set_room_size( float x, float y, float z );
+    
+    void set_tracking( bool status );
+    bool get_tracking();
+    
+    /** @brief Fixes the seeds of the FDNs, see FDN::set_seed(). */
+    void set_seed( unsigned seed );
+    
+    /** @returns True in case FDN and ISM decayed to silence. */
+    bool is_idle();
+    
+    /** @returns The ISM of the early reflections. */
+    ISMverb* get_ism();
+    
+    /** @brief Sets the profiler the processing stages are recorded with. May be nullptr. */
+    void set_profiler( DspProfiler* profiler );
+    
+    /**
+    @brief Reports what happened since the last call. Only call from the audio thread.
+    @param record Filled in case it is not nullptr.
+    */
+    void end_cycle( DeadlineWatchdog::Overrun* record );
+    
+    /**
+    @brief Enables the load governor.
+    
+    The governor measures the processing time of every block against its
+    duration. Under pressure it steps to a cheaper quality level, when
+    enough headroom returns it steps back up. Levels are crossfaded.
+    */
+    void set_governor( bool status );
+    bool get_governor();
+    
+    /** @brief Sets the quality level manually. Only applied while the governor is disabled. */
+    void set_quality_level( unsigned level );
+    
+    /**
+    @brief Selects a quality level right away, without warm-up and crossfade.
+    
+    Meant for offline rendering, where the level is fixed from the first
+    sample on. Not real-time safe, call it before the first process().
+    Disable the governor to keep the level.
+    */
+    void switch_quality_level( unsigned level );
+    
+    /** @returns Current quality level. 0 is the highest quality. */
+    unsigned get_quality_level();
+    
+    /** @returns Settings of a quality level. */
+    QualityLevel get_quality_settings( unsigned level );
+    
+    /** @returns Maximum number of ISM delay taps of the current quality level. */
+    unsigned get_tap_budget();
+    
+    /** @returns Peak processing load of the last measurement window. */
+    float get_load();
+    
+    /** @returns The most recent quality level changes, oldest first. */
+    std::vector< QualityStep > get_quality_history();
+    
+private:
+    const unsigned _n_rev_sources;
+    unsigned _sample_rate;
+    unsigned _block_size;
+    
+    DspProfiler* _profiler = nullptr;
+    
+    // One FDN per quality level. Only the audible ones are processed.
+    FDN* _fdns[n_quality_levels];
+    ISMverb _ism;
+    float** _fdn_buffers;
+    
+    float** _internal_buffers;
+    
+    static const unsigned _n_bands = 3;
+    float _t60_times[_n_bands];
+    
+    std::atomic<float> _fdn_ism_mix{0.5f};
+    std::atomic<float> _ism_gain{1.0f};
+    std::atomic<float> _fdn_gain{1.0f};
+    std::atomic<float> _gain{1.0f};
+    
+    // Output mix stage. Coefficients are ramped from the previous to the
+    // current parameter values across one block.
+    float _fdn_coeff = 0.5f;
+    float _ism_coeff = 0.5f;
+    float _fdn_coeff_target = 0.5f;
+    float _ism_coeff_target = 0.5f;
+    float _fdn_coeff_step = 0.f;
+    float _ism_coeff_step = 0.f;
+    
+    /** @brief Loads the mix parameters and sets up the ramp for the coming block. */
+    void _prepare_mix( unsigned n_frames );
+    
+    /**
+    @brief Mixes the ISM result into the FDN result and applies all gains.
+    @param outputs Buffers holding the FDN result. The mix is written in place.
+    @param n_frames Number of frames to be mixed.
+    */
+    void _mix_outputs( float** outputs, unsigned n_frames );
+    
+    // Load governor.
+    std::atomic<bool> _governor_active{ true };
+    std::atomic<unsigned> _manual_level{ 0 };
+    std::atomic<unsigned> _level{ 0 };
+    std::atomic<float> _load{ 0.f };
+    
+    unsigned _fading_level = 0;
+    // FDN being emptied after it faded out, n_quality_levels if none.
+    unsigned _flush_level = n_quality_levels;
+    unsigned long _fade_pos = 0;
+    unsigned long _warmup_length;
+    unsigned long _fade_length;
+    
+    float _window_load = 0.f;
+    unsigned long _window_pos = 0;
+    unsigned long _window_length;
+    unsigned _n_relaxed_windows = 0;
+    
+    std::chrono::steady_clock::time_point _start_time;
+    
+    static const unsigned _history_length = 64;
+    std::atomic<unsigned long long> _history[_history_length];
+    std::atomic<unsigned> _n_steps{ 0 };
+    
+    /** @brief Evaluates the load of the last block and changes the quality level. */
+    void _govern( float load, unsigned n_frames );
+    void _step_to( unsigned level, float load );
+    
+    /** @brief Crossfades from the previous to the current FDN. */
+    void _crossfade_fdns( float* input, float** outputs, unsigned n_frames );
+    
+    // Cycle context reported to the deadline watchdog.
+    std::atomic<bool> _param_swap{ false };
+    unsigned long _last_n_updates = 0;
+    
+    void _make_buffers();
+    void _delete_buffers();
+    void _setup_governor_timing();
+};
+
+} // SSRverb namspace
+
+#endif /* DynamicFDNEngine_hpp */
@@ -18,6 +18,8 @@
 #include "laproque/include/JackPlugin.hpp"
 #include "laproque/include/FilteredDelay.hpp"
 #include "reverbs/include/Room.hpp"
+#include "reverbs/include/SilenceDetector.hpp"
+#include "reverbs/include/ReverbEngine.hpp"
 #include "ssrface/include/SceneManager.hpp"
 #include "Matrix.h"
 #include "reverbs/ismverb/include/ISMverb.hpp"
@@ -26,7 +28,7 @@ namespace SSRverb {
 /**
  @class FDN Implementation of a Feedback Delay Network with choosable number of feedback paths, sample rate and number of output channels.
  */
-class FDN
+class FDN : public ReverbEngine
 {
 public:
     /**
@@ -36,6 +38,12 @@ public:
     FDN( unsigned sample_rate, unsigned n_fbpaths = 16, unsigned n_rev_sources = 8 );
     ~FDN();
     
+    /** @brief Recomputes the delays for a new sample rate. Any block size is accepted. */
+    void prepare( unsigned sample_rate, unsigned max_block_size );
+    
+    /** @returns Number of output channels. */
+    unsigned get_n_outputs();
+    
     /**
      @brief Process the samples in input and write results to output.
      @param input Pointer to array with input samples.
@@ -65,9 +73,37 @@ public:
      */
     void set_boundries( float x, float y, float  z );
     
+    /** @brief Same as set_boundries(). */
+    void set_room_size( float x, float y, float z );
+    
     /** @brief Computes all internal values to employ the current settings. */
     void update_t60();
     
+    /** @returns True in case the FDN decayed to silence and is skipped. */
+    bool is_idle();
+    
+    /** @brief Enables skipping the processing once decayed to silence. Enabled by default. */
+    void set_idle_detection( bool status );
+    
+    /** @brief Empties all delay lines and feedback buffers. Not real-time safe for long delays. */
+    void clear();
+    
+    /**
+    @brief Empties the FDN in parts, continuing where the last call stopped.
+    @param max_samples Number of samples pushed through the delay lines at most.
+    @returns True once the FDN is empty.
+    */
+    bool clear_part( unsigned max_samples );
+    
+    /**
+    @brief Fixes the seed of the random delay variation and recomputes the delays.
+    The seed is random by default.
+    */
+    void set_seed( unsigned seed );
+    
+    /** @returns Number of feedback paths. */
+    unsigned get_n_fbpaths();
+    
 private:
     // FDN properties
     const unsigned _n_fbpaths;
@@ -84,6 +120,10 @@ private:
     
     laproque::FilteredDelay*  _delays;
     
+    // Progress of clear_part().
+    unsigned _clear_path = 0;
+    unsigned _clear_pos = 0;
+    
     float _t60_values[3]{2.f, 1.f, .2f};
     
     std::mt19937 _mt{ std::random_device{}() };
@@ -91,6 +131,10 @@ private:
     
     void _compute_delays();
     
+    // Skips processing once the input is silent and the tail decayed.
+    SilenceDetector _silence;
+    void _update_tail_length();
+    
     Matrix _fb_matrix;
     
     unsigned _sample_rate;
@@ -0,0 +1,488 @@
+//
+//  DynamicFDNEngine.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "DynamicFDNEngine.hpp"
+#include "reverbs/include/Vector3D.hpp"
+
+#include <math.h>
+#include <algorithm>
+
+const SSRverb::Vector3D DFDN_ROOM_INIT{5.f, 7.f, 3.2};
+
+// Quality levels of the governor, from best to cheapest.
+const SSRverb::DynamicFDNEngine::QualityLevel DFDN_QUALITY_LEVELS[SSRverb::DynamicFDNEngine::n_quality_levels] {
+    { 24, 4 },
+    { 16, 3 },
+    {  8, 2 }
+};
+
+// Peak load per window above which quality is reduced.
+const float GOV_HIGH_LOAD = 0.7f;
+// Peak load per window below which quality may be increased.
+const float GOV_LOW_LOAD = 0.35f;
+// Number of consecutive relaxed windows needed to increase quality.
+const unsigned GOV_RELAX_WINDOWS = 40;
+// Delay line samples emptied per processed frame while flushing a faded out FDN.
+const unsigned FLUSH_SAMPLES_PER_FRAME = 4;
+
+SSRverb::DynamicFDNEngine::DynamicFDNEngine( unsigned sample_rate, unsigned block_size, unsigned n_rev_sources )
+: _n_rev_sources( n_rev_sources ),
+  _sample_rate( sample_rate ),
+  _block_size( block_size ),
+  _ism( DFDN_ROOM_INIT[0], DFDN_ROOM_INIT[1], DFDN_ROOM_INIT[2], DFDN_QUALITY_LEVELS[0].ism_order, sample_rate, block_size )
+{
+    for ( unsigned lvl = 0; lvl < n_quality_levels; lvl++ ) {
+        _fdns[lvl] = new FDN( _sample_rate, DFDN_QUALITY_LEVELS[lvl].n_fbpaths, n_rev_sources );
+    }
+    
+    _make_buffers();
+    _setup_governor_timing();
+    
+    _start_time = std::chrono::steady_clock::now();
+    for ( unsigned idx = 0; idx < _history_length; idx++ ) {
+        _history[idx].store( 0 );
+    }
+    
+    set_rec_pos( DFDN_ROOM_INIT/2 );
+}
+
+SSRverb::DynamicFDNEngine::~DynamicFDNEngine()
+{
+    _delete_buffers();
+    
+    for ( unsigned lvl = 0; lvl < n_quality_levels; lvl++ ) {
+        delete _fdns[lvl];
+    }
+}
+
+void SSRverb::DynamicFDNEngine::_make_buffers()
+{
+    _internal_buffers = new float*[_n_rev_sources];
+    _fdn_buffers = new float*[_n_rev_sources];
+    for ( unsigned src = 0; src < _n_rev_sources; src++ ) {
+        _internal_buffers[src] = new float[_block_size];
+        _fdn_buffers[src] = new float[_block_size];
+    }
+}
+
+void SSRverb::DynamicFDNEngine::_delete_buffers()
+{
+    for ( unsigned src = 0; src < _n_rev_sources; src++ ) {
+        delete [] _internal_buffers[src];
+        delete [] _fdn_buffers[src];
+    }
+    delete [] _internal_buffers;
+    delete [] _fdn_buffers;
+}
+
+void SSRverb::DynamicFDNEngine::_setup_governor_timing()
+{
+    _window_length = _sample_rate / 20;
+    _warmup_length = _sample_rate / 4;
+    _fade_length = _sample_rate / 4;
+    _fade_pos = _warmup_length + _fade_length;
+    _window_pos = 0;
+    _window_load = 0.f;
+}
+
+void SSRverb::DynamicFDNEngine::prepare( unsigned sample_rate, unsigned max_block_size )
+{
+    for ( unsigned lvl = 0; lvl < n_quality_levels; lvl++ ) {
+        _fdns[lvl]->prepare( sample_rate, max_block_size );
+    }
+    _ism.prepare( sample_rate, max_block_size );
+    
+    if ( max_block_size > _block_size ) {
+        _delete_buffers();
+        _block_size = max_block_size;
+        _make_buffers();
+    }
+    
+    if ( sample_rate != _sample_rate ) {
+        _sample_rate = sample_rate;
+        _setup_governor_timing();
+    }
+}
+
+unsigned SSRverb::DynamicFDNEngine::get_n_outputs()
+{
+    return _n_rev_sources;
+}
+
+void SSRverb::DynamicFDNEngine::process( float* input, float** outputs, unsigned n_frames )
+{
+    auto start = std::chrono::steady_clock::now();
+    
+    const unsigned level = _level.load();
+    
+    _prepare_mix( n_frames );
+    
+    {
+        SSRVERB_PROFILE_SCOPE( _profiler, DspProfiler::FDN );
+        
+        if ( _fade_pos < _warmup_length + _fade_length ) {
+            _crossfade_fdns( input, outputs, n_frames );
+        }
+        else {
+            _fdns[level]->process( input, outputs, n_frames );
+            
+            // Empty the FDN faded out last a part per block, so it is clean once selected again.
+            if ( _flush_level < n_quality_levels && _fdns[_flush_level]->clear_part( n_frames * FLUSH_SAMPLES_PER_FRAME ) ) {
+                _flush_level = n_quality_levels;
+            }
+        }
+    }
+    
+    _ism.process( input, _internal_buffers, n_frames );
+    
+    // Both wrote silence, nothing to mix.
+    if ( !_fdns[level]->is_idle() || !_ism.is_idle() ) {
+        SSRVERB_PROFILE_SCOPE( _profiler, DspProfiler::MIX );
+        _mix_outputs( outputs, n_frames );
+    }
+    
+    // Avoid accumulating rounding errors of the ramp.
+    _fdn_coeff = _fdn_coeff_target;
+    _ism_coeff = _ism_coeff_target;
+    
+    // Load is the processing time relative to the duration of the block.
+    std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+    _govern( elapsed.count() * _sample_rate / n_frames, n_frames );
+}
+
+void SSRverb::DynamicFDNEngine::_crossfade_fdns( float* input, float** outputs, unsigned n_frames )
+{
+    unsigned idx, prt;
+    unsigned long pos;
+    float fade, old_gain, new_gain;
+    
+    _fdns[_fading_level]->process( input, outputs, n_frames );
+    _fdns[_level.load()]->process( input, _fdn_buffers, n_frames );
+    
+    // The new FDN is built up silently first, then faded in with equal power.
+    if ( _fade_pos + n_frames > _warmup_length )
+    {
+        for ( idx = 0; idx < n_frames; idx++ )
+        {
+            pos = _fade_pos + idx;
+            fade = pos < _warmup_length ? 0.f : std::min( float(pos - _warmup_length) / _fade_length, 1.f );
+            old_gain = cosf( fade * float(M_PI) / 2.f );
+            new_gain = sinf( fade * float(M_PI) / 2.f );
+            
+            for ( prt = 0; prt < _n_rev_sources; prt++ ) {
+                outputs[prt][idx] = outputs[prt][idx] * old_gain + _fdn_buffers[prt][idx] * new_gain;
+            }
+        }
+    }
+    
+    _fade_pos += n_frames;
+    if ( _fade_pos >= _warmup_length + _fade_length ) _flush_level = _fading_level;
+}
+
+void SSRverb::DynamicFDNEngine::_govern( float load, unsigned n_frames )
+{
+    // Evaluate peak load per window.
+    _window_load = std::max( _window_load, load );
+    _window_pos += n_frames;
+    if ( _window_pos < _window_length ) return;
+    
+    load = _window_load;
+    _load.store( load );
+    _window_load = 0.f;
+    _window_pos = 0;
+    
+    // The load of a transition includes both FDNs. Wait until it is over and the old FDN is empty.
+    if ( _fade_pos < _warmup_length + _fade_length || _flush_level < n_quality_levels ) return;
+    
+    const unsigned level = _level.load();
+    
+    if ( !_governor_active.load() )
+    {
+        unsigned manual_level = _manual_level.load();
+        if ( manual_level != level ) _step_to( manual_level, load );
+        return;
+    }
+    
+    if ( load > GOV_HIGH_LOAD )
+    {
+        _n_relaxed_windows = 0;
+        if ( level + 1 < n_quality_levels ) _step_to( level + 1, load );
+    }
+    else if ( load < GOV_LOW_LOAD )
+    {
+        _n_relaxed_windows++;
+        if ( _n_relaxed_windows >= GOV_RELAX_WINDOWS && level > 0 ) _step_to( level - 1, load );
+    }
+    else {
+        _n_relaxed_windows = 0;
+    }
+}
+
+void SSRverb::DynamicFDNEngine::_step_to( unsigned level, float load )
+{
+    const unsigned previous = _level.load();
+    
+    _ism.set_active_order( DFDN_QUALITY_LEVELS[level].ism_order );
+    
+    _fading_level = previous;
+    _fade_pos = 0;
+    _n_relaxed_windows = 0;
+    _level.store( level );
+    _param_swap.store( true );
+    
+    // Pack step into one word: time in ms, levels and load in per mille.
+    unsigned long long time_ms = std::chrono::duration_cast< std::chrono::milliseconds >(
+                                    std::chrono::steady_clock::now() - _start_time ).count();
+    unsigned long long load_pm = (unsigned long long)( std::min( load, 65.f ) * 1000.f );
+    
+    unsigned n_steps = _n_steps.load();
+    _history[n_steps % _history_length].store(
+                                                 ( time_ms & 0xFFFFFFFFull )
+                                               | ( (unsigned long long)( previous & 0xFF ) << 32 )
+                                               | ( (unsigned long long)( level & 0xFF ) << 40 )
+                                               | ( load_pm << 48 )
+                                               );
+    _n_steps.store( n_steps + 1 );
+}
+
+void SSRverb::DynamicFDNEngine::end_cycle( DeadlineWatchdog::Overrun* record )
+{
+    const unsigned long n_updates = _ism.get_n_updates();
+    const bool param_swap = _param_swap.exchange( false );
+    
+    if ( record != nullptr ) {
+        record->ism_update = n_updates != _last_n_updates;
+        record->param_swap = param_swap;
+        record->n_taps = std::min( _ism.get_n_taps(), 65535u );
+        record->quality_level = _level.load();
+    }
+    _last_n_updates = n_updates;
+}
+
+void SSRverb::DynamicFDNEngine::_prepare_mix( unsigned n_frames )
+{
+    // Parameters are loaded once per block.
+    const float mix = _fdn_ism_mix.load();
+    const float gain = _gain.load();
+    
+    _fdn_coeff_target = mix * _fdn_gain.load() * gain;
+    _ism_coeff_target = (1.f - mix) * _ism_gain.load() * gain;
+    
+    if ( n_frames == 0 ) n_frames = 1;
+    _fdn_coeff_step = (_fdn_coeff_target - _fdn_coeff) / float(n_frames);
+    _ism_coeff_step = (_ism_coeff_target - _ism_coeff) / float(n_frames);
+}
+
+void SSRverb::DynamicFDNEngine::_mix_outputs( float** outputs, unsigned n_frames )
+{
+    const float fdn_start = _fdn_coeff;
+    const float ism_start = _ism_coeff;
+    const float fdn_step = _fdn_coeff_step;
+    const float ism_step = _ism_coeff_step;
+    
+    for ( unsigned prt = 0; prt < _n_rev_sources; prt++ )
+    {
+        float* __restrict out = outputs[prt];
+        const float* __restrict ism = _internal_buffers[prt];
+        
+        // Single pass over the block, free of loop carried dependencies.
+        for ( unsigned idx = 0; idx < n_frames; idx++ ) {
+            out[idx] = out[idx] * ( fdn_start + fdn_step * float(idx) )
+                     + ism[idx] * ( ism_start + ism_step * float(idx) );
+        }
+    }
+    
+    _fdn_coeff += fdn_step * float(n_frames);
+    _ism_coeff += ism_step * float(n_frames);
+}
+
+void SSRverb::DynamicFDNEngine::set_rec_pos( Vector3D new_pos )
+{
+    _ism.set_receiver( new_pos );
+}
+
+void SSRverb::DynamicFDNEngine::set_rec_orientation( float azimuth )
+{
+    // The FDN is diffuse, only the reflections turn.
+    _ism.set_receiver_orientation( azimuth );
+}
+
+void SSRverb::DynamicFDNEngine::set_src_pos( Vector3D new_pos )
+{
+    _ism.set_source( new_pos );
+}
+
+void SSRverb::DynamicFDNEngine::set_tracked_source( unsigned source_id )
+{
+    _ism.set_tracked_source( source_id );
+}
+
+void SSRverb::DynamicFDNEngine::set_gain( float new_gain )
+{
+    _gain.store( new_gain );
+}
+
+void SSRverb::DynamicFDNEngine::set_fdn_ism_mix( float new_mix )
+{
+    _fdn_ism_mix.store( new_mix );
+}
+
+void SSRverb::DynamicFDNEngine::set_ism_gain( float new_gain )
+{
+    _ism_gain.store( new_gain );
+}
+
+void SSRverb::DynamicFDNEngine::set_fdn_gain( float new_gain )
+{
+    _fdn_gain.store( new_gain );
+}
+
+void SSRverb::DynamicFDNEngine::set_room_size( float x, float y, float z )
+{
+    for ( unsigned lvl = 0; lvl < n_quality_levels; lvl++ ) {
+        _fdns[lvl]->set_boundries( x, y, z );
+    }
+    _ism.set_room_dimensions( y, x, z );
+    _param_swap.store( true );
+}
+
+void SSRverb::DynamicFDNEngine::set_t60( float t60_value, unsigned band_idx )
+{
+    if ( band_idx < _n_bands )
+    {
+        _t60_times[band_idx] = t60_value;
+        
+        for ( unsigned lvl = 0; lvl < n_quality_levels; lvl++ ) {
+            _fdns[lvl]->set_t60( t60_value, band_idx );
+        }
+        _ism.set_t60( t60_value, band_idx );
+        _param_swap.store( true );
+    }
+
+}
+
+void SSRverb::DynamicFDNEngine::set_co_freqs( std::vector<float> co_freqs )
+{
+    for ( unsigned lvl = 0; lvl < n_quality_levels; lvl++ ) {
+        _fdns[lvl]->set_co_freqs( co_freqs );
+    }
+    _ism.set_co_freqs( co_freqs );
+    _param_swap.store( true );
+}
+
+void SSRverb::DynamicFDNEngine::set_tracking( bool status )
+{
+    // Move tracked source in front of receiver.
+    //_ism.set_source( _ism.get_receiver() + Vector3D{0.f, 1.f, 0.f} );
+    _ism.set_tracking( status );
+}
+
+bool SSRverb::DynamicFDNEngine::get_tracking()
+{
+    return _ism.get_tracking();
+}
+
+void SSRverb::DynamicFDNEngine::set_seed( unsigned seed )
+{
+    for ( unsigned lvl = 0; lvl < n_quality_levels; lvl++ ) {
+        _fdns[lvl]->set_seed( seed + lvl );
+    }
+}
+
+bool SSRverb::DynamicFDNEngine::is_idle()
+{
+    return _fdns[_level.load()]->is_idle() && _ism.is_idle();
+}
+
+SSRverb::ISMverb* SSRverb::DynamicFDNEngine::get_ism()
+{
+    return &_ism;
+}
+
+void SSRverb::DynamicFDNEngine::set_profiler( DspProfiler* profiler )
+{
+    _profiler = profiler;
+    _ism.set_profiler( profiler );
+}
+
+void SSRverb::DynamicFDNEngine::set_governor( bool status )
+{
+    // Continue manually from where the governor stopped.
+    if ( !status ) _manual_level.store( _level.load() );
+    _governor_active.store( status );
+}
+
+bool SSRverb::DynamicFDNEngine::get_governor()
+{
+    return _governor_active.load();
+}
+
+void SSRverb::DynamicFDNEngine::set_quality_level( unsigned level )
+{
+    _manual_level.store( std::min( level, n_quality_levels - 1 ) );
+}
+
+void SSRverb::DynamicFDNEngine::switch_quality_level( unsigned level )
+{
+    level = std::min( level, n_quality_levels - 1 );
+    
+    _fdns[level]->clear();
+    _ism.switch_active_order( DFDN_QUALITY_LEVELS[level].ism_order );
+    
+    // No transition in progress, so the governor continues from this level.
+    _fade_pos = _warmup_length + _fade_length;
+    _flush_level = n_quality_levels;
+    _n_relaxed_windows = 0;
+    _manual_level.store( level );
+    _level.store( level );
+    _param_swap.store( true );
+}
+
+unsigned SSRverb::DynamicFDNEngine::get_quality_level()
+{
+    return _level.load();
+}
+
+SSRverb::DynamicFDNEngine::QualityLevel SSRverb::DynamicFDNEngine::get_quality_settings( unsigned level )
+{
+    return DFDN_QUALITY_LEVELS[ std::min( level, n_quality_levels - 1 ) ];
+}
+
+unsigned SSRverb::DynamicFDNEngine::get_tap_budget()
+{
+    return _ism.get_tap_budget( DFDN_QUALITY_LEVELS[_level.load()].ism_order );
+}
+
+float SSRverb::DynamicFDNEngine::get_load()
+{
+    return _load.load();
+}
+
+std::vector< SSRverb::DynamicFDNEngine::QualityStep > SSRverb::DynamicFDNEngine::get_quality_history()
+{
+    std::vector< QualityStep > history;
+    
+    unsigned n_steps = _n_steps.load();
+    unsigned first = n_steps > _history_length ? n_steps - _history_length : 0;
+    
+    unsigned long long entry;
+    for ( unsigned step = first; step < n_steps; step++ )
+    {
+        entry = _history[step % _history_length].load();
+        
+        QualityStep this_step;
+        this_step.time = ( entry & 0xFFFFFFFFull ) / 1000.0;
+        this_step.from = ( entry >> 32 ) & 0xFF;
+        this_step.to = ( entry >> 40 ) & 0xFF;
+        this_step.load = ( entry >> 48 ) / 1000.f;
+        
+        history.push_back( this_step );
+    }
+    
+    return history;
+}
@@ -9,8 +9,10 @@
 #include "FDN.hpp"
 #include "prime.h"
 #include "tools.h"
+#include "reverbs/include/Denormals.hpp"
 
 #include <math.h>
+#include <algorithm>
 
 SSRverb::FDN::FDN( unsigned sample_rate, unsigned n_fbpaths, unsigned n_rev_sources ) :
 _n_fbpaths( n_fbpaths ), _n_rev_sources( n_rev_sources )
@@ -56,10 +58,35 @@ SSRverb::FDN::~FDN()
     delete [] _delays;
 }
 
+void SSRverb::FDN::prepare( unsigned sample_rate, unsigned max_block_size )
+{
+    if ( sample_rate == _sample_rate ) return;
+    
+    _sample_rate = sample_rate;
+    set_boundries( _boundries[0], _boundries[1], _boundries[2] );
+    clear();
+}
+
+unsigned SSRverb::FDN::get_n_outputs()
+{
+    return _n_rev_sources;
+}
+
 void SSRverb::FDN::process( float* input, float** outputs, unsigned n_frames )
 {
     unsigned idx, path, row, col, path_map, out;
     
+    // Idle path, only write silence.
+    if ( _silence.check_input( input, n_frames ) )
+    {
+        for ( out = 0; out < _n_rev_sources; out++ ) {
+            for ( idx = 0; idx < n_frames; idx++ ) {
+                outputs[out][idx] = 0.f;
+            }
+        }
+        return;
+    }
+    
     for ( idx = 0; idx < n_frames; idx++ ) {
         // Set outputs to zero
         for ( out = 0; out < _n_rev_sources; out++) {
@@ -81,9 +108,83 @@ void SSRverb::FDN::process( float* input, float** outputs, unsigned n_frames )
             {
                 _matrix_outs[row][0] += _fb_matrix[row][col] * _delay_outs[col][0];
             }
+            // Keep the feedback free of subnormals without relying on the FPU mode.
+            _matrix_outs[row][0] = flush_denormal( _matrix_outs[row][0] );
+        }
+    }
+    
+    // Flush the feedback state once the tail decayed.
+    if ( _silence.check_output( outputs, _n_rev_sources, n_frames ) ) {
+        _reset_buffers();
+    }
+}
+
+bool SSRverb::FDN::is_idle()
+{
+    return _silence.is_idle();
+}
+
+void SSRverb::FDN::set_idle_detection( bool status )
+{
+    _silence.set_enabled( status );
+}
+
+void SSRverb::FDN::clear()
+{
+    _clear_path = 0;
+    _clear_pos = 0;
+    clear_part( ~0u );
+}
+
+bool SSRverb::FDN::clear_part( unsigned max_samples )
+{
+    // Push zeros through every delay line.
+    while ( _clear_path < _n_fbpaths && max_samples > 0 )
+    {
+        const unsigned length = _delays[_clear_path].get_delay() + 1;
+        const unsigned n_samples = std::min( length - _clear_pos, max_samples );
+        for ( unsigned idx = 0; idx < n_samples; idx++ ) {
+            _delays[_clear_path]( 0.f );
+        }
+        
+        _clear_pos += n_samples;
+        max_samples -= n_samples;
+        if ( _clear_pos == length ) {
+            _clear_path++;
+            _clear_pos = 0;
         }
     }
+    if ( _clear_path < _n_fbpaths ) return false;
     
+    _clear_path = 0;
+    _reset_buffers();
+    _silence.reset();
+    return true;
+}
+
+void SSRverb::FDN::set_seed( unsigned seed )
+{
+    _mt.seed( seed );
+    set_boundries( _boundries[0], _boundries[1], _boundries[2] );
+}
+
+unsigned SSRverb::FDN::get_n_fbpaths()
+{
+    return _n_fbpaths;
+}
+
+void SSRverb::FDN::_update_tail_length()
+{
+    unsigned max_delay = 0;
+    for ( unsigned path = 0; path < _n_fbpaths; path++ ) {
+        max_delay = std::max( max_delay, _delays[path].get_delay() );
+    }
+    
+    float max_t60 = std::max( _t60_values[0], std::max( _t60_values[1], _t60_values[2] ) );
+    
+    // The output is only meaningful once the longest path was passed.
+    _silence.set_hold_length( max_delay );
+    _silence.set_tail_length( max_delay + SilenceDetector::decay_length( max_t60, _sample_rate, _silence.get_threshold_db() ) );
 }
 
 void SSRverb::FDN::_compute_delays()
@@ -141,6 +242,11 @@ void SSRverb::FDN::set_boundries( float x, float y, float z )
     }
 }
 
+void SSRverb::FDN::set_room_size( float x, float y, float z )
+{
+    set_boundries( x, y, z );
+}
+
 void SSRverb::FDN::set_t60( float t60_value, unsigned band_idx )
 {
     float weight;
@@ -151,6 +257,8 @@ void SSRverb::FDN::set_t60( float t60_value, unsigned band_idx )
         _delays[path].set_band_weight( weight, band_idx );
     }
     _t60_values[band_idx] = t60_value;
+    
+    _update_tail_length();
 }
 
 void SSRverb::FDN::set_co_freqs( std::vector<float> co_freqs )
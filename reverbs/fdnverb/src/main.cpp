@@ -6,91 +6,73 @@
 //  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
 //
 
-//#include "DynamicFDN.hpp"
-#include "laproc/include/JackPlugin.hpp"
-#include "FDN.hpp"
-#include "DynamicFDN.hpp"
-#include "ssrface/include/SceneManager.hpp"
-#include <iostream>
-#include "tools.h"
+//  Renders the impulse response of the ISM/FDN reverberator without JACK.
 
-class JackFDN : public JackPlugin, public SSRverb::FDN
-{
-public:
-    JackFDN() : JackPlugin("FDN", 1, 8 ), FDN(JackPlugin::_sample_rate, 24, 8) {
-        FDN::set_boundries( 4, 6, 3 );
-        FDN::set_t60( 3, 0 );
-        FDN::set_t60( 2, 1 );
-        FDN::set_t60( 1, 2 );
-        FDN::set_co_freqs(std::vector<float>{ 300, 3000 });
-    };
-    
-    void render_audio(
-                                  jack_nframes_t n_frames
-                                  , jack_sample **in_buffers
-                                  , jack_sample **out_buffers
-                                  )
-    {
-        FDN::process( in_buffers[0],  out_buffers, n_frames );
-    };
-};
+#include "DynamicFDNEngine.hpp"
+#include <sndfile.h>
+#include <vector>
+#include <stdio.h>
 
-int main()
+const unsigned SAMPLE_RATE = 44100;
+const unsigned BLOCK_SIZE = 64;
+
+int main( int argc, char** argv )
 {
-    SSRverb::DynamicFDN reverb;
-//    reverb.set_ssr_address("127.0.0.1", 4711);
-//    reverb.connect();
-//    reverb.clear_scene();
-//    reverb.run();
-//    reverb.setup_rev_sources();
-//    usleep(100000);
+    const char* file_path = argc > 1 ? argv[1] : "imp_resp.wav";
+    const unsigned long length = 3 * SAMPLE_RATE;
+    
+    SSRverb::DynamicFDNEngine reverb( SAMPLE_RATE, BLOCK_SIZE );
+    const unsigned n_outputs = reverb.get_n_outputs();
+    
+    // Offline rendering is not time critical, keep the best quality.
+    reverb.set_governor( false );
     
     reverb.set_fdn_gain( 1.f );
     reverb.set_ism_gain( 1.f );
     reverb.set_room_size( 16.f, 29.f, 6.f );
     
-    reverb.set_src_pos( Vector3D{3.5f, 4.5f, 1.78f} );
-    reverb.set_rec_pos( Vector3D{2.5f, 2.5f, 1.78f} );
+    reverb.set_src_pos( SSRverb::Vector3D{3.5f, 4.5f, 1.78f} );
+    reverb.set_rec_pos( SSRverb::Vector3D{2.5f, 2.5f, 1.78f} );
     
     reverb.set_t60( 5, 0 );
     reverb.set_t60( 3, 1 );
     reverb.set_t60( 0.8, 2 );
     
-    reverb.write_imp_resp(3*44100);
-
-    //reverb.write_imp_resp(4*44100);
+    SF_INFO format;
+    format.samplerate = SAMPLE_RATE;
+    format.channels = n_outputs;
+    format.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
     
+    SNDFILE* file = sf_open( file_path, SFM_WRITE, &format );
+    if ( file == nullptr ) {
+        printf( "Could not open %s: %s\n", file_path, sf_strerror( nullptr ) );
+        return 1;
+    }
     
-//    usleep(100000);
-//
-//    foo.remove_rev_sources();
-//
-//    auto ids = foo.get_scene()->get_source_ids();
-//    for (unsigned idx = 0; idx < ids.size(); idx++) {
-//        printf("%s\n", foo.get_scene()->get_source(ids[idx])->name.c_str() );
-//    }
-//    
-//    foo.disconnect();
-//    foo.deactivate();
-//    
-//    foo.connect();
-//    foo.run();
-//    
-//    foo.setup_rev_sources();
-//    
-//    usleep(100000);
-//    
-//    ids = foo.get_scene()->get_source_ids();
-//    for (unsigned idx = 0; idx < ids.size(); idx++) {
-//        printf("%s\n", foo.get_scene()->get_source(ids[idx])->name.c_str() );
-//    }
-//    
-//    foo.remove_rev_sources();
-//    
-//    foo.disconnect();
-//    foo.deactivate();
+    std::vector< float > input( BLOCK_SIZE, 0.f );
+    std::vector< float > samples( BLOCK_SIZE * n_outputs );
+    std::vector< float > interleaved( BLOCK_SIZE * n_outputs );
+    std::vector< float* > outputs( n_outputs );
+    for ( unsigned out = 0; out < n_outputs; out++ ) {
+        outputs[out] = samples.data() + out * BLOCK_SIZE;
+    }
     
+    input[0] = 1.f;
+    for ( unsigned long done = 0; done < length; done += BLOCK_SIZE )
+    {
+        reverb.process( input.data(), outputs.data(), BLOCK_SIZE );
+        input[0] = 0.f;
+        
+        for ( unsigned idx = 0; idx < BLOCK_SIZE; idx++ ) {
+            for ( unsigned out = 0; out < n_outputs; out++ ) {
+                interleaved[idx * n_outputs + out] = outputs[out][idx];
+            }
+        }
+        sf_writef_float( file, interleaved.data(), BLOCK_SIZE );
+    }
     
-    return 0;
+    sf_close( file );
+    printf( "Impulse response written to %s\n", file_path );
     
+    return 0;
 }
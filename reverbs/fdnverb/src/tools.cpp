@@ -1,6 +1,6 @@
-#include <iostream>
 #include <math.h>
 #include "tools.h"
+#include "reverbs/include/Logger.hpp"
 
 SSRverb::Matrix SSRverb::hadamard(unsigned order, float gain)
 {
@@ -594,7 +594,7 @@ SSRverb::Matrix SSRverb::hadamard(unsigned order, float gain)
     }
     
     else if ( !is_pow2(order) ) {
-        std::cout << "Order must be power of 2 or 24" << std::endl;
+        SSRVERB_LOG_ERROR( "Order must be power of 2 or 24" );
         hadamatrix.resize(0);
     }
     
@@ -0,0 +1,119 @@
+//
+//  DeadlineWatchdog.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef DeadlineWatchdog_hpp
+#define DeadlineWatchdog_hpp
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "DspProfiler.hpp"
+
+namespace SSRverb {
+
+/**
+@class DeadlineWatchdog
+Keeps a record of every processing cycle that came close to its deadline.
+
+The audio thread reports cycles exceeding a fraction of the period duration
+into a lock-free single producer, single consumer ring. Records are taken
+out by a non real-time thread, either the export thread or a caller of
+pop_all(). In case the ring is full, records are dropped and counted.
+*/
+class DeadlineWatchdog
+{
+public:
+    /** @brief Compact description of one late cycle. */
+    struct Overrun
+    {
+        /** Wall clock time at the end of the cycle in seconds since the epoch. */
+        double time;
+        uint32_t period_frames;
+        float deadline_us;
+        float duration_us;
+        /** Slowest stage, DspProfiler::N_STAGES if no stage was timed. */
+        uint8_t worst_stage;
+        float worst_stage_us;
+        /** ISM taps were recomputed in this cycle. */
+        bool ism_update;
+        /** Parameters were changed or swapped in this cycle. */
+        bool param_swap;
+        /** Number of ISM delay taps in use. */
+        uint16_t n_taps;
+        /** Quality level of the governor. */
+        uint8_t quality_level;
+    };
+    
+    /** @param threshold Fraction of the deadline above which a cycle is recorded. */
+    DeadlineWatchdog( float threshold = 0.8f );
+    ~DeadlineWatchdog();
+    
+    /** @brief Changes the fraction of the deadline above which a cycle is recorded. */
+    void set_threshold( float threshold );
+    float get_threshold();
+    
+    /** @returns True in case a cycle of this duration must be recorded. */
+    bool is_late( double duration_s, double deadline_s );
+    
+    /** @brief Stores a record. Real-time safe, only call from the audio thread. */
+    void push( const Overrun& record );
+    
+    /** @returns All records stored since the last call, oldest first. Not while the export thread runs. */
+    std::vector< Overrun > pop_all();
+    
+    /**
+    @brief Starts a thread that periodically takes out the records and appends them to a file.
+    
+    Every record is written as one line, see print(). Records dropped since
+    the last export are reported in a line of their own.
+    @param file_path nullptr writes to stderr.
+    @param interval_ms Time between two exports.
+    */
+    void start_export( const char* file_path = nullptr, unsigned interval_ms = 1000 );
+    
+    /** @brief Stops the export thread, e.g. to take out the records with pop_all() instead. */
+    void stop_export();
+    
+    /** @returns Number of recorded cycles since construction, including dropped ones. */
+    unsigned long get_n_overruns();
+    
+    /** @returns Number of records dropped because the ring was full. */
+    unsigned long get_n_dropped();
+    
+    /** @brief Writes a record as one human readable line. */
+    static void print( FILE* file, const Overrun& record );
+    
+private:
+    static const unsigned _capacity = 256;
+    
+    Overrun _ring[_capacity];
+    std::atomic<unsigned> _write_pos{ 0 };
+    std::atomic<unsigned> _read_pos{ 0 };
+    
+    std::atomic<float> _threshold;
+    std::atomic<unsigned long> _n_overruns{ 0 };
+    std::atomic<unsigned long> _n_dropped{ 0 };
+    
+    std::thread _export_thread;
+    std::mutex _export_mtx;
+    std::condition_variable _export_cv;
+    bool _exporting = false;
+    
+    /** @brief Appends the records taken out since the last call. */
+    void _export( const std::string& path, unsigned long& n_reported_dropped );
+};
+
+} // namespace SSRverb
+
+#endif /* DeadlineWatchdog_hpp */
@@ -0,0 +1,74 @@
+//
+//  Denormals.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef Denormals_hpp
+#define Denormals_hpp
+
+#include <float.h>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+namespace SSRverb {
+
+/**
+@class DenormalGuard
+Enables flush-to-zero and denormals-are-zero for the lifetime of an instance.
+
+Decaying feedback loops and IIR filters end up in subnormal floats, which are
+very slow on x86. Create an instance at the top of every audio or worker
+thread function. The previous state is restored on destruction.
+*/
+class DenormalGuard
+{
+public:
+    DenormalGuard()
+    {
+#if defined(__SSE__) || defined(_M_X64)
+        _saved = _mm_getcsr();
+        // FTZ is bit 15, DAZ is bit 6.
+        _mm_setcsr( _saved | 0x8040 );
+#elif defined(__aarch64__)
+        __asm__ __volatile__( "mrs %0, fpcr" : "=r"( _saved ) );
+        // FZ is bit 24.
+        __asm__ __volatile__( "msr fpcr, %0" : : "r"( _saved | ( 1ul << 24 ) ) );
+#endif
+    };
+    
+    ~DenormalGuard()
+    {
+#if defined(__SSE__) || defined(_M_X64)
+        _mm_setcsr( _saved );
+#elif defined(__aarch64__)
+        __asm__ __volatile__( "msr fpcr, %0" : : "r"( _saved ) );
+#endif
+    };
+    
+    DenormalGuard( const DenormalGuard& ) = delete;
+    DenormalGuard& operator=( const DenormalGuard& ) = delete;
+    
+private:
+    unsigned long _saved = 0;
+};
+
+/**
+@brief Replaces subnormal values by zero.
+
+For state that must decay cleanly regardless of the floating point mode of
+the calling thread.
+*/
+inline float flush_denormal( float value )
+{
+    return fabsf( value ) < FLT_MIN ? 0.f : value;
+}
+
+} // namespace SSRverb
+
+#endif /* Denormals_hpp */
@@ -0,0 +1,190 @@
+//
+//  DspProfiler.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef DspProfiler_hpp
+#define DspProfiler_hpp
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ Stage statistics are only compiled in when SSRVERB_PROFILE is defined
+ (make PROFILE=1). Otherwise the scopes only add their duration to the
+ current cycle, two timestamps per stage, so the deadline watchdog can
+ still name the slowest stage of a late cycle.
+ */
+#define SSRVERB_PROFILE_CONCAT_( a, b ) a##b
+#define SSRVERB_PROFILE_CONCAT( a, b ) SSRVERB_PROFILE_CONCAT_( a, b )
+
+#ifdef SSRVERB_PROFILE
+#define SSRVERB_PROFILE_SCOPE( profiler, stage ) \
+    SSRverb::DspProfiler::Scope SSRVERB_PROFILE_CONCAT( _profile_scope_, __LINE__ )( profiler, stage )
+#else
+#define SSRVERB_PROFILE_SCOPE( profiler, stage ) \
+    SSRverb::DspProfiler::CycleScope SSRVERB_PROFILE_CONCAT( _profile_scope_, __LINE__ )( profiler, stage )
+#endif
+
+namespace SSRverb {
+
+/**
+@class DspProfiler
+Collects processing time statistics of the stages of a reverberator.
+
+Every instance must only be written by one thread, normally the audio
+thread of its reverberator. Statistics are kept in relaxed atomics, so
+recording never blocks and the export thread can read at any time.
+*/
+class DspProfiler
+{
+public:
+    enum Stage
+    {
+        CYCLE = 0,
+        FDN,
+        ISM_UPDATE,
+        ISM_FILTERBANKS,
+        ISM_DELAYS,
+        MIX,
+        CONVOLUTION,
+        N_STAGES
+    };
+    
+    /** Number of log2 spaced histogram buckets. */
+    static const unsigned n_buckets = 40;
+    
+    /** @brief Statistics of one stage in nanoseconds. */
+    struct StageStats
+    {
+        uint64_t count;
+        double min_ns;
+        double mean_ns;
+        double max_ns;
+        /** Bucket b counts durations below 2^b ticks. */
+        uint64_t histogram[n_buckets];
+        /** Upper bound of every bucket in nanoseconds. */
+        double bucket_limits_ns[n_buckets];
+    };
+    
+    /** @param name Name written to the statistics file. */
+    DspProfiler( const char* name = "reverb" );
+    ~DspProfiler();
+    
+    /** @returns Current timestamp in ticks. TSC on x86, nanoseconds otherwise. */
+    static uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        timespec time_spec;
+        clock_gettime( CLOCK_MONOTONIC, &time_spec );
+        return uint64_t( time_spec.tv_sec ) * 1000000000ull + time_spec.tv_nsec;
+#endif
+    };
+    
+    /** @brief Adds one duration in ticks to a stage. Real-time safe. */
+    void record( Stage stage, uint64_t ticks );
+    
+    /** @brief Adds one duration in ticks to a stage of the current cycle only. Audio thread only. */
+    void record_cycle( Stage stage, uint64_t ticks )
+    {
+        _cycle_ticks[stage] += ticks;
+    };
+    
+    /** @returns Statistics of a stage. */
+    StageStats get_stats( Stage stage );
+    
+    /**
+    @brief Finds the slowest stage since the last call to reset_cycle(). Audio thread only.
+    @param duration_ns Is set to the time spent in that stage.
+    @returns N_STAGES in case no stage was recorded.
+    */
+    Stage get_cycle_worst( double& duration_ns );
+    
+    /** @brief Starts a new cycle for get_cycle_worst(). Audio thread only. */
+    void reset_cycle();
+    
+    /** @returns Name of a stage. */
+    static const char* get_stage_name( Stage stage );
+    
+    /**
+    @brief Starts a thread that periodically writes the statistics to a file.
+    @param file_path Statistics are written as JSON in case the path ends in ".json", as text otherwise.
+    @param interval_ms Time between two exports.
+    */
+    void start_export( const char* file_path, unsigned interval_ms = 1000 );
+    
+    /** @brief Stops the export thread. */
+    void stop_export();
+    
+    /** @brief Writes the statistics once. @returns False in case the file could not be written. */
+    bool write_stats( const char* file_path );
+    
+    /** @brief Measures the duration of a scope. */
+    class Scope
+    {
+    public:
+        Scope( DspProfiler* profiler, Stage stage ) : _profiler( profiler ), _stage( stage ), _start( now() ) {};
+        ~Scope() { if ( _profiler ) _profiler->record( _stage, now() - _start ); };
+    private:
+        DspProfiler* _profiler;
+        Stage _stage;
+        uint64_t _start;
+    };
+    
+    /** @brief Measures the duration of a scope for the current cycle only. */
+    class CycleScope
+    {
+    public:
+        CycleScope( DspProfiler* profiler, Stage stage ) : _profiler( profiler ), _stage( stage ), _start( now() ) {};
+        ~CycleScope() { if ( _profiler ) _profiler->record_cycle( _stage, now() - _start ); };
+    private:
+        DspProfiler* _profiler;
+        Stage _stage;
+        uint64_t _start;
+    };
+    
+private:
+    std::string _name;
+    
+    struct Counters
+    {
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> sum{ 0 };
+        std::atomic<uint64_t> min{ UINT64_MAX };
+        std::atomic<uint64_t> max{ 0 };
+        std::atomic<uint64_t> histogram[n_buckets];
+    };
+    Counters _counters[N_STAGES];
+    
+    // Time per stage in the current cycle, only touched by the audio thread.
+    uint64_t _cycle_ticks[N_STAGES];
+    
+    // Reference points to convert ticks to nanoseconds.
+    uint64_t _start_ticks;
+    uint64_t _start_ns;
+    double _ns_per_tick();
+    static uint64_t _monotonic_ns();
+    
+    std::thread _export_thread;
+    std::mutex _export_mtx;
+    std::condition_variable _export_cv;
+    bool _exporting = false;
+};
+
+} // namespace SSRverb
+
+#endif /* DspProfiler_hpp */
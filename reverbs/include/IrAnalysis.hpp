@@ -0,0 +1,103 @@
+//
+//  IrAnalysis.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef IrAnalysis_hpp
+#define IrAnalysis_hpp
+
+#include <vector>
+
+namespace SSRverb {
+
+/**
+@class IrAnalysis
+Measures of rendered reverb signals, used to compare them against references.
+
+Signals are split into the frequency bands of the reverberators. Per band the
+energy decay curve is computed by Schroeder backward integration and the
+reverberation time is estimated from its slope.
+*/
+class IrAnalysis
+{
+public:
+    /** @brief Differences between a signal and its reference. The larger value of all bands. */
+    struct Comparison
+    {
+        float max_abs_error = 0.f;
+        /** Largest difference of the energy decay curves in dB, down to the dynamic range. */
+        float max_decay_diff_db = 0.f;
+        /** Largest difference of the reverberation times relative to the reference. */
+        float max_t60_diff = 0.f;
+    };
+    
+    /**
+    @param sample_rate Sample rate of the analysed signals.
+    @param co_freqs Crossover frequencies of the bands.
+    @param dynamic_range_db Energy decay curves are compared down to this level below the start.
+    */
+    IrAnalysis(  unsigned sample_rate
+               , std::vector< float > co_freqs = std::vector< float >{ 300.f, 3000.f }
+               , float dynamic_range_db = 60.f
+               );
+    
+    /** @returns Number of analysed frequency bands. */
+    unsigned get_n_bands();
+    
+    /**
+    @brief Splits a signal into the frequency bands.
+    @param bands Filled with one signal per band.
+    */
+    void split_bands( const float* signal, unsigned long n_samples, std::vector< std::vector< float > >& bands );
+    
+    /** @returns Reverberation time of every band in s. 0 where the decay is too short to fit. */
+    std::vector< float > get_t60s( const float* signal, unsigned long n_samples );
+    
+    /** @brief Compares signal against reference band by band. */
+    Comparison compare( const float* reference, const float* signal, unsigned long n_samples );
+    
+    /** @returns Largest absolute sample difference. */
+    static float max_abs_error( const float* reference, const float* signal, unsigned long n_samples );
+    
+    /**
+    @brief Schroeder backward integration.
+    @param curve_db Filled with the remaining energy in dB relative to the total energy.
+    */
+    static void decay_curve( const float* signal, unsigned long n_samples, std::vector< float >& curve_db );
+    
+    /**
+    @brief Reverberation time from the slope of an energy decay curve.
+    
+    A line is fitted between -5 and -35 dB and extrapolated to -60 dB. Curves
+    that do not reach -35 dB are fitted down to -25 dB.
+    @returns Reverberation time in s. 0 if the curve does not reach -25 dB.
+    */
+    static float estimate_t60( const std::vector< float >& curve_db, unsigned sample_rate );
+    
+    /**
+    @brief Normalized echo density after Abel and Huang.
+    
+    Fraction of samples outside one standard deviation of a sliding window,
+    relative to the fraction expected for gaussian noise. Sparse early
+    reflections are well below 1, a fully diffuse tail is about 1.
+    @param density Filled with the density of every hop, at the window centers.
+    @param window_length Window length in s.
+    @param hop_length Distance of the evaluated windows in s.
+    */
+    static void echo_density(  const float* signal, unsigned long n_samples, unsigned sample_rate
+                             , std::vector< float >& density, float window_length = .02f, float hop_length = .001f );
+    
+private:
+    unsigned _sample_rate;
+    std::vector< float > _co_freqs;
+    float _dynamic_range_db;
+    
+    static float _fit_decay( const std::vector< float >& curve_db, float start_db, float end_db, unsigned sample_rate );
+};
+
+} // namespace SSRverb
+
+#endif /* IrAnalysis_hpp */
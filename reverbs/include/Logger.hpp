@@ -0,0 +1,206 @@
+//
+//  Logger.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef Logger_hpp
+#define Logger_hpp
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <type_traits>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ Logs a printf style message. Every call site is rate limited on its own.
+ The format must be a string literal, string arguments are copied.
+ */
+#define SSRVERB_LOG( level, ... ) \
+    do { \
+        static SSRverb::Logger::RateLimit _log_rate_limit; \
+        SSRverb::Logger::get().log( _log_rate_limit, level, __VA_ARGS__ ); \
+    } while ( 0 )
+
+#define SSRVERB_LOG_DEBUG( ... )   SSRVERB_LOG( SSRverb::Logger::DEBUG, __VA_ARGS__ )
+#define SSRVERB_LOG_INFO( ... )    SSRVERB_LOG( SSRverb::Logger::INFO, __VA_ARGS__ )
+#define SSRVERB_LOG_WARNING( ... ) SSRVERB_LOG( SSRverb::Logger::WARNING, __VA_ARGS__ )
+#define SSRVERB_LOG_ERROR( ... )   SSRVERB_LOG( SSRverb::Logger::ERROR, __VA_ARGS__ )
+
+namespace SSRverb {
+
+/**
+@class Logger
+Lock-free and allocation-free logging, usable from time critical threads.
+
+Producers copy the format string pointer and the arguments into fixed-size
+records of a bounded multi producer ring. A background thread formats the
+records and writes them to the output. In case the ring is full, records
+are dropped and counted, producers never wait.
+*/
+class Logger
+{
+public:
+    enum Level
+    {
+        DEBUG = 0,
+        INFO,
+        WARNING,
+        ERROR,
+        N_LEVELS
+    };
+    
+    /** @brief Per call site message counter, see SSRVERB_LOG. */
+    struct RateLimit
+    {
+        std::atomic<uint64_t> window_start{ 0 };
+        std::atomic<unsigned> count{ 0 };
+        std::atomic<unsigned> suppressed{ 0 };
+    };
+    
+    /** @returns The process wide logger. The first call starts the log thread. */
+    static Logger& get();
+    
+    ~Logger();
+    
+    /** @brief Messages below this level are discarded. INFO by default. */
+    void set_level( Level level );
+    Level get_level();
+    
+    /** @brief Maximum number of messages per second and call site. 20 by default. */
+    void set_rate_limit( unsigned max_per_second );
+    
+    /** @brief Sets the file messages are written to. stderr by default. */
+    void set_output( FILE* file );
+    
+    /** @brief Writes all pending messages. Not real-time safe. */
+    void flush();
+    
+    /** @returns Number of messages dropped because the ring was full. */
+    unsigned long get_n_dropped();
+    
+    /** @returns Name of a level. */
+    static const char* get_level_name( Level level );
+    
+    /** @brief Queues a message. Real-time safe. Use the SSRVERB_LOG macros. */
+    template< typename... Args >
+    void log( RateLimit& rate_limit, Level level, const char* format, const Args&... args )
+    {
+        if ( level < _level.load( std::memory_order_relaxed ) ) return;
+        
+        unsigned suppressed;
+        if ( !_pass_rate_limit( rate_limit, suppressed ) ) return;
+        
+        Record* record = _claim();
+        if ( record == nullptr ) return;
+        
+        record->level = level;
+        record->format = format;
+        record->suppressed = suppressed;
+        record->n_args = 0;
+        record->n_chars = 0;
+        _store_args( *record, args... );
+        
+        _publish( record );
+    };
+    
+private:
+    Logger();
+    
+    static const unsigned _capacity = 1024;
+    static const unsigned _max_args = 8;
+    static const unsigned _max_chars = 128;
+    
+    struct Arg
+    {
+        char type;
+        union
+        {
+            long long i;
+            unsigned long long u;
+            double d;
+            const void* p;
+            unsigned offset;
+        };
+    };
+    
+    struct Record
+    {
+        std::atomic<unsigned> sequence;
+        Level level;
+        double time;
+        const char* format;
+        unsigned suppressed;
+        unsigned n_args;
+        Arg args[_max_args];
+        unsigned n_chars;
+        char chars[_max_chars];
+    };
+    
+    Record* _ring;
+    std::atomic<unsigned> _write_pos{ 0 };
+    unsigned _read_pos = 0;
+    
+    std::atomic<int> _level{ INFO };
+    std::atomic<unsigned> _max_per_second{ 20 };
+    std::atomic<unsigned long> _n_dropped{ 0 };
+    unsigned long _n_dropped_reported = 0;
+    
+    std::atomic<FILE*> _output;
+    
+    std::thread _thread;
+    std::atomic<bool> _running{ true };
+    std::mutex _consumer_mtx;
+    
+    bool _pass_rate_limit( RateLimit& rate_limit, unsigned& suppressed );
+    Record* _claim();
+    void _publish( Record* record );
+    
+    /** @brief Formats and writes all published records. */
+    void _drain();
+    void _write( const Record& record, FILE* file );
+    void _run();
+    
+    // Argument capture. Everything not matching is written as a pointer.
+    void _store_args( Record& record ) {};
+    
+    template< typename T, typename... Args >
+    void _store_args( Record& record, const T& value, const Args&... args )
+    {
+        if ( record.n_args < _max_args ) _store( record, record.args[record.n_args++], value );
+        _store_args( record, args... );
+    };
+    
+    template< typename T >
+    typename std::enable_if< std::is_integral<T>::value && std::is_signed<T>::value >::type
+    _store( Record& record, Arg& arg, const T& value ) { arg.type = 'i'; arg.i = value; };
+    
+    template< typename T >
+    typename std::enable_if< std::is_integral<T>::value && !std::is_signed<T>::value >::type
+    _store( Record& record, Arg& arg, const T& value ) { arg.type = 'u'; arg.u = value; };
+    
+    template< typename T >
+    typename std::enable_if< std::is_floating_point<T>::value >::type
+    _store( Record& record, Arg& arg, const T& value ) { arg.type = 'd'; arg.d = value; };
+    
+    template< typename T >
+    typename std::enable_if< std::is_pointer<T>::value >::type
+    _store( Record& record, Arg& arg, const T& value ) { arg.type = 'p'; arg.p = (const void*)value; };
+    
+    template< size_t N >
+    void _store( Record& record, Arg& arg, const char (&value)[N] ) { _store_string( record, arg, value ); };
+    
+    void _store( Record& record, Arg& arg, const char* const& value ) { _store_string( record, arg, value ); };
+    void _store( Record& record, Arg& arg, char* const& value ) { _store_string( record, arg, value ); };
+    
+    void _store_string( Record& record, Arg& arg, const char* value );
+};
+
+} // namespace SSRverb
+
+#endif /* Logger_hpp */
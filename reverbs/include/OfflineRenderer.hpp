@@ -0,0 +1,89 @@
+//
+//  OfflineRenderer.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef OfflineRenderer_hpp
+#define OfflineRenderer_hpp
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "ReverbEngine.hpp"
+
+namespace SSRverb {
+
+/**
+@class OfflineRenderer
+Runs reverb engines on sound files as fast as possible, without JACK.
+
+Input files are read in blocks through libsndfile and mixed down to mono.
+The reverb source outputs are written to one multichannel file per input.
+Several files are rendered in parallel, each with its own engine.
+*/
+class OfflineRenderer
+{
+public:
+    /** @brief Creates a prepared engine for the given sample rate and block size. */
+    typedef std::function< std::unique_ptr< ReverbEngine >( unsigned sample_rate, unsigned block_size ) > EngineFactory;
+    
+    /** @brief One input file and the file its result is written to. */
+    struct Job
+    {
+        std::string input_path;
+        std::string output_path;
+    };
+    
+    /** @brief Outcome of one job. */
+    struct Result
+    {
+        bool success;
+        std::string message;
+        unsigned sample_rate;
+        unsigned long n_frames;
+        /** Processing time in seconds, excluding file access. */
+        double process_time;
+        /** Total time in seconds including file access. */
+        double wall_time;
+        /** Duration of the rendered audio relative to the total time. */
+        double realtime_factor;
+    };
+    
+    /**
+    @param factory Called once per job to create its engine.
+    @param block_size Number of frames read and processed at once.
+    @param tail_length Seconds rendered after the end of the input to catch the reverb tail.
+    */
+    OfflineRenderer( EngineFactory factory, unsigned block_size = 1024, float tail_length = 2.f );
+    
+    /** @brief Renders one file in the calling thread. */
+    Result render( const Job& job );
+    
+    /**
+    @brief Renders all jobs, n_threads at a time.
+    @param n_threads Number of threads. 0 uses one thread per core.
+    @param on_done Called after each job with its index, from the worker thread. May be empty.
+    @returns Results in the order of the jobs.
+    */
+    std::vector< Result > render_all(  const std::vector< Job >& jobs
+                                     , unsigned n_threads = 0
+                                     , std::function< void( unsigned, const Result& ) > on_done = nullptr
+                                     );
+    
+    /** @returns Output path in out_dir, or next to the input if empty, with "_reverb" appended to the name. */
+    static std::string make_output_path( const std::string& input_path, const std::string& out_dir );
+    
+private:
+    EngineFactory _factory;
+    unsigned _block_size;
+    float _tail_length;
+};
+
+} // namespace SSRverb
+
+#endif /* OfflineRenderer_hpp */
@@ -0,0 +1,92 @@
+//
+//  RevSourceRegistry.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef RevSourceRegistry_hpp
+#define RevSourceRegistry_hpp
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstring>
+
+#include "SceneDiff.hpp"
+
+namespace SSRverb {
+
+/**
+@class RevSourceRegistry
+SSR IDs of the reverberation sources, in the order they are placed on the circle.
+
+Reverberation sources are recognized by the "rev_" prefix of their name.
+Names are only compared when a source appears in the scene, removed sources
+are dropped. Needs neither JACK nor a connection, so the tracking path can
+be driven by a mock SSR or a scene trace.
+
+Updated on the SceneManager thread, read from any thread.
+*/
+class RevSourceRegistry
+{
+public:
+    /** Name prefix of the reverberation sources. */
+    static constexpr const char* prefix = "rev_";
+    
+    /**
+    @brief Adds new reverberation sources and drops removed ones.
+    @param scene Anything offering get_source( id ) with a name, e.g. ssrface::Scene or TraceScene.
+    @param diff Changes of the scene in this update.
+    */
+    template < typename Scene >
+    void track( Scene* scene, const SceneDiff& diff );
+    
+    /** @returns IDs of the reverberation sources in placement order. */
+    std::vector< unsigned short > get_ids();
+    
+    /** @returns True if the source is a tracked reverberation source. */
+    bool contains( unsigned short id );
+    
+    /** @returns Number of tracked reverberation sources. */
+    unsigned get_n_sources();
+    
+    /**
+    @brief Empties the registry.
+    @returns IDs which were tracked, e.g. to delete the sources.
+    */
+    std::vector< unsigned short > take_all();
+    
+private:
+    void _add( unsigned short id );
+    void _remove( unsigned short id );
+    
+    std::mutex _mtx;
+    std::vector< unsigned short > _ids;
+    std::unordered_map< unsigned short, unsigned > _index;
+};
+
+template < typename Scene >
+void RevSourceRegistry::track( Scene* scene, const SceneDiff& diff )
+{
+    const std::vector< SceneDiff::Change >& added = diff.get_added();
+    const std::vector< unsigned short >& removed = diff.get_removed();
+    if ( added.empty() && removed.empty() ) return;
+    
+    const size_t prefix_length = strlen( prefix );
+    std::lock_guard< std::mutex > lock( _mtx );
+    
+    for ( unsigned idx = 0; idx < added.size(); idx++ )
+    {
+        auto source = scene->get_source( added[idx].id );
+        if ( source == nullptr || strncmp( source->name.c_str(), prefix, prefix_length ) ) continue;
+        _add( added[idx].id );
+    }
+    
+    for ( unsigned idx = 0; idx < removed.size(); idx++ ) _remove( removed[idx] );
+}
+
+} // namespace SSRverb
+
+#endif /* RevSourceRegistry_hpp */
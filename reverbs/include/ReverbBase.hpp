@@ -13,32 +13,95 @@
 #include <algorithm>
 #include <mutex>
 #include <atomic>
+#include <thread>
+#include <condition_variable>
 
 #include "Vector3D.hpp"
+#include "DspProfiler.hpp"
+#include "DeadlineWatchdog.hpp"
+#include "ReverbEngine.hpp"
+#include "SceneTrace.hpp"
+#include "SceneDiff.hpp"
+#include "RevSourceRegistry.hpp"
+#include "Seqlock.hpp"
 #include "laproque/include/JackPlugin.hpp"
 #include "ssrface/include/SceneManager.hpp"
 
 namespace SSRverb {
 
+/**
+@class ReverbBase
+JACK and SSR adapter of a ReverbEngine.
+
+Derived classes own the engine and register it with _set_engine(). The
+audio is passed on to the engine in blocks of the internal block size.
+*/
 class ReverbBase : public laproque::JackPlugin, public ssrface::SceneManager
 {
 public:
+    /**
+    @param name Name of the JACK client.
+    @param n_rev_sources Number of reverberation sources i.e. output ports.
+    @param block_size Internal block size the reverberator is processed with.
+    */
     ReverbBase(   const char* name
                 , unsigned n_rev_sources = 8
+                , unsigned block_size = 64
               );
     
     ~ReverbBase();
     
     /**
-    @brief This is the audio processing callback function. 
-    @param n_frames Number of frames to be processed in this block.
+    @brief This is the JACK audio processing callback function.
+    
+    The JACK period is split into, or collected to, blocks of the internal
+    block size, which are passed on to process_block(). In case the period
+    is a multiple of the internal block size, this happens without latency.
+    Otherwise, samples are buffered and one internal block of latency is
+    introduced and reported to JACK.
+    @param n_frames Number of frames to be processed in this period.
+    @param in_buffers Arrays contining an array with samples for each input.
+    @param out_buffers Arrays contining an array with samples for each output.
+    */
+    void render_audio(  laproque::nframes_t n_frames
+                      , laproque::sample_t **in_buffers
+                      , laproque::sample_t **out_buffers
+                      ) final;
+    
+    /**
+    @brief Processes exactly one internal block. Runs the engine by default.
+    @param n_frames Number of frames, equals the internal block size.
     @param in_buffers Arrays contining an array with samples for each input.
     @param out_buffers Arrays contining an array with samples for each output.
     */
-    virtual void render_audio(  laproque::nframes_t n_frames
-                              , laproque::sample_t **in_buffers
-                              , laproque::sample_t **out_buffers
-                              ) = 0;
+    virtual void process_block(  unsigned n_frames
+                               , laproque::sample_t **in_buffers
+                               , laproque::sample_t **out_buffers
+                               );
+    
+    /** @returns The engine processing the audio, nullptr if none is set. */
+    ReverbEngine* get_engine();
+    
+    /** @returns Block size the reverberator is processed with. */
+    unsigned get_internal_block_size();
+    
+    /** @returns Latency in samples currently introduced by the re-blocking. */
+    unsigned get_latency();
+    
+    /**
+    @returns Profiler holding the processing time statistics of this reverberator.
+    Statistics are only recorded when compiled with SSRVERB_PROFILE.
+    */
+    DspProfiler* get_profiler();
+    
+    /** @returns Watchdog holding the cycles which came close to their deadline. Exports them to stderr by default. */
+    DeadlineWatchdog* get_watchdog();
+    
+    /**
+    @brief Sets the fraction of the JACK period above which a cycle is recorded by the watchdog.
+    @param threshold E.g. 0.8 records all cycles taking longer than 80 % of the period.
+    */
+    void set_watchdog_threshold( float threshold );
     
     /**
     @brief Creates the sources used for reverberation in the SSR.
@@ -68,15 +131,48 @@ public:
     /** @brief Changes the position of the internal virtual receiver. */
     virtual void set_rec_pos( Vector3D new_pos );
     
+    /**
+    @brief Turns the internal virtual receiver, e.g. after the head tracker.
+    
+    The reverberation sources in the SSR turn with it, so they stay where
+    the engine pans the reflections to.
+    @param azimuth Counterclockwise rotation in radians, 0 by default. That is the SSR reference azimuth minus 90 degrees.
+    */
+    virtual void set_rec_orientation( float azimuth );
+    
     /** @brief Set the ID of the source to be tracked in the SSR. */
     virtual void set_tracked_source( unsigned source_id );
 
     /** @brief Change the distance of all reverberation sources.  */
     void set_radius( float new_radius );
     
+    /**
+    @brief Sets how far the reference has to move before the reverberation sources follow.
+    @param dead_band Distance in m, 0.05 by default.
+    */
+    void set_placement_dead_band( float dead_band );
+    
+    /**
+    @brief Sets how often the reverberation sources are moved at most.
+    @param max_rate Updates per second, 20 by default.
+    */
+    void set_placement_rate( float max_rate );
+    
+    /** @returns Number of times the reverberation sources were moved after the reference. */
+    unsigned long get_n_placements();
+    
     /** @returns Vector with the SSR IDs of the reverberation sources. */
     std::vector< unsigned short > get_rev_ids();
     
+    /**
+    @brief Starts recording the scene updates received from the SSR, see SceneTraceRecorder.
+    @returns False if the file could not be opened.
+    */
+    bool start_scene_trace( const char* path );
+    
+    /** @brief Stops the recording of scene updates. */
+    void stop_scene_trace();
+    
     /** @brief Stops SceneManager update process and deactivats JACK client. */
     void end();
     
@@ -86,65 +182,159 @@ public:
     */
     bool is_rev_source( unsigned short id );
     
-    // Called when on new source in SSR.
-    static void track_rev_sources( ssrface::Scene* scene_ptr, void* io_data )
-    {
-        SSRverb::ReverbBase* rev_base = (SSRverb::ReverbBase*)io_data;
-        std::vector< unsigned short > ids = scene_ptr->get_source_ids();
-        
-        ssrface::Source* source;
-        
-        // Loop through source map.
-        for ( unsigned idx = 0; idx < ids.size(); idx++ )
-        {
-            source = scene_ptr->get_source( ids[idx] );
-            if ( source == nullptr ) continue;
-            
-            // Check if name prefix fits.
-            if ( !strncmp( source->name.c_str(), rev_base->_rev_name, rev_base->_prefix_length ) )
-            {
-                // Check if ID is already in list.
-                if ( std::find( rev_base->_rev_source_ids.begin(), rev_base->_rev_source_ids.end(), source->id ) != rev_base->_rev_source_ids.end() ) {
-                    continue;
-                }
-                else {
-                    rev_base->_rev_source_ids.push_back( source->id );
-                }
-            }
-        }
-    };
+    /**
+    @brief Keeps the registry of reverberation sources up to date. Called on every scene update.
+    
+    See RevSourceRegistry::track().
+    @param diff Changes of the scene in this update.
+    */
+    void track_rev_sources( ssrface::Scene* scene_ptr, const SceneDiff& diff );
     
     /** @brief Callback function for SceneManager which trackes the SSR reference position. */
     static void track_reference( ssrface::Scene* scene_ptr, void* io_data )
     {
         SSRverb::ReverbBase* ReverbBase = (SSRverb::ReverbBase*)io_data;
         
+        ReverbBase->_scene_trace.record_reference( scene_ptr );
+        
+        // ssrface::Source only carries the position. The orientation comes from set_rec_orientation().
         ssrface::Source* ref = scene_ptr->get_reference();
         
-        ReverbBase->_rec_pos = Vector3D{ref->x, ref->y, ReverbBase->_rec_pos[2]};
+        ReverbBase->_positions.modify( [ref]( Positions& positions ) {
+            positions.receiver[0] = ref->x;
+            positions.receiver[1] = ref->y;
+        } );
 
-        if ( ReverbBase->_rev_srcs_set.load() ) ReverbBase->_update_rev_sources();
+        if ( ReverbBase->_rev_srcs_set.load() ) ReverbBase->_request_placement( ReverbBase->_get_rec_pos(), ReverbBase->_get_rec_orientation(), false );
     };
     
 protected:
     unsigned _n_rev_sources;
-    std::vector<unsigned short> _rev_source_ids;
-    float _radius = 1.f;
+    RevSourceRegistry _rev_registry;
+    std::atomic<float> _radius{ 1.f };
     
     std::atomic<bool> _rev_srcs_set{ false };
     
-    Vector3D _src_pos;
-    Vector3D _rec_pos;
+    /** Positions written by the SSR, GUI and placement threads. */
+    struct Positions
+    {
+        float source[3];
+        float receiver[3];
+        float receiver_azimuth;
+    };
+    Seqlock< Positions > _positions;
+    
+    std::atomic<unsigned> _tracked_source_id{ 0 };
+    
+    /** @returns Consistent copy of the internal receiver position. */
+    Vector3D _get_rec_pos();
     
-    unsigned _tracked_source_id;
+    /** @returns Consistent copy of the internal source position. */
+    Vector3D _get_src_pos();
     
-    const char* _rev_name = "rev_";
-    const unsigned _prefix_length = 4;
+    /** @returns Orientation of the internal receiver in radians. */
+    float _get_rec_orientation();
     
-    void _update_rev_sources();
+    /**
+    @brief Moves the reverberation sources in the SSR onto the circle around center.
+    @param rotation Counterclockwise rotation of the circle in radians, see set_rec_orientation().
+    @returns False if they are not set up or there is no connection.
+    */
+    bool _update_rev_sources( Vector3D center, float rotation );
     
     std::mutex _mtx;
     
+    // Reverb source placement, coalesced on its own thread.
+    std::thread _placement_thread;
+    std::mutex _placement_mtx;
+    std::condition_variable _placement_cv;
+    Vector3D _placement_target;
+    float _placement_rotation = 0.f;
+    bool _placement_pending = false;
+    bool _placement_forced = false;
+    bool _placement_quit = false;
+    std::atomic<float> _placement_dead_band{ .05f };
+    std::atomic<float> _placement_rate{ 20.f };
+    std::atomic<unsigned long> _n_placements{ 0 };
+    
+    /**
+    @brief Hands a new center of the reverberation sources to the placement thread.
+    Returns immediately. Requests arriving faster than the placement rate are merged.
+    @param rotation Rotation of the reverberation sources around center. Any change moves them.
+    @param forced Move even if the center is within the dead-band, e.g. after a radius change.
+    */
+    void _request_placement( Vector3D center, float rotation, bool forced );
+    
+    /** @brief Placement thread. Sends the latest requested placement at most at the placement rate. */
+    void _placement_loop();
+    
+    void _stop_placement();
+    
+    // Re-blocking of JACK periods to the internal block size.
+    static const unsigned _n_inputs = 1;
+    const unsigned _internal_block_size;
+    
+    float** _in_fifo;
+    float** _out_fifo;
+    float** _in_ptrs;
+    float** _out_ptrs;
+    unsigned _fifo_pos = 0;
+    
+    std::atomic<bool> _buffered{ false };
+    std::atomic<unsigned> _latency{ 0 };
+    
+    void _setup_reblocking( unsigned period_size );
+    
+    DspProfiler _profiler;
+    DeadlineWatchdog _watchdog;
+    
+    ReverbEngine* _engine = nullptr;
+    
+    typedef void (*SceneUpdate)( ssrface::Scene* scene_ptr, const SceneDiff& diff, void* data );
+    
+    SceneTraceRecorder _scene_trace;
+    SceneDiff _scene_diff;
+    SceneUpdate _scene_update = nullptr;
+    void* _scene_update_data = nullptr;
+    
+    /**
+    @brief Sets the function called on scene updates which changed something.
+    It receives the changes, after the update was recorded and the reverberation
+    sources were tracked. Use instead of set_update_callback(), which would
+    bypass both. Must be called before connecting to the SSR.
+    */
+    void _set_scene_update( SceneUpdate callback, void* data );
+    
+    /** @brief SceneManager update callback. Records the update, diffs it and passes on the changes. */
+    static void _on_scene_update( ssrface::Scene* scene_ptr, void* io_data );
+    
+    /**
+    @brief Sets the engine processing the audio and prepares it for the JACK sample rate.
+    Must be called before the client is activated.
+    */
+    void _set_engine( ReverbEngine* engine );
+    
+    /** @brief Splits or collects the period into internal blocks. */
+    void _render_blocks(  laproque::nframes_t n_frames
+                        , laproque::sample_t **in_buffers
+                        , laproque::sample_t **out_buffers
+                        );
+    
+    /**
+    @brief Called at the end of every cycle on the audio thread.
+    
+    Reverberators add what happened in the cycle to the record and reset
+    their per-cycle state.
+    @param record Record of the cycle in case it was late, nullptr otherwise.
+    */
+    virtual void _end_cycle( DeadlineWatchdog::Overrun* record ) {};
+    
+    /** @brief JACK callback, called on the non real-time thread before the period size changes. */
+    static int _buffer_size_callback( jack_nframes_t n_frames, void* arg );
+    
+    /** @brief JACK callback reporting the re-blocking latency on the ports. */
+    static void _latency_callback( jack_latency_callback_mode_t mode, void* arg );
+    
 };
 
 } // SSRverb namspace
@@ -0,0 +1,77 @@
+//
+//  ReverbEngine.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef ReverbEngine_hpp
+#define ReverbEngine_hpp
+
+#include <vector>
+
+#include "Vector3D.hpp"
+
+namespace SSRverb {
+
+/**
+@class ReverbEngine
+Audio backend independent interface of a reverberator.
+
+Engines turn one input channel into get_n_outputs() reverberated channels.
+They know nothing about JACK or the SSR, so they can be run by the JACK
+adapters in ReverbBase, rendered offline faster than real-time or embedded
+in other hosts. Parameters an engine does not support are ignored.
+*/
+class ReverbEngine
+{
+public:
+    virtual ~ReverbEngine() {};
+
+    /**
+    @brief Adapts the engine to the host. Not real-time safe.
+    @param sample_rate Sample rate of the processed signals.
+    @param max_block_size Maximum number of frames passed to process().
+    */
+    virtual void prepare( unsigned sample_rate, unsigned max_block_size ) = 0;
+
+    /**
+    @brief Processes one block.
+
+    Block based engines require n_frames to equal the maximum block size
+    passed to prepare(). All others accept any smaller number of frames.
+    @param input Array with n_frames input samples.
+    @param outputs Arrays for the n_frames samples of each output channel.
+    @param n_frames Number of frames, at most the maximum block size.
+    */
+    virtual void process( float* input, float** outputs, unsigned n_frames ) = 0;
+
+    /** @returns Number of output channels. */
+    virtual unsigned get_n_outputs() = 0;
+
+    /** @brief Changes the reverberation time of one frequency band. */
+    virtual void set_t60( float t60_value, unsigned band_idx ) {};
+
+    /** @brief Changes the crossover frequencies of the frequency bands. */
+    virtual void set_co_freqs( std::vector< float > co_freqs ) {};
+
+    /** @brief Changes the dimensions of the simulated room. */
+    virtual void set_room_size( float x, float y, float z ) {};
+
+    /** @brief Changes the position of the sound source. */
+    virtual void set_src_pos( Vector3D new_pos ) {};
+
+    /** @brief Changes the position of the receiver. */
+    virtual void set_rec_pos( Vector3D new_pos ) {};
+
+    /** @brief Turns the receiver. Counterclockwise in radians, 0 by default. */
+    virtual void set_rec_orientation( float azimuth ) {};
+
+    /** @returns True in case the engine decayed to silence and skips processing. */
+    virtual bool is_idle() { return false; };
+};
+
+} // namespace SSRverb
+
+#endif /* ReverbEngine_hpp */
@@ -0,0 +1,135 @@
+//
+//  SceneDiff.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef SceneDiff_hpp
+#define SceneDiff_hpp
+
+#include <vector>
+#include <unordered_map>
+
+namespace SSRverb {
+
+/**
+@class SceneDiff
+Changes of the SSR scene between two update callbacks.
+
+The SceneManager passes on the whole scene with every update. SceneDiff
+keeps the last known position of every source in a hash map and splits an
+update into added, moved and removed sources, so the callbacks further on
+only handle what actually changed.
+
+Updated and read on the SceneManager thread only.
+*/
+class SceneDiff
+{
+public:
+    /** @brief Source which was added or moved, with its new position. */
+    struct Change
+    {
+        unsigned short id;
+        float x;
+        float y;
+    };
+    
+    /**
+    @brief Compares the scene with the previous one.
+    @param scene Anything offering get_source_ids() and get_source( id ), e.g. ssrface::Scene or TraceScene.
+    */
+    template < typename Scene >
+    void update( Scene* scene );
+    
+    /** @returns Sources which appeared in the last update. */
+    const std::vector< Change >& get_added() const;
+    
+    /** @returns Sources which moved in the last update. */
+    const std::vector< Change >& get_moved() const;
+    
+    /** @returns IDs of the sources which disappeared in the last update. */
+    const std::vector< unsigned short >& get_removed() const;
+    
+    /** @returns True if the last update changed nothing. */
+    bool is_empty() const;
+    
+    /** @returns Last known position of a source, nullptr if it is not in the scene. */
+    const Change* find( unsigned short id ) const;
+    
+    /** @returns Position of a source if it was added or moved in the last update, nullptr otherwise. */
+    const Change* find_changed( unsigned short id ) const;
+    
+    /** @returns Number of sources in the scene. */
+    unsigned get_n_sources() const;
+    
+    /** @brief Forgets all sources, e.g. after a reconnect. */
+    void clear();
+    
+private:
+    struct Entry
+    {
+        Change position;
+        unsigned seen;
+        unsigned changed;
+    };
+    
+    std::unordered_map< unsigned short, Entry > _entries;
+    unsigned _generation = 0;
+    
+    std::vector< Change > _added;
+    std::vector< Change > _moved;
+    std::vector< unsigned short > _removed;
+};
+
+template < typename Scene >
+void SceneDiff::update( Scene* scene )
+{
+    _generation++;
+    _added.clear();
+    _moved.clear();
+    _removed.clear();
+    
+    std::vector< unsigned short > ids = scene->get_source_ids();
+    unsigned n_seen = 0;
+    
+    for ( unsigned idx = 0; idx < ids.size(); idx++ )
+    {
+        auto source = scene->get_source( ids[idx] );
+        if ( source == nullptr ) continue;
+        n_seen++;
+        
+        const Change position{ ids[idx], source->x, source->y };
+        typename std::unordered_map< unsigned short, Entry >::iterator entry = _entries.find( ids[idx] );
+        
+        if ( entry == _entries.end() ) {
+            _entries.emplace( ids[idx], Entry{ position, _generation, _generation } );
+            _added.push_back( position );
+            continue;
+        }
+        
+        entry->second.seen = _generation;
+        if ( entry->second.position.x != position.x || entry->second.position.y != position.y ) {
+            entry->second.position = position;
+            entry->second.changed = _generation;
+            _moved.push_back( position );
+        }
+    }
+    
+    // Only look for removed sources if some are missing.
+    if ( _entries.size() == n_seen ) return;
+    
+    for ( auto entry = _entries.begin(); entry != _entries.end(); )
+    {
+        if ( entry->second.seen != _generation ) {
+            _removed.push_back( entry->first );
+            entry = _entries.erase( entry );
+        }
+        else entry++;
+    }
+}
+
+} // namespace SSRverb
+
+#endif /* SceneDiff_hpp */
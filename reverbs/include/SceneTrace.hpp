@@ -0,0 +1,185 @@
+//
+//  SceneTrace.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef SceneTrace_hpp
+#define SceneTrace_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "ssrface/include/Scene.hpp"
+
+namespace SSRverb {
+
+/**
+@class TraceScene
+Scene state rebuilt from a scene trace.
+
+Offers the parts of ssrface::Scene the SceneManager callbacks use, so the
+callbacks can be driven by a SceneTracePlayer without an SSR.
+*/
+class TraceScene
+{
+public:
+    /** @returns IDs of all sources in the scene. */
+    std::vector< unsigned short > get_source_ids();
+    
+    /** @returns Source with the given ID, nullptr if there is none. */
+    ssrface::Source* get_source( unsigned short id );
+    
+    /** @returns The reference, i.e. the listener position. */
+    ssrface::Source* get_reference();
+    
+    /** @brief Adds a source or changes its position. */
+    void set_source( unsigned short id, float x, float y );
+    
+    /** @brief Names a source. Reverb sources are recognized by their name. */
+    void set_name( unsigned short id, const std::string& name );
+    
+    void remove_source( unsigned short id );
+    
+    void set_reference( float x, float y );
+    
+private:
+    std::map< unsigned short, ssrface::Source > _sources;
+    ssrface::Source _reference{};
+};
+
+/**
+@class SceneTraceRecorder
+Writes the scene updates a reverberator receives to a compact binary file.
+
+Every callback is recorded with its time, also those which changed nothing,
+since each one may trigger an ISM update. Only sources which appeared,
+moved or disappeared since the last update are stored.
+
+File layout, in host byte order: "SSRT", uint16 version, then records
+starting with a uint8 type:
+- UPDATE: uint32 µs since the last event, uint16 n, n * ( uint16 id, float x, float y )
+- REFERENCE: uint32 µs since the last event, float x, float y
+- NAME: uint16 id, uint8 length, characters. Precedes the first UPDATE with the source.
+- REMOVE: uint16 id
+
+Recording happens on the SceneManager thread, never on the audio thread.
+*/
+class SceneTraceRecorder
+{
+public:
+    enum RecordType : uint8_t { UPDATE = 0, REFERENCE = 1, NAME = 2, REMOVE = 3 };
+    
+    static const uint16_t VERSION = 1;
+    
+    ~SceneTraceRecorder();
+    
+    /**
+    @brief Starts writing a new trace. A running recording is stopped.
+    @returns False if the file could not be opened.
+    */
+    bool start( const char* path );
+    
+    /** @brief Stops the recording and closes the file. */
+    void stop();
+    
+    /** @returns True while recording. */
+    bool is_recording();
+    
+    /** @brief Records the state of the sources after an update callback. */
+    void record_update( ssrface::Scene* scene );
+    
+    /** @brief Records the reference after a reference callback. */
+    void record_reference( ssrface::Scene* scene );
+    
+    /** @returns Number of recorded update and reference events. */
+    unsigned long get_n_events();
+    
+private:
+    FILE* _file = nullptr;
+    std::mutex _mtx;
+    
+    std::chrono::steady_clock::time_point _last_time;
+    std::map< unsigned short, std::pair< float, float > > _positions;
+    unsigned long _n_events = 0;
+    
+    uint32_t _time_delta();
+    
+    template < typename T > void _write( T value ) { fwrite( &value, sizeof(T), 1, _file ); }
+};
+
+/**
+@class SceneTracePlayer
+Replays a recorded scene trace.
+
+The events are applied to a TraceScene one after another and passed on to a
+callback together with the scene, like the SceneManager passes on the
+ssrface::Scene.
+*/
+class SceneTracePlayer
+{
+public:
+    /** @brief One recorded callback and the changes of the scene it saw. */
+    struct Event
+    {
+        /** Seconds since the start of the recording. */
+        double time;
+        SceneTraceRecorder::RecordType type;
+        std::vector< ssrface::Source > changed;
+        std::vector< unsigned short > removed;
+    };
+    
+    typedef std::function< void( const Event& event, TraceScene* scene ) > Callback;
+    
+    /**
+    @brief Reads a trace.
+    @returns False if the file could not be read or is no scene trace.
+    */
+    bool load( const char* path );
+    
+    /** @returns Recorded events, in order. */
+    const std::vector< Event >& get_events();
+    
+    /** @returns Time of the last event in s. */
+    double get_duration();
+    
+    /** @brief Starts over with an empty scene. */
+    void rewind();
+    
+    /**
+    @brief Applies the next event and passes it on to the callback.
+    @returns False once all events are replayed.
+    */
+    bool step( Callback callback );
+    
+    /** @returns Time of the next event in s, negative once all events are replayed. */
+    double get_next_time();
+    
+    /**
+    @brief Replays all events in the calling thread.
+    @param speed 1 replays in original time, 2 twice as fast. 0 replays without waiting.
+    */
+    void play( float speed, Callback callback );
+    
+    /** @returns The scene as of the last replayed event. */
+    TraceScene* get_scene();
+    
+private:
+    std::vector< Event > _events;
+    unsigned long _next_event = 0;
+    TraceScene _scene;
+    
+    template < typename T > bool _read( FILE* file, T& value ) { return fread( &value, sizeof(T), 1, file ) == 1; }
+};
+
+} // namespace SSRverb
+
+#endif /* SceneTrace_hpp */
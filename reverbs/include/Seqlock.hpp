@@ -0,0 +1,139 @@
+//
+//  Seqlock.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef Seqlock_hpp
+#define Seqlock_hpp
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <type_traits>
+
+namespace SSRverb {
+
+/**
+@class Seqlock
+Small value shared between control threads and the audio thread.
+
+Readers never take a lock. They copy the value and retry in the rare case a
+writer was active meanwhile, so they always see a consistent value, never
+one mixed from two writes. The audio thread bounds the retries with
+try_load() and keeps its last copy if they run out. Writers are serialized
+among each other. The value is kept in atomic words, so the copies are no
+data races.
+
+T has to be trivially copyable, e.g. a struct of floats.
+*/
+template < typename T >
+class Seqlock
+{
+public:
+    Seqlock( const T& value = T() )
+    {
+        _write( value );
+    }
+    
+    /** @returns Consistent copy of the value. Spins as long as writers are active, use try_load() on the audio thread. */
+    T load() const
+    {
+        T value;
+        while ( !try_load( value, ~0u ) ) {}
+        return value;
+    }
+    
+    /**
+    @brief Copies the value with a bounded number of attempts.
+    @param value Left unchanged if no attempt succeeded.
+    @returns False if a writer was active during all attempts.
+    */
+    bool try_load( T& value, unsigned max_attempts ) const
+    {
+        T copy;
+        unsigned before, after;
+        for ( unsigned attempt = 0; attempt < max_attempts; attempt++ )
+        {
+            before = _sequence.load( std::memory_order_acquire );
+            if ( before & 1 ) continue;
+            
+            _read( copy );
+            std::atomic_thread_fence( std::memory_order_acquire );
+            after = _sequence.load( std::memory_order_relaxed );
+            
+            if ( before == after ) {
+                value = copy;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    void store( const T& value )
+    {
+        modify( [&value]( T& current ) { current = value; } );
+    }
+    
+    /**
+    @brief Changes part of the value. Other writers cannot interfere in between.
+    @param modifier Called with the current value, which it changes in place.
+    */
+    template < typename Modifier >
+    void modify( Modifier modifier )
+    {
+        const unsigned sequence = _lock();
+        
+        T value;
+        _read( value );
+        modifier( value );
+        _write( value );
+        
+        _sequence.store( sequence + 2, std::memory_order_release );
+    }
+    
+private:
+    static_assert( std::is_trivially_copyable< T >::value, "Seqlock values are copied word by word." );
+    
+    static const unsigned _n_words = ( sizeof(T) + sizeof(uint32_t) - 1 ) / sizeof(uint32_t);
+    
+    std::atomic< uint32_t > _words[_n_words];
+    std::atomic< unsigned > _sequence{ 0 };
+    
+    // Odd sequence numbers mark a write in progress.
+    unsigned _lock()
+    {
+        unsigned sequence = _sequence.load( std::memory_order_relaxed );
+        while ( true )
+        {
+            if ( !( sequence & 1 ) && _sequence.compare_exchange_weak( sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed ) ) break;
+            if ( sequence & 1 ) {
+                std::this_thread::yield();
+                sequence = _sequence.load( std::memory_order_relaxed );
+            }
+        }
+        std::atomic_thread_fence( std::memory_order_release );
+        return sequence;
+    }
+    
+    void _read( T& value ) const
+    {
+        uint32_t words[_n_words];
+        for ( unsigned idx = 0; idx < _n_words; idx++ ) words[idx] = _words[idx].load( std::memory_order_relaxed );
+        memcpy( &value, words, sizeof(T) );
+    }
+    
+    void _write( const T& value )
+    {
+        uint32_t words[_n_words] = {};
+        memcpy( words, &value, sizeof(T) );
+        for ( unsigned idx = 0; idx < _n_words; idx++ ) _words[idx].store( words[idx], std::memory_order_relaxed );
+    }
+};
+
+} // namespace SSRverb
+
+#endif /* Seqlock_hpp */
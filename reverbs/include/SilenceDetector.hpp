@@ -0,0 +1,82 @@
+//
+//  SilenceDetector.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef SilenceDetector_hpp
+#define SilenceDetector_hpp
+
+#include <atomic>
+
+namespace SSRverb {
+
+/**
+@class SilenceDetector
+Decides when a reverberator has decayed to silence and can be skipped.
+
+The energy of the input is tracked block by block. Once the input has been
+silent longer than the hold length and the output energy fell below the
+threshold, or once the input has been silent longer than the tail length,
+the reverberator is considered idle until the input becomes active again.
+*/
+class SilenceDetector
+{
+public:
+    /**
+    @param threshold_db Level relative to full scale below which a block counts as silent.
+    */
+    SilenceDetector( float threshold_db = -100.f );
+    
+    /**
+    @brief Checks the input of the coming block.
+    @returns True in case the reverberator is idle and the block can be skipped.
+    */
+    bool check_input( const float* input, unsigned n_frames );
+    
+    /**
+    @brief Checks the output of the processed block.
+    @returns True in case the reverberator just became idle. The caller should flush its state.
+    */
+    bool check_output( float** outputs, unsigned n_channels, unsigned n_frames );
+    
+    /** @brief Minimum number of silent input samples before the output energy is considered. */
+    void set_hold_length( unsigned long n_samples );
+    
+    /** @brief Number of silent input samples after which the tail is over in any case. */
+    void set_tail_length( unsigned long n_samples );
+    
+    /** @brief Forces the detector back to the active state. */
+    void reset();
+    
+    /** @brief Enables or disables idle detection. Disabled detectors never report idle. */
+    void set_enabled( bool status );
+    
+    /** @returns True in case the reverberator is idle. */
+    bool is_idle();
+    
+    /** @returns Threshold in dB relative to full scale. */
+    float get_threshold_db();
+    
+    /** @returns Number of samples a T60 decay takes to fall below a threshold. */
+    static unsigned long decay_length( float t60, unsigned sample_rate, float threshold_db );
+    
+private:
+    float _threshold_db;
+    float _threshold;
+    
+    std::atomic<unsigned long> _hold_length{ 0 };
+    std::atomic<unsigned long> _tail_length{ 0 };
+    
+    unsigned long _n_silent = 0;
+    std::atomic<bool> _idle{ false };
+    std::atomic<bool> _enabled{ true };
+    
+    static float _mean_square( const float* data, unsigned n_frames );
+};
+
+} // namespace SSRverb
+
+#endif /* SilenceDetector_hpp */
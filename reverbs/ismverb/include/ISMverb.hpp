@@ -10,6 +10,11 @@
 #define ISMverb_hpp
 
 #include "reverbs/include/Room.hpp"
+#include "reverbs/include/SilenceDetector.hpp"
+#include "reverbs/include/DspProfiler.hpp"
+#include "reverbs/include/ReverbEngine.hpp"
+#include "reverbs/include/Seqlock.hpp"
+#include "TapGrid.hpp"
 #include "laproque/include/FadingMultiDelay.hpp"
 #include "laproque/include/Filterbank.hpp"
 #include "ssrface/include/Scene.hpp"
@@ -17,6 +22,10 @@
 #include <atomic>
 #include <vector>
 #include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 template <typename T> int sign(T value) {
     return (T(0) < value) - (value < T(0));
@@ -29,8 +38,14 @@ namespace SSRverb {
 
 /**
  @class ISMverb Implementation of an Image Source Model (ISM) for cuboid-shaped rooms with uniformly reflecting walls.
+ 
+ Several receivers, e.g. listening zones or binaural listeners in the same
+ room, can share one instance. The source is mirrored and the input filtered
+ once for all of them, only distances, panning and delay lines are per
+ receiver. Receiver k has its own reverberation sources, on outputs
+ k * 8 to k * 8 + 7.
  **/
-class ISMverb
+class ISMverb : public ReverbEngine
 {
 public:
     /**
@@ -40,6 +55,7 @@ public:
      @param order Reflection oder used in this ISM instance.
      @param sample_rate Sampling frequency of processed audio signal.
      @param block_size Number of samples in one audio signal block.
+     @param n_receivers Number of receivers, 1 to 8.
      */
     ISMverb(
               float x
@@ -48,16 +64,30 @@ public:
             , unsigned order
             , unsigned sample_rate
             , unsigned block_size
+            , unsigned n_receivers = 1
             );
     ~ISMverb();
     
+    /**
+     @brief Changes sample rate and block size. Not real-time safe.
+     @param sample_rate Sampling frequency of processed audio signal.
+     @param max_block_size Maximum number of samples in one audio signal block.
+     */
+    void prepare( unsigned sample_rate, unsigned max_block_size );
+    
     /**
      @brief Compute ISM result of input and write to outputs channel.
      @param input Pointer to array with input samples.
      @param outputs Pointer to array with pointers to output buffers.
      @n_frames Number of audio frames to be processed.
      */
-    void process( float *input, float **outputs, unsigned long n_frames );
+    void process( float *input, float **outputs, unsigned n_frames );
+    
+    /** @returns Number of output channels. */
+    unsigned get_n_outputs();
+    
+    /** @returns Number of receivers. */
+    unsigned get_n_receivers();
     
     /**
      @brief Change the position of the receiver.
@@ -65,17 +95,52 @@ public:
      */
     void set_receiver( Vector3D receiver );
     
+    /**
+     @brief Change the position of one of several receivers.
+     @param receiver Index of the receiver.
+     @param position New position in 3D space.
+     */
+    void set_receiver( unsigned receiver, Vector3D position );
+    
     /**
      @brief Change the position of the sound source.
      @param source New position in 3D space.
      */
     void set_source( Vector3D source );
     
+    /**
+    @brief Turns the receiver, e.g. after the head tracker.
+    
+    The reverberation sources turn with the receiver. Their reflections are
+    re-panned from the known image sources, without mirroring the source
+    again, at most at the maximum update rate.
+    @param azimuth Counterclockwise rotation in radians, 0 by default.
+    */
+    void set_receiver_orientation( float azimuth );
+    
+    /** @brief Turns one of several receivers, see set_receiver_orientation(). */
+    void set_receiver_orientation( unsigned receiver, float azimuth );
+    
+    /** @returns Orientation of the receiver in radians. */
+    float get_receiver_orientation( unsigned receiver = 0 );
+    
     /**
      @brief Changes the dimensions of the cuboid-shaped toom.
      */
     void set_room_dimensions( float x, float y, float z );
     
+    /** @brief Same as set_room_dimensions(). */
+    void set_room_size( float x, float y, float z );
+    
+    /** @brief Same as set_source(). */
+    void set_src_pos( Vector3D new_pos );
+    
+    /** @brief Same as set_receiver(). */
+    void set_rec_pos( Vector3D new_pos );
+    
+    /** @brief Same as set_receiver_orientation(). */
+    void set_rec_orientation( float azimuth );
+    
     /**
      @brief Set the SSR ID of the sound source to be tracked.
      */
@@ -108,23 +173,133 @@ public:
     /** @returns State of source tracking. */
     bool get_tracking();
     
+    /** @returns True in case the ISM decayed to silence and is skipped. */
+    bool is_idle();
+    
+    /** @brief Enables skipping the processing once decayed to silence. Enabled by default. */
+    void set_idle_detection( bool status );
+    
+    /**
+    @brief Limits the processed reflection orders to save processing time.
+    
+    Orders that are switched off are faded out. Orders that are switched on
+    again are processed silently until their delay lines are refilled and
+    then faded in.
+    @param order Highest order to be processed. Must be <= order of this instance.
+    */
+    void set_active_order( unsigned order );
+    
+    /**
+    @brief Limits the processed reflection orders right away, without fades.
+    
+    Only to be called before the first process() or from the audio thread.
+    @param order Highest order to be processed. Must be <= order of this instance.
+    */
+    void switch_active_order( unsigned order );
+    
+    /** @returns Highest reflection order currently processed. */
+    unsigned get_active_order();
+    
+    /** @returns Maximum number of delay taps used by the given orders. */
+    unsigned get_tap_budget( unsigned order );
+    
+    /**
+    @brief Sets how far source and receiver have to move together before the taps are recomputed.
+    
+    Their summed displacement bounds the path length change of every image
+    source. Smaller moves are applied once the movement stopped for 50 ms.
+    @param dead_band Distance in m. Negative values use one sample of path difference, the default.
+    */
+    void set_update_dead_band( float dead_band );
+    
+    /**
+    @brief Limits how often moves recompute the taps. Room changes are applied right away.
+    @param max_rate Updates per second, 100 by default. 0 removes the limit.
+    */
+    void set_max_update_rate( float max_rate );
+    
+    /**
+    @brief Compensates the tracking latency by extrapolating the trajectories.
+    
+    Source and receiver velocities are estimated from their recent updates
+    and smoothed over about 50 ms. The taps are then computed for where both
+    will be horizon seconds after their last update, e.g. the network and
+    block latency. A position is not extrapolated once no update arrived for
+    40 ms, so stopping sources end up at their final position.
+    @param horizon Look-ahead in s. 0 disables the extrapolation, the default.
+    */
+    void set_extrapolation( float horizon );
+    
+    /**
+    @brief Sets how many low orders follow every move.
+    
+    Higher orders are diffuse and tolerate outdated positions. After a move
+    they are refreshed in the following blocks, one order per block and order
+    k at most at max_update_rate / ( k - n_orders ), so no block pays for all
+    of them. Room changes still update all orders at once.
+    @param n_orders 2 by default. The order of this instance updates all orders on every move.
+    */
+    void set_full_rate_orders( unsigned n_orders );
+    
+    /**
+    @brief Precomputes the taps on a grid of source positions, for sources moving too fast to mirror them on every move.
+    
+    A background thread computes the taps of a source in the center of every
+    cell at the given height. Moves of sources at that height then snap to
+    the nearest cell instead of being mirrored. Until the grid is done, and
+    for other sources, the taps are computed as usual. The grid is rebuilt
+    once receiver, room and sample rate did not change for 0.5 s.
+    @param spacing Cell size in m. 0 disables the grid, the default.
+    @param source_height Height of the sources in m. SSR sources are placed at 1.7 m.
+    @param directory Grids are saved there and loaded again for the same room, receiver and order. nullptr keeps them in memory.
+    Only used with a single receiver.
+    */
+    void enable_tap_grid( float spacing, float source_height = 1.7f, const char* directory = nullptr );
+    
+    /** @returns True if the taps currently come from the grid. Can be called from any thread. */
+    bool is_tap_grid_used();
+    
+    /** @returns Number of tap recomputations so far. Only call from the audio thread. */
+    unsigned long get_n_updates();
+    
+    /** @returns Number of delay taps currently in use. Only call from the audio thread. */
+    unsigned get_n_taps();
+    
+    /**
+     @brief Recomputes the delay taps from the current positions right away.
+     
+     Usually done by process() after a position change. Must not be called
+     while process() runs, e.g. only from offline tools and benchmarks.
+     */
+    void update_taps();
+    
+    /** @brief Re-pans the taps to the current receiver orientation right away. Same restrictions as update_taps(). */
+    void update_rotation();
+    
+    /** @brief Sets the profiler the processing stages are recorded with. May be nullptr. */
+    void set_profiler( DspProfiler* profiler );
+    
     /** @returns Position of receiver. */
-    Vector3D get_receiver();
+    Vector3D get_receiver( unsigned receiver = 0 );
     
     /** @returns Position of sound source */
     Vector3D get_source();
     
-    /** @brief Callback fuction for SceneManager to track sound source position. */
-    static void update_src_pos( ssrface::Scene* scene_ptr, void* ismverb_ptr )
+    /**
+    @brief Callback fuction for SceneManager to track sound source position.
+    Also takes a TraceScene, to replay recorded scene traces.
+    */
+    template < typename Scene >
+    static void update_src_pos( Scene* scene_ptr, void* ismverb_ptr )
     {
         // Cast reverb pointer.
         ISMverb* ismverb = (ISMverb*)ismverb_ptr;
         
         if ( ismverb->get_tracking() )
         {
-            unsigned src_id = ismverb->_tracked_source_id;
+            unsigned src_id = ismverb->_tracked_source_id.load();
             
-            ssrface::Source* source = scene_ptr->get_source( src_id );
+            auto source = scene_ptr->get_source( src_id );
             
             if ( source != nullptr )
             {
@@ -137,24 +312,92 @@ public:
         }
     };
     
+    /**
+    @brief Callback function for the scene updates of a ReverbBase, which only passes on the changes.
+    
+    Looks up the tracked source among the changed sources. A newly selected
+    source is picked up with its last known position, even if it did not move.
+    @param diff SceneDiff of the update.
+    */
+    template < typename Scene, typename Diff >
+    static void update_changed_src_pos( Scene*, const Diff& diff, void* ismverb_ptr )
+    {
+        ISMverb* ismverb = (ISMverb*)ismverb_ptr;
+        if ( !ismverb->get_tracking() ) return;
+        
+        const unsigned src_id = ismverb->_tracked_source_id.load();
+        auto change = src_id == ismverb->_applied_source_id ? diff.find_changed( src_id ) : diff.find( src_id );
+        if ( change == nullptr ) return;
+        
+        ismverb->_applied_source_id = src_id;
+        ismverb->set_source( Vector3D( change->x, change->y, 1.7f ) );
+    };
+    
 private:
     static const unsigned _n_rev_sources = 8;
     static const unsigned _n_freq_bands = 3;
+    static const unsigned _max_delay = 10000;
+    static const unsigned _max_receivers = 8;
+    
+    unsigned _n_receivers;
+    unsigned _n_outputs;
     
     unsigned _sample_rate;
     unsigned _block_size;
-    unsigned _tracked_source_id = 0;
+    std::atomic<unsigned> _tracked_source_id{ 0 };
+    unsigned _applied_source_id = ~0u;
     std::atomic<bool> _tracking_active{true};
     
     std::atomic<bool> _has_changed{false};
+    std::atomic<bool> _has_moved{false};
+    std::atomic<bool> _has_rotated{false};
+    
+    // Dead-band and rate limit of moves. Only used on the audio thread, except for the settings.
+    std::atomic<float> _dead_band{ -1.f };
+    std::atomic<float> _max_update_rate{ 100.f };
+    std::atomic<unsigned> _full_rate_orders{ 2 };
+    bool _move_pending = false;
+    bool _rotation_pending = false;
+    unsigned long _frames_since_rotation = 1ul << 40;
+    unsigned long _frames_since_move = 0;
+    unsigned long _frames_since_update = 1ul << 40;
     
     // Image source model related members
     unsigned _order;
     Room _room;
     
-    Vector3D _src_pos;
-    Vector3D _rec_pos;
-    float _rec_orientation = 0.f;
+    /** Positions written by the SSR and GUI threads and read by the audio thread. */
+    struct Geometry
+    {
+        float source[3];
+        float receiver[_max_receivers][3];
+        float receiver_azimuth[_max_receivers];
+        
+        // Smoothed velocities in m/s and times of the last updates in s, for extrapolation.
+        float source_velocity[3];
+        float receiver_velocity[_max_receivers][3];
+        double source_time;
+        double receiver_time[_max_receivers];
+    };
+    Seqlock< Geometry > _geometry;
+    Geometry _applied_geometry;
+    
+    /**
+    @brief Snapshot of the positions for the audio thread, read with a bounded number of attempts.
+    @returns False if writers kept it busy. geometry holds the applied positions then.
+    */
+    bool _load_geometry( Geometry& geometry );
+    
+    std::atomic<float> _extrapolation{ 0.f };
+    static constexpr float _velocity_smoothing = .05f;
+    
+    /** @brief Stores a new position and updates the smoothed velocity. */
+    static void _track( float* position, float* velocity, double& time, Vector3D new_pos, double now );
+    
+    /** @returns Position extrapolated horizon s past now, or the last position if it stopped. */
+    static Vector3D _predict( const float* position, const float* velocity, double time, double now, float horizon );
+    
+    static double _now();
     
     // Mirrored sources related members
     unsigned _n_mirr_sources;
@@ -175,16 +418,83 @@ private:
     unsigned long*** _delay_values;
     float*** _delay_weights;
     
+    // Image sources of every receiver and order, kept to re-pan them after rotations.
+    TapGrid::Image*** _images;
+    float* _image_buffer;
+    
     float** _band_buffers;
-    float* _internal_buffer;
+    float** _order_buffers;
     
     float* _delay_output;
     
+    // Skips processing once the input is silent and all reflections passed.
+    SilenceDetector _silence;
+    
+    // Orders switched on and off at runtime.
+    std::atomic<unsigned> _active_order;
+    float* _order_gains;
+    unsigned long* _order_warmup;
+    
+    // Orders refreshed after the low ones, from the mirror sources of the last move.
+    bool* _order_stale;
+    unsigned long* _order_age;
+    bool _grid_in_scene = false;
+    Vector3D _grid_receivers[_max_receivers];
+    float _grid_direct_distances[_max_receivers];
+    unsigned _fade_length;
+    
+    bool _order_running( unsigned ord, unsigned active_order );
+    
+    // Taps precomputed on a grid of source positions, see enable_tap_grid().
+    std::thread _tap_grid_thread;
+    std::mutex _tap_grid_mtx;
+    std::condition_variable _tap_grid_cv;
+    float _tap_grid_spacing = 0.f;
+    float _tap_grid_height = 1.7f;
+    std::string _tap_grid_directory;
+    TapGrid::Key _tap_grid_request;
+    unsigned _tap_grid_generation = 0;
+    bool _tap_grid_quit = false;
+    std::atomic<bool> _tap_grid_enabled{ false };
+    
+    // Handed over to the audio thread and back to the grid thread, which frees it.
+    std::atomic<TapGrid*> _tap_grid_ready{ nullptr };
+    std::atomic<TapGrid*> _tap_grid_retired{ nullptr };
+    TapGrid* _tap_grid = nullptr;
+    // Written on the audio thread, read by is_tap_grid_used() from any thread.
+    std::atomic<int> _tap_grid_cell{ -1 };
+    
+    TapGrid::Key _make_tap_grid_key( Vector3D receiver, float spacing, float source_height );
+    void _request_tap_grid();
+    void _tap_grid_loop();
+    TapGrid* _build_tap_grid( const TapGrid::Key& key, const std::string& directory, unsigned generation );
+    
+    DspProfiler* _profiler = nullptr;
+    
     // Functions
     void _update_delays();
+    void _mirror_positions();
+    void _update_order( unsigned ord );
+    void _measure_images(
+              unsigned ord
+            , unsigned sample_rate
+            , unsigned n_receivers
+            , Vector3D* receivers
+            , const float* direct_distances
+            , Vector3D* one_order
+            , TapGrid::Image** images
+            , float* buffer
+            );
+    void _pan_order( unsigned receiver, unsigned ord );
+    void _rotate_taps();
+    void _refresh_stale_order();
+    bool _move_due();
     void _make_allocations();
+    void _make_block_buffers();
+    void _delete_block_buffers();
     
     unsigned long _call_counter;
+    unsigned long _n_updates = 0;
     
 };
 
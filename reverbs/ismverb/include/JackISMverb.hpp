@@ -21,17 +21,18 @@ public:
     JackISMverb( float x, float y, float z, unsigned order );
     ~JackISMverb();
     
-    void render_audio( laproque::nframes_t n_frames, laproque::sample_t **in_buffers, laproque::sample_t **out_buffers );
-    
     void activate();
     
     void set_src_pos( Vector3D new_pos );
     void set_rec_pos( Vector3D new_pos );
+    void set_rec_orientation( float azimuth );
     void set_tracked_source( unsigned id );
     
 private:
     SSRverb::ISMverb _ism;
-
+    
+    unsigned long _last_n_updates = 0;
+    void _end_cycle( DeadlineWatchdog::Overrun* record );
     
 };
 
@@ -0,0 +1,113 @@
+//
+//  TapGrid.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef TapGrid_hpp
+#define TapGrid_hpp
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace SSRverb {
+
+/**
+@class TapGrid
+Precomputed ISM delay taps on a grid of source positions.
+
+For a fixed room, receiver and order the taps only depend on the source
+position. The grid covers the room floor with square cells at one source
+height. Every cell holds delay, weight and azimuth of all image sources of
+a source in its center. Panning them to the reverberation sources depends
+on the receiver orientation and is left to ISMverb.
+
+Grids can be saved and loaded again, keyed by everything the taps depend
+on. Loading reads the whole grid into memory, lookups are then read-only
+and real-time safe.
+*/
+class TapGrid
+{
+public:
+    /** @brief Everything the taps depend on. Grids only match if all of it is equal. */
+    struct Key
+    {
+        float room[3];
+        float receiver[3];
+        float source_height;
+        float spacing;
+        uint32_t order;
+        uint32_t sample_rate;
+    };
+    
+    /** @brief Image source as seen from the receiver. */
+    struct Image
+    {
+        int32_t delay;
+        float weight;
+        float azimuth;
+    };
+    
+    /**
+    @brief Allocates an empty grid, to be filled with set_images().
+    @param order_sizes Number of mirror sources in every order.
+    */
+    TapGrid( const Key& key, const std::vector< unsigned >& order_sizes );
+    
+    ~TapGrid();
+    
+    /**
+    @brief Reads a saved grid. Not real-time safe.
+    @returns nullptr if there is no file or it was saved for another key.
+    */
+    static TapGrid* load( const char* path, const Key& key, const std::vector< unsigned >& order_sizes );
+    
+    /** @returns False if the file could not be written. */
+    bool save( const char* path );
+    
+    /** @returns File name of the grid in a directory, unique for the key. */
+    static std::string get_file_name( const char* directory, const Key& key );
+    
+    const Key& get_key();
+    
+    /** @returns True if the grid was computed for these positions. The source is snapped to the nearest cell. */
+    bool matches( const Key& key, float source_z );
+    
+    unsigned get_n_cells();
+    
+    /** @returns Center of a cell. */
+    void get_cell_center( unsigned cell, float& x, float& y );
+    
+    /** @returns Cell nearest to a source position, -1 outside of the room. */
+    int get_cell( float x, float y );
+    
+    /** @returns Image sources of an order of a cell. */
+    const Image* get_images( unsigned cell, unsigned ord );
+    
+    /** @brief Stores the image sources of an order of a cell. */
+    void set_images( unsigned cell, unsigned ord, const Image* images );
+    
+private:
+    TapGrid() = default;
+    TapGrid( const TapGrid& ) = delete;
+    TapGrid& operator=( const TapGrid& ) = delete;
+    
+    Key _key;
+    unsigned _n_x = 1;
+    unsigned _n_y = 1;
+    
+    std::vector< size_t > _order_offsets;
+    std::vector< unsigned > _order_sizes;
+    size_t _cell_size = 0;
+    
+    uint8_t* _data = nullptr;
+    
+    void _setup_layout( const std::vector< unsigned >& order_sizes );
+};
+
+} // namespace SSRverb
+
+#endif /* TapGrid_hpp */
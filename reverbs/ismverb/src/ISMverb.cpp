@@ -7,8 +7,15 @@
 //
 
 #include "ISMverb.hpp"
+#include "reverbs/include/Logger.hpp"
 #include <cstring>
 #include <random>
+#include <chrono>
+
+// Positions are not extrapolated anymore once no update arrived for this long, in s.
+const double ISM_PREDICTION_TIMEOUT = .04;
+// Attempts of the audio thread to read the positions before it keeps the applied ones.
+const unsigned ISM_GEOMETRY_ATTEMPTS = 8;
 
 SSRverb::ISMverb::ISMverb(
                  float x
@@ -17,18 +24,32 @@ SSRverb::ISMverb::ISMverb(
                  , unsigned order
                  , unsigned sample_rate
                  , unsigned block_size
+                 , unsigned n_receivers
                  )
 : _room(x, y, z)
 {
     // Store data.
+    _n_receivers = std::min( std::max( n_receivers, 1u ), _max_receivers );
+    _n_outputs = _n_receivers * _n_rev_sources;
     _order = order;
     _n_mirr_sources = Room::get_n_mirr_src( order );
     _sample_rate = sample_rate;
     _block_size = block_size;
+    _active_order.store( order );
+    _fade_length = _sample_rate / 20;
     
-    // Initialize valid positions of source an receiver
-    _src_pos = Vector3D{x/3.f, y/3.f, z/3.f};
-    _rec_pos = Vector3D{2.f*x/3.f, 2.f*y/3.f, 2.f*z/3.f};
+    // Initialize valid positions of source an receivers
+    Geometry geometry{ { x/3.f, y/3.f, z/3.f } };
+    _applied_geometry = Geometry{ { NAN, NAN, NAN } };
+    for ( unsigned rcv = 0; rcv < _max_receivers; rcv++ ) {
+        geometry.receiver[rcv][0] = 2.f*x/3.f;
+        geometry.receiver[rcv][1] = 2.f*y/3.f;
+        geometry.receiver[rcv][2] = 2.f*z/3.f;
+        for ( int dim = 0; dim < 3; dim++ ) _applied_geometry.receiver[rcv][dim] = NAN;
+        _applied_geometry.receiver_azimuth[rcv] = NAN;
+    }
+    _geometry.store( geometry );
+    Vector3D rec_pos = get_receiver();
     
     // Create vector with number of mirror sources in every order.
     _sources_in_order = new unsigned[_order];
@@ -42,11 +63,11 @@ SSRverb::ISMverb::ISMverb(
     // Calculate reverb position angles.
     float x_pos, y_pos, radius = 1.2f;
     for ( unsigned rev = 0; rev < _n_rev_sources; rev++ ) {
-        x_pos = _rec_pos[0] + radius * cosf( 2.f*M_PI/_n_rev_sources * rev );
-        y_pos = _rec_pos[1] + radius * sinf( 2.f*M_PI/_n_rev_sources * rev );
+        x_pos = rec_pos[0] + radius * cosf( 2.f*M_PI/_n_rev_sources * rev );
+        y_pos = rec_pos[1] + radius * sinf( 2.f*M_PI/_n_rev_sources * rev );
         
         // Store the  azimuth of the reverb source in respect to the listener.
-        _rev_source_angles[rev] = _rec_pos.azimuth_to( Vector3D{x_pos, y_pos, 0.f} );
+        _rev_source_angles[rev] = rec_pos.azimuth_to( Vector3D{x_pos, y_pos, 0.f} );
         //if ( _rev_source_angles[rev] < 0.f ) _rev_source_angles[rev] += 2*M_PI;
         //printf("%f, ", _rev_source_angles[rev]);
     }
@@ -70,24 +91,29 @@ SSRverb::ISMverb::ISMverb(
         _filterbanks[ord]->set_co_freqs( ISM_CO_FREQS );
     }
     
-    // Initialize delays
+    // Initialize delays. The first move is not held back by the rate limit.
     _update_delays();
+    _frames_since_update = 1ul << 40;
+    
+    // The response is finite. Allow the filterbanks some time to settle.
+    _silence.set_hold_length( _max_delay );
+    _silence.set_tail_length( _max_delay + _sample_rate / 10 );
     
 }
 
 void SSRverb::ISMverb::_make_allocations()
 {
-    unsigned ord, rev, band;
+    unsigned ord, rev;
     
-    // Create a filter for every order in every reverb source.
+    // Create a filter for every order in every reverb source of every receiver.
     //printf( "\n Allocating MultiDelays form ISM: Sources: %i, Order: %i\n", _n_rev_sources, _order );
     
-    _delays = new laproque::FadingMultiDelay**[_n_rev_sources];
-    _delay_counters = new unsigned*[_n_rev_sources];
-    _delay_values = new unsigned long**[_n_rev_sources];
-    _delay_weights = new float**[_n_rev_sources];
+    _delays = new laproque::FadingMultiDelay**[_n_outputs];
+    _delay_counters = new unsigned*[_n_outputs];
+    _delay_values = new unsigned long**[_n_outputs];
+    _delay_weights = new float**[_n_outputs];
     
-    for ( rev = 0; rev < _n_rev_sources; rev++ )
+    for ( rev = 0; rev < _n_outputs; rev++ )
     {
         _delays[rev] = new laproque::FadingMultiDelay*[_order];
         _delay_counters[rev] = new unsigned[_order];
@@ -97,7 +123,7 @@ void SSRverb::ISMverb::_make_allocations()
         for ( ord = 0; ord < _order; ord++ )
         {
             _delay_counters[rev][ord] = 0;
-            _delays[rev][ord] = new laproque::FadingMultiDelay( 10000 );
+            _delays[rev][ord] = new laproque::FadingMultiDelay( _max_delay );
             _delay_values[rev][ord] = new unsigned long[ _sources_in_order[_order-1] ];
             _delay_weights[rev][ord] = new float[ _sources_in_order[_order-1] ];
         }
@@ -115,18 +141,107 @@ void SSRverb::ISMverb::_make_allocations()
     _mirror_sources = Room::prepare_mirror_vector( _order );
     _one_order = new Vector3D[_sources_in_order[_order-1]];
     
+    _images = new TapGrid::Image**[_n_receivers];
+    for ( unsigned rcv = 0; rcv < _n_receivers; rcv++ ) {
+        _images[rcv] = new TapGrid::Image*[_order];
+        for ( ord = 0; ord < _order; ord++ ) _images[rcv][ord] = new TapGrid::Image[_sources_in_order[ord]];
+    }
+    _image_buffer = new float[4 * _sources_in_order[_order-1]];
+    
+    _make_block_buffers();
+    
+    _order_gains = new float[_order];
+    _order_warmup = new unsigned long[_order];
+    _order_stale = new bool[_order];
+    _order_age = new unsigned long[_order];
+    for ( ord = 0; ord < _order; ord++ ) {
+        _order_gains[ord] = 1.f;
+        _order_warmup[ord] = 0;
+        _order_stale[ord] = true;
+        _order_age[ord] = 0;
+    }
+}
+
+void SSRverb::ISMverb::_make_block_buffers()
+{
     _delay_output = new float[_block_size];
     
     _band_buffers = new float*[_n_freq_bands];
-    for ( band = 0; band < _n_freq_bands; band++) {
+    for ( unsigned band = 0; band < _n_freq_bands; band++) {
         _band_buffers[band] = new float[_block_size];
     }
     
-    _internal_buffer = new float[_block_size];
+    _order_buffers = new float*[_order];
+    for ( unsigned ord = 0; ord < _order; ord++ ) {
+        _order_buffers[ord] = new float[_block_size];
+    }
+}
+
+void SSRverb::ISMverb::_delete_block_buffers()
+{
+    delete [] _delay_output;
+    
+    for ( unsigned band = 0; band < _n_freq_bands; band++) {
+        delete [] _band_buffers[band];
+    }
+    delete [] _band_buffers;
+    
+    for ( unsigned ord = 0; ord < _order; ord++ ) {
+        delete [] _order_buffers[ord];
+    }
+    delete [] _order_buffers;
+}
+
+void SSRverb::ISMverb::prepare( unsigned sample_rate, unsigned max_block_size )
+{
+    if ( max_block_size > _block_size ) {
+        _delete_block_buffers();
+        _block_size = max_block_size;
+        _make_block_buffers();
+    }
+    
+    if ( sample_rate != _sample_rate ) {
+        _sample_rate = sample_rate;
+        _fade_length = _sample_rate / 20;
+        
+        for ( unsigned ord = 0; ord < _order; ord++ ) {
+            _filterbanks[ord]->set_sample_rate( _sample_rate );
+            _filterbanks[ord]->reset();
+        }
+        _silence.set_tail_length( _max_delay + _sample_rate / 10 );
+        _silence.reset();
+        
+        // Delays in samples depend on the sample rate.
+        _update_delays();
+        _frames_since_update = 1ul << 40;
+        _request_tap_grid();
+    }
+}
+
+unsigned SSRverb::ISMverb::get_n_outputs()
+{
+    return _n_outputs;
+}
+
+unsigned SSRverb::ISMverb::get_n_receivers()
+{
+    return _n_receivers;
 }
 
 SSRverb::ISMverb::~ISMverb()
 {
+    if ( _tap_grid_thread.joinable() )
+    {
+        {
+            std::lock_guard< std::mutex > lock( _tap_grid_mtx );
+            _tap_grid_quit = true;
+        }
+        _tap_grid_cv.notify_one();
+        _tap_grid_thread.join();
+    }
+    delete _tap_grid;
+    delete _tap_grid_ready.load();
+    delete _tap_grid_retired.load();
     
     Room::dispose_mirror_vector( _mirror_sources, _order );
     
@@ -140,7 +255,14 @@ SSRverb::ISMverb::~ISMverb()
     
     delete [] _band_weights;
     
-    for ( unsigned rev = 0; rev < _n_rev_sources; rev++ ) {
+    for ( unsigned rcv = 0; rcv < _n_receivers; rcv++ ) {
+        for ( unsigned ord = 0; ord < _order; ord++ ) delete [] _images[rcv][ord];
+        delete [] _images[rcv];
+    }
+    delete [] _images;
+    delete [] _image_buffer;
+    
+    for ( unsigned rev = 0; rev < _n_outputs; rev++ ) {
         for ( unsigned ord = 0; ord < _order; ord++ ) {
             delete _delays[rev][ord];
             delete [] _delay_values[rev][ord];
@@ -157,46 +279,192 @@ SSRverb::ISMverb::~ISMverb()
     delete [] _delay_values;
     delete [] _delay_weights;
     
-    delete [] _delay_output;
-    
     delete [] _sources_in_order;
     
+    _delete_block_buffers();
     
-    for ( unsigned band = 0; band < _n_freq_bands; band++) {
-        delete [] _band_buffers[band];
-    }
-    delete [] _band_buffers;
-    
-    delete [] _internal_buffer;
+    delete [] _order_gains;
+    delete [] _order_warmup;
+    delete [] _order_stale;
+    delete [] _order_age;
 }
 
 
 void SSRverb::ISMverb::_update_delays()
 {
- 
+    _mirror_positions();
+    for ( unsigned ord = 0; ord < _order; ord++ ) _update_order( ord );
+}
+
+void SSRverb::ISMverb::_mirror_positions()
+{
+    _n_updates++;
+    
+    // One consistent snapshot of the positions for the whole update.
+    Geometry geometry;
+    const bool current = _load_geometry( geometry );
+    Vector3D src_pos( geometry.source[0], geometry.source[1], geometry.source[2] );
+    Vector3D rec_pos[_max_receivers];
+    for ( unsigned rcv = 0; rcv < _n_receivers; rcv++ ) {
+        rec_pos[rcv] = Vector3D( geometry.receiver[rcv][0], geometry.receiver[rcv][1], geometry.receiver[rcv][2] );
+    }
+    
+    bool extrapolated = false;
+    const float horizon = _extrapolation.load();
+    if ( horizon > 0.f )
+    {
+        const double now = _now();
+        Vector3D predicted_src = _predict( geometry.source, geometry.source_velocity, geometry.source_time, now, horizon );
+        
+        // Predictions through a wall would mute the reflections. Keep the last known positions then.
+        if (   predicted_src[0] > 0.f && predicted_src[0] < _room.get_x_size()
+            && predicted_src[1] > 0.f && predicted_src[1] < _room.get_y_size() )
+        {
+            src_pos = predicted_src;
+            extrapolated |= now - geometry.source_time <= ISM_PREDICTION_TIMEOUT;
+        }
+        
+        for ( unsigned rcv = 0; rcv < _n_receivers; rcv++ )
+        {
+            Vector3D predicted_rec = _predict( geometry.receiver[rcv], geometry.receiver_velocity[rcv], geometry.receiver_time[rcv], now, horizon );
+            if (   predicted_rec[0] > 0.f && predicted_rec[0] < _room.get_x_size()
+                && predicted_rec[1] > 0.f && predicted_rec[1] < _room.get_y_size() )
+            {
+                rec_pos[rcv] = predicted_rec;
+                extrapolated |= now - geometry.receiver_time[rcv] <= ISM_PREDICTION_TIMEOUT;
+            }
+        }
+    }
+    
+    // Extrapolated taps overshoot once the movement stops. The move stays pending until
+    // an update without extrapolation applied the last known positions, see _move_due().
+    // Same if the positions could not be read, they are tried again in the next block.
+    _applied_geometry = geometry;
+    _move_pending = extrapolated || !current;
+    _rotation_pending = false;
+    _frames_since_update = 0;
+    
     // Mute if source is outside of room.
-    bool in_scene = _src_pos[0] < _room.get_x_size()
-                 && _src_pos[1] < _room.get_y_size();
+    _grid_in_scene = src_pos[0] < _room.get_x_size()
+                  && src_pos[1] < _room.get_y_size();
+    
+    _grid_in_scene &= src_pos[0] > 0
+                   && src_pos[1] > 0;
+    
+    // All orders are outdated now, until they are updated from the new mirror sources.
+    for ( unsigned ord = 0; ord < _order; ord++ ) _order_stale[ord] = true;
+    _tap_grid_cell.store( -1 );
+    if ( !_grid_in_scene ) return;
+    
+    // Calculate direct distances for relative compensation.
+    for ( unsigned rcv = 0; rcv < _n_receivers; rcv++ ) {
+        _grid_receivers[rcv] = rec_pos[rcv];
+        _grid_direct_distances[rcv] = (rec_pos[rcv] - src_pos).get_length();
+    }
+    
+    // Snap to the nearest precomputed cell if the grid was made for this receiver, room and height.
+    int cell = -1;
+    if ( _tap_grid != nullptr && _tap_grid_enabled.load() && _n_receivers == 1 )
+    {
+        const TapGrid::Key& grid_key = _tap_grid->get_key();
+        if ( _tap_grid->matches( _make_tap_grid_key( rec_pos[0], grid_key.spacing, grid_key.source_height ), src_pos[2] ) ) {
+            cell = _tap_grid->get_cell( src_pos[0], src_pos[1] );
+        }
+    }
+    _tap_grid_cell.store( cell );
+    if ( cell >= 0 ) return;
     
-    in_scene &= _src_pos[0] > 0
-             && _src_pos[1] > 0;
+    // Compute the positions of all mirror sources, once for all receivers.
+    _room.mirror_point( src_pos, _order, _mirror_sources );
+}
+
+void SSRverb::ISMverb::_update_order( unsigned ord )
+{
+    // Orders switched off keep their taps. They are updated when switched on.
+    if ( !_order_running( ord, _active_order.load() ) ) return;
     
-    unsigned rev, ord, src;
+    _order_stale[ord] = false;
+    _order_age[ord] = 0;
+    
+    unsigned rev, rcv;
     
     // Silence in case source is not in scene;
-    if ( !in_scene )
+    if ( !_grid_in_scene )
     {
-        for ( rev = 0; rev < _n_rev_sources; rev++) {
-            for ( ord = 0; ord < _order; ord++) {
-                //printf("SILENCING %i SOURCES, rev: %i ord: %i\n", _delay_counters[rev][ord], rev, ord );
-                _delays[rev][ord]->clear_delays();
-            }
+        for ( rev = 0; rev < _n_outputs; rev++) {
+            _delays[rev][ord]->clear_delays();
         }
         return;
     }
     
+    TapGrid::Image* images[_max_receivers];
+    for ( rcv = 0; rcv < _n_receivers; rcv++ ) images[rcv] = _images[rcv][ord];
     
-    float distance, weight, closest_weight, neighbor_weight, angle;
+    const int cell = _tap_grid_cell.load();
+    if ( cell >= 0 ) {
+        // Copy the precomputed image sources of the nearest cell.
+        memcpy( images[0], _tap_grid->get_images( cell, ord ), _sources_in_order[ord] * sizeof(TapGrid::Image) );
+    }
+    else {
+        Room::extract_order( ord+1, _mirror_sources, _order, _one_order );
+        _measure_images( ord, _sample_rate, _n_receivers, _grid_receivers, _grid_direct_distances, _one_order, images, _image_buffer );
+    }
+    
+    for ( rcv = 0; rcv < _n_receivers; rcv++ ) _pan_order( rcv, ord );
+}
+
+void SSRverb::ISMverb::_measure_images(
+                            unsigned ord
+                          , unsigned sample_rate
+                          , unsigned n_receivers
+                          , Vector3D* receivers
+                          , const float* direct_distances
+                          , Vector3D* one_order
+                          , TapGrid::Image** images
+                          , float* buffer
+                          )
+{
+    const unsigned n_images = _sources_in_order[ord];
+    const unsigned capacity = _sources_in_order[_order-1];
+    float* __restrict x = buffer;
+    float* __restrict y = buffer + capacity;
+    float* __restrict z = buffer + 2 * capacity;
+    float* __restrict squared_distance = buffer + 3 * capacity;
+    unsigned src;
+    
+    // Split up the mirror sources once, so the distances of every receiver are computed in one vectorizable pass.
+    // sqrtf() and atan2f() may set errno, which keeps them out of it.
+    for ( src = 0; src < n_images; src++ ) {
+        x[src] = one_order[src][0];
+        y[src] = one_order[src][1];
+        z[src] = one_order[src][2];
+    }
+    
+    for ( unsigned rcv = 0; rcv < n_receivers; rcv++ )
+    {
+        const float rec_x = receivers[rcv][0], rec_y = receivers[rcv][1], rec_z = receivers[rcv][2];
+        
+        for ( src = 0; src < n_images; src++ ) {
+            const float dx = x[src] - rec_x, dy = y[src] - rec_y, dz = z[src] - rec_z;
+            squared_distance[src] = dx*dx + dy*dy + dz*dz;
+        }
+        
+        // Compute relevant properties of the mirror sources.
+        TapGrid::Image* __restrict result = images[rcv];
+        for ( src = 0; src < n_images; src++ ) {
+            const float length = sqrtf( squared_distance[src] );
+            result[src].azimuth = atan2f( y[src] - rec_y, x[src] - rec_x );
+            result[src].weight = std::min( 1.f / length, 1.f);
+            result[src].delay = int32_t( roundf( (length-direct_distances[rcv]) / 343. * sample_rate) );
+        }
+    }
+}
+
+void SSRverb::ISMverb::_pan_order( unsigned receiver, unsigned ord )
+{
+    unsigned rev, src;
+    
+    float weight, closest_weight, neighbor_weight, angle;
     float angle_diff = 1e6;
     float abs_angle_diff = 1e-6;
     
@@ -204,151 +472,417 @@ void SSRverb::ISMverb::_update_delays()
     
     long samples_delay;
     
-    // TEMP: SIGN RANDOMIZER
-//    std::mt19937 gen( time(0) );
-//    std::uniform_int_distribution<int> dis(-1, 1);
+    // Delay lines of this receiver.
+    unsigned long*** values = _delay_values + receiver * _n_rev_sources;
+    float*** weights = _delay_weights + receiver * _n_rev_sources;
+    unsigned** counters = _delay_counters + receiver * _n_rev_sources;
+    laproque::FadingMultiDelay*** delays = _delays + receiver * _n_rev_sources;
+    const TapGrid::Image* images = _images[receiver][ord];
     
-    // Calculate direct distance for relative compensation.
-    float direct_distance = (_rec_pos - _src_pos).get_length();
+    // Reset counters.
+    for ( rev = 0; rev < _n_rev_sources; rev++ ) {
+        counters[rev][ord] = 0;
+    }
     
-    // Compute the positions of all mirror sources
-    _room.mirror_point( _src_pos, _order, _mirror_sources );
+    // The reverb sources turn with the receiver.
+    const float orientation = _applied_geometry.receiver_azimuth[receiver];
     
-    // Loop through orders of reflections
-    for ( ord = 0; ord < _order; ord++)
+    // Loop through sources in this order
+    for ( src = 0; src < _sources_in_order[ord]; src++)
     {
-        // Reset counters.
-        for ( rev = 0; rev < _n_rev_sources; rev++ ) {
-            _delay_counters[rev][ord] = 0;
-        }
+        angle = remainderf( images[src].azimuth - orientation, 2*M_PI );
+        weight = images[src].weight;
+        samples_delay = images[src].delay;
         
-        // Loop through sources in this order
-        Room::extract_order( ord+1, _mirror_sources, _order, _one_order );
-        for ( src = 0; src < _sources_in_order[ord]; src++)
+        // Find reverb source with closest azimuth.
+        for ( rev = 0; rev < _n_rev_sources; rev++)
         {
-            // Compute relevant properties of this mirror source.
-            distance = _one_order[src].distance_to( _rec_pos );
-            angle = _rec_pos.azimuth_to( _one_order[src] );
-            weight = std::min( 1.f / distance, 1.f);
-            samples_delay = roundf( (distance-direct_distance) / 343. * _sample_rate);
-            
+            angle_diff = angle - _rev_source_angles[rev];
+            abs_angle_diff = fabsf( angle_diff );
+            // Maximum angular distance of two points on a circle is PI
+            if ( abs_angle_diff > M_PI ) abs_angle_diff= 2*M_PI - abs_angle_diff;
             
-            // Find reverb source with closest azimuth.
-            for ( rev = 0; rev < _n_rev_sources; rev++)
-            {
-                angle_diff = angle - _rev_source_angles[rev];
-                abs_angle_diff = fabsf( angle_diff );
-                // Maximum angular distance of two points on a circle is PI
-                if ( abs_angle_diff > M_PI ) abs_angle_diff= 2*M_PI - abs_angle_diff;
+            if ( abs_angle_diff <= _max_anglular_distance ) {
+                closest_reverb = rev;
                 
-                if ( abs_angle_diff <= _max_anglular_distance ) {
-                    closest_reverb = rev;
-                    
-                    break;
-                }
+                break;
             }
-            //printf("%f\t%i\n", angle_diff, closest_reverb);
-            
-            // Fade between the neighboring sources.
-            closest_weight = weight * (1.f - (abs_angle_diff / _max_anglular_distance));
-            
-            // Install delay to next neighbor.
-            neighbor = closest_reverb + sign(angle_diff);
-            if ( neighbor < 0 || neighbor == _n_rev_sources) neighbor = 0;
-            neighbor_weight = weight * (abs_angle_diff / _max_anglular_distance);
-            
-            // Store delay and weight values.
-            _delay_values [closest_reverb][ord][_delay_counters[closest_reverb][ord]] = samples_delay;
-            _delay_weights[closest_reverb][ord][_delay_counters[closest_reverb][ord]] = closest_weight;
-            _delay_counters[closest_reverb][ord]++;
-            
-            _delay_values [neighbor][ord][_delay_counters[neighbor][ord]] = samples_delay;
-            _delay_weights[neighbor][ord][_delay_counters[neighbor][ord]] = neighbor_weight;
-            _delay_counters[neighbor][ord]++;
-            
         }
+        //printf("%f\t%i\n", angle_diff, closest_reverb);
         
-        // Apply new values in delay modules of this order.
-        for ( rev = 0; rev < _n_rev_sources; rev++ ) {
-            _delays[rev][ord]->set_delays(  _delay_values[rev][ord]
-                                          , _delay_weights[rev][ord]
-                                          , _delay_counters[rev][ord]
-                                          );
-        }
+        // Fade between the neighboring sources.
+        closest_weight = weight * (1.f - (abs_angle_diff / _max_anglular_distance));
+        
+        // Install delay to next neighbor.
+        neighbor = closest_reverb + sign(angle_diff);
+        if ( neighbor < 0 || neighbor == _n_rev_sources) neighbor = 0;
+        neighbor_weight = weight * (abs_angle_diff / _max_anglular_distance);
+        
+        // Store delay and weight values.
+        values [closest_reverb][ord][counters[closest_reverb][ord]] = samples_delay;
+        weights[closest_reverb][ord][counters[closest_reverb][ord]] = closest_weight;
+        counters[closest_reverb][ord]++;
+        
+        values [neighbor][ord][counters[neighbor][ord]] = samples_delay;
+        weights[neighbor][ord][counters[neighbor][ord]] = neighbor_weight;
+        counters[neighbor][ord]++;
+        
+    }
+    
+    // Apply new values in delay modules of this order.
+    for ( rev = 0; rev < _n_rev_sources; rev++ ) {
+        delays[rev][ord]->set_delays(  values[rev][ord]
+                                     , weights[rev][ord]
+                                     , counters[rev][ord]
+                                     );
+    }
+}
+
+void SSRverb::ISMverb::_rotate_taps()
+{
+    // The rotation stays pending if the orientation could not be read.
+    Geometry geometry;
+    if ( !_load_geometry( geometry ) ) return;
+    
+    for ( unsigned rcv = 0; rcv < _n_receivers; rcv++ ) _applied_geometry.receiver_azimuth[rcv] = geometry.receiver_azimuth[rcv];
+    _rotation_pending = false;
+    _frames_since_rotation = 0;
+    
+    // Muted orders have nothing to re-pan.
+    if ( !_grid_in_scene ) return;
+    
+    const unsigned active_order = _active_order.load();
+    for ( unsigned ord = 0; ord < _order; ord++ )
+    {
+        if ( !_order_running( ord, active_order ) ) continue;
+        for ( unsigned rcv = 0; rcv < _n_receivers; rcv++ ) _pan_order( rcv, ord );
+    }
+}
+
+void SSRverb::ISMverb::_refresh_stale_order()
+{
+    const float max_rate = _max_update_rate.load();
+    const unsigned full_rate_orders = _full_rate_orders.load();
+    
+    // Order k is refreshed at most at max_rate / ( k - full_rate_orders ), the lowest outdated one first.
+    for ( unsigned ord = full_rate_orders; ord < _order; ord++ )
+    {
+        if ( !_order_stale[ord] || !_order_running( ord, _active_order.load() ) ) continue;
+        
+        const float interval = max_rate > 0.f ? _sample_rate / max_rate * float( ord + 1 - full_rate_orders ) : 0.f;
+        if ( _order_age[ord] < interval ) continue;
+        
+        SSRVERB_PROFILE_SCOPE( _profiler, DspProfiler::ISM_UPDATE );
+        _update_order( ord );
+        return;
     }
 }
 
+bool SSRverb::ISMverb::_move_due()
+{
+    const float max_rate = _max_update_rate.load();
+    if ( max_rate > 0.f && _frames_since_update < _sample_rate / max_rate ) return false;
+    
+    // Once the movement stopped, the final position is applied in any case.
+    // That is past ISM_PREDICTION_TIMEOUT, so it is not extrapolated.
+    if ( _frames_since_move >= _sample_rate / 20 ) return true;
+    
+    Geometry geometry;
+    _load_geometry( geometry );
+    float source_shift = 0.f, receiver_shift = 0.f;
+    for ( int dim = 0; dim < 3; dim++ ) {
+        source_shift += powf( geometry.source[dim] - _applied_geometry.source[dim], 2.f );
+    }
+    
+    // The receiver which moved most bounds the path length changes of all of them.
+    for ( unsigned rcv = 0; rcv < _n_receivers; rcv++ )
+    {
+        float shift = 0.f;
+        for ( int dim = 0; dim < 3; dim++ ) shift += powf( geometry.receiver[rcv][dim] - _applied_geometry.receiver[rcv][dim], 2.f );
+        if ( !( shift <= receiver_shift ) ) receiver_shift = shift;
+    }
+    
+    float dead_band = _dead_band.load();
+    if ( dead_band < 0.f ) dead_band = 343.f / _sample_rate;
+    
+    // NAN before the first update, which is never within the dead-band.
+    return !( sqrtf( source_shift ) + sqrtf( receiver_shift ) < dead_band );
+}
 
 void SSRverb::ISMverb::process(
                       float *input
                       , float **outputs
-                      , unsigned long n_frames
+                      , unsigned n_frames
                       )
 {
-    if ( _has_changed.load() ) _update_delays();
-    
     unsigned rev, idx, ord, band;
     
-    for ( rev = 0; rev < _n_rev_sources; rev++ ) {
+    for ( rev = 0; rev < _n_outputs; rev++ ) {
         for ( idx = 0; idx < n_frames; idx++ ) {
             outputs[rev][idx] = 0.f;
         }
     }
     
+    // Idle path. Pending position changes are applied on wake up.
+    if ( _silence.check_input( input, n_frames ) ) return;
+    
+    const unsigned active_order = _active_order.load();
+    const float fade_step = float(n_frames) / float(_fade_length);
+    float gain_start, gain_end, gain_step;
+    
+    // Taken before the update, so changes arriving during it are not lost.
+    // Room changes update all orders right away, moves pass the dead-band and rate limit.
+    bool update = _has_changed.exchange( false );
+    
+    // Swap in a new tap grid. The grid thread frees the old one, once it took the retired one back.
+    if ( _tap_grid_retired.load() == nullptr )
+    {
+        TapGrid* grid = _tap_grid_ready.exchange( nullptr );
+        if ( grid != nullptr ) {
+            _tap_grid_retired.store( _tap_grid );
+            _tap_grid = grid;
+            update = true;
+        }
+    }
+    
+    if ( _has_moved.exchange( false ) ) {
+        _move_pending = true;
+        _frames_since_move = 0;
+    }
+    else _frames_since_move += n_frames;
+    _frames_since_update += n_frames;
+    
+    if ( _has_rotated.exchange( false ) ) _rotation_pending = true;
+    _frames_since_rotation += n_frames;
+    
     for ( ord = 0; ord < _order; ord++ )
     {
-        // Process Filterbank in this oder.
-        _filterbanks[ord]->process( input, _band_buffers, n_frames );
-        for ( idx = 0; idx < n_frames; idx++ )
+        _order_age[ord] += n_frames;
+        
+        if ( ord < active_order ) {
+            // Switched on again. Taps are outdated.
+            if ( _order_gains[ord] == 0.f && _order_warmup[ord] == _max_delay ) update = true;
+        }
+        else if ( _order_gains[ord] == 0.f ) {
+            // Switched off and faded out. Delay lines need refilling before fading in again.
+            _order_warmup[ord] = _max_delay;
+        }
+    }
+    
+    if ( update ) {
+        SSRVERB_PROFILE_SCOPE( _profiler, DspProfiler::ISM_UPDATE );
+        _update_delays();
+    }
+    else if ( _move_pending && _move_due() ) {
+        // Low orders follow every move. Higher ones are refreshed in later blocks.
+        SSRVERB_PROFILE_SCOPE( _profiler, DspProfiler::ISM_UPDATE );
+        _mirror_positions();
+        for ( ord = 0; ord < std::min( _full_rate_orders.load(), _order ); ord++ ) _update_order( ord );
+    }
+    else if ( _rotation_pending && !( _max_update_rate.load() > 0.f && _frames_since_rotation < _sample_rate / _max_update_rate.load() ) ) {
+        // Only turned. The image sources stay, they are only re-panned.
+        SSRVERB_PROFILE_SCOPE( _profiler, DspProfiler::ISM_UPDATE );
+        _rotate_taps();
+    }
+    else _refresh_stale_order();
+    
+    {
+        SSRVERB_PROFILE_SCOPE( _profiler, DspProfiler::ISM_FILTERBANKS );
+        
+        for ( ord = 0; ord < _order; ord++ )
         {
-            _internal_buffer[idx] = 0.f;
-            // Apply band weights according to order
-            for ( band = 0; band < _n_freq_bands; band++ ) {
-                _internal_buffer[idx] += _band_buffers[band][idx] * _band_weights[ord][band];
+            if ( !_order_running( ord, active_order ) ) continue;
+            
+            // Process Filterbank in this oder.
+            _filterbanks[ord]->process( input, _band_buffers, n_frames );
+            for ( idx = 0; idx < n_frames; idx++ )
+            {
+                _order_buffers[ord][idx] = 0.f;
+                // Apply band weights according to order
+                for ( band = 0; band < _n_freq_bands; band++ ) {
+                    _order_buffers[ord][idx] += _band_buffers[band][idx] * _band_weights[ord][band];
+                }
             }
         }
+    }
+    
+    SSRVERB_PROFILE_SCOPE( _profiler, DspProfiler::ISM_DELAYS );
+    
+    for ( ord = 0; ord < _order; ord++ )
+    {
+        if ( !_order_running( ord, active_order ) ) continue;
+        
+        // Compute gain ramp of this order.
+        gain_start = _order_gains[ord];
+        if ( ord >= active_order ) {
+            _order_gains[ord] = std::max( gain_start - fade_step, 0.f );
+        }
+        else if ( _order_warmup[ord] > 0 ) {
+            _order_warmup[ord] -= std::min( _order_warmup[ord], (unsigned long)n_frames );
+        }
+        else {
+            _order_gains[ord] = std::min( gain_start + fade_step, 1.f );
+        }
+        gain_end = _order_gains[ord];
+        gain_step = (gain_end - gain_start) / n_frames;
         
-        for ( rev = 0; rev < _n_rev_sources; rev++ )
+        // The filtered input of this order is shared by the delay lines of all receivers.
+        for ( rev = 0; rev < _n_outputs; rev++ )
         {
             // Process delay
-            _delays[rev][ord]->process( _internal_buffer, _delay_output, n_frames );
+            _delays[rev][ord]->process( _order_buffers[ord], _delay_output, n_frames );
             
             // Add to output buffer.
-            for ( idx = 0; idx < n_frames; idx++ ) {
-                outputs[rev][idx] += _delay_output[idx];
+            if ( gain_start == 1.f && gain_end == 1.f ) {
+                for ( idx = 0; idx < n_frames; idx++ ) {
+                    outputs[rev][idx] += _delay_output[idx];
+                }
+            }
+            else if ( gain_start > 0.f || gain_end > 0.f ) {
+                for ( idx = 0; idx < n_frames; idx++ ) {
+                    outputs[rev][idx] += _delay_output[idx] * ( gain_start + gain_step * float(idx) );
+                }
             }
         }
     }
     
-    _has_changed.store( false );
+    // Flush filter states once the last reflection passed.
+    if ( _silence.check_output( outputs, _n_outputs, n_frames ) )
+    {
+        for ( ord = 0; ord < _order; ord++ ) {
+            _filterbanks[ord]->reset();
+        }
+    }
+}
+
+double SSRverb::ISMverb::_now()
+{
+    return std::chrono::duration< double >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void SSRverb::ISMverb::_track( float* position, float* velocity, double& time, Vector3D new_pos, double now )
+{
+    const double delta = now - time;
+    
+    for ( int dim = 0; dim < 3; dim++ )
+    {
+        // Start from rest after a pause. Updates arriving in one burst leave the velocity as is.
+        if ( delta > .25 ) velocity[dim] = 0.f;
+        else if ( delta > 1e-4 ) {
+            const float raw = float( ( new_pos[dim] - position[dim] ) / delta );
+            velocity[dim] += ( 1.f - expf( -float( delta ) / _velocity_smoothing ) ) * ( raw - velocity[dim] );
+        }
+        position[dim] = new_pos[dim];
+    }
+    time = now;
+}
+
+bool SSRverb::ISMverb::_load_geometry( Geometry& geometry )
+{
+    // Writers may be preempted while they hold the lock. Never wait for them.
+    if ( _geometry.try_load( geometry, ISM_GEOMETRY_ATTEMPTS ) ) return true;
+    
+    geometry = _applied_geometry;
+    return false;
+}
+
+SSRverb::Vector3D SSRverb::ISMverb::_predict( const float* position, const float* velocity, double time, double now, float horizon )
+{
+    // Before the final update of a stopped source is due, see _move_due().
+    const double age = now - time;
+    if ( age > ISM_PREDICTION_TIMEOUT ) return Vector3D( position[0], position[1], position[2] );
+    
+    const float lead = float( age ) + horizon;
+    return Vector3D(  position[0] + velocity[0] * lead
+                    , position[1] + velocity[1] * lead
+                    , position[2] + velocity[2] * lead
+                    );
 }
 
 void SSRverb::ISMverb::set_source( Vector3D source )
 {
-    _src_pos = source;
-    _has_changed.store( true );
+    const double now = _now();
+    _geometry.modify( [&source, now]( Geometry& geometry ) {
+        _track( geometry.source, geometry.source_velocity, geometry.source_time, source, now );
+    } );
+    _has_moved.store( true );
 }
 
 void SSRverb::ISMverb::set_receiver( Vector3D receiver )
 {
-    _rec_pos = receiver;
-    _has_changed.store( true );
+    set_receiver( 0, receiver );
+}
+
+void SSRverb::ISMverb::set_receiver( unsigned receiver, Vector3D position )
+{
+    if ( receiver >= _n_receivers ) return;
+    
+    const double now = _now();
+    _geometry.modify( [receiver, &position, now]( Geometry& geometry ) {
+        _track( geometry.receiver[receiver], geometry.receiver_velocity[receiver], geometry.receiver_time[receiver], position, now );
+    } );
+    _has_moved.store( true );
+    _request_tap_grid();
+}
+
+void SSRverb::ISMverb::set_receiver_orientation( float azimuth )
+{
+    set_receiver_orientation( 0, azimuth );
+}
+
+void SSRverb::ISMverb::set_receiver_orientation( unsigned receiver, float azimuth )
+{
+    if ( receiver >= _n_receivers ) return;
+    
+    _geometry.modify( [receiver, azimuth]( Geometry& geometry ) {
+        geometry.receiver_azimuth[receiver] = azimuth;
+    } );
+    _has_rotated.store( true );
+}
+
+float SSRverb::ISMverb::get_receiver_orientation( unsigned receiver )
+{
+    return _geometry.load().receiver_azimuth[std::min( receiver, _n_receivers - 1 )];
 }
 
 SSRverb::Vector3D SSRverb::ISMverb::get_source()
 {
-    return _src_pos;
+    const Geometry geometry = _geometry.load();
+    return Vector3D( geometry.source[0], geometry.source[1], geometry.source[2] );
 }
 
-SSRverb::Vector3D SSRverb::ISMverb::get_receiver()
+SSRverb::Vector3D SSRverb::ISMverb::get_receiver( unsigned receiver )
 {
-    return _rec_pos;
+    const Geometry geometry = _geometry.load();
+    const float* position = geometry.receiver[std::min( receiver, _n_receivers - 1 )];
+    return Vector3D( position[0], position[1], position[2] );
 }
 
 void SSRverb::ISMverb::set_room_dimensions( float x, float y, float z )
 {
     _room.set_dimensions( x, y, z );
     _has_changed = true;
+    _request_tap_grid();
+}
+
+void SSRverb::ISMverb::set_room_size( float x, float y, float z )
+{
+    set_room_dimensions( x, y, z );
+}
+
+void SSRverb::ISMverb::set_src_pos( Vector3D new_pos )
+{
+    set_source( new_pos );
+}
+
+void SSRverb::ISMverb::set_rec_pos( Vector3D new_pos )
+{
+    set_receiver( new_pos );
+}
+
+void SSRverb::ISMverb::set_rec_orientation( float azimuth )
+{
+    set_receiver_orientation( azimuth );
 }
 
 void SSRverb::ISMverb::set_co_freqs( std::vector<float> co_freqs )
@@ -366,9 +900,165 @@ void SSRverb::ISMverb::set_band_weight( float weight, unsigned band_idx )
     }
 }
 
+void SSRverb::ISMverb::set_update_dead_band( float dead_band )
+{
+    _dead_band.store( dead_band );
+}
+
+void SSRverb::ISMverb::set_max_update_rate( float max_rate )
+{
+    _max_update_rate.store( max_rate );
+}
+
+void SSRverb::ISMverb::set_extrapolation( float horizon )
+{
+    _extrapolation.store( horizon );
+}
+
+void SSRverb::ISMverb::set_full_rate_orders( unsigned n_orders )
+{
+    _full_rate_orders.store( n_orders );
+}
+
+void SSRverb::ISMverb::enable_tap_grid( float spacing, float source_height, const char* directory )
+{
+    {
+        std::lock_guard< std::mutex > lock( _tap_grid_mtx );
+        _tap_grid_spacing = spacing;
+        _tap_grid_height = source_height;
+        _tap_grid_directory = directory != nullptr ? directory : "";
+    }
+    
+    _tap_grid_enabled.store( spacing > 0.f );
+    if ( spacing <= 0.f ) return;
+    
+    if ( !_tap_grid_thread.joinable() ) _tap_grid_thread = std::thread( &ISMverb::_tap_grid_loop, this );
+    _request_tap_grid();
+}
+
+bool SSRverb::ISMverb::is_tap_grid_used()
+{
+    return _tap_grid_cell.load() >= 0;
+}
+
+SSRverb::TapGrid::Key SSRverb::ISMverb::_make_tap_grid_key( Vector3D receiver, float spacing, float source_height )
+{
+    return TapGrid::Key{
+          { _room.get_x_size(), _room.get_y_size(), _room.get_z_size() }
+        , { receiver[0], receiver[1], receiver[2] }
+        , source_height
+        , spacing
+        , _order
+        , _sample_rate
+    };
+}
+
+void SSRverb::ISMverb::_request_tap_grid()
+{
+    if ( !_tap_grid_enabled.load() || _n_receivers > 1 ) return;
+    
+    std::lock_guard< std::mutex > lock( _tap_grid_mtx );
+    _tap_grid_request = _make_tap_grid_key( get_receiver(), _tap_grid_spacing, _tap_grid_height );
+    _tap_grid_generation++;
+    _tap_grid_cv.notify_one();
+}
+
+void SSRverb::ISMverb::_tap_grid_loop()
+{
+    std::unique_lock< std::mutex > lock( _tap_grid_mtx );
+    unsigned built = 0;
+    
+    while ( true )
+    {
+        _tap_grid_cv.wait( lock, [this, built] { return _tap_grid_quit || _tap_grid_generation != built; } );
+        if ( _tap_grid_quit ) return;
+        
+        // Wait until the requests settled, e.g. while the receiver is dragged around.
+        const unsigned generation = _tap_grid_generation;
+        if ( _tap_grid_cv.wait_for( lock, std::chrono::milliseconds( 500 ), [this, generation] {
+            return _tap_grid_quit || _tap_grid_generation != generation;
+        } ) ) continue;
+        
+        built = generation;
+        const TapGrid::Key key = _tap_grid_request;
+        const std::string directory = _tap_grid_directory;
+        lock.unlock();
+        
+        // The audio thread only retires a grid while none is waiting to be freed.
+        delete _tap_grid_retired.exchange( nullptr );
+        
+        TapGrid* grid = _build_tap_grid( key, directory, generation );
+        if ( grid != nullptr ) delete _tap_grid_ready.exchange( grid );
+        
+        lock.lock();
+    }
+}
+
+SSRverb::TapGrid* SSRverb::ISMverb::_build_tap_grid( const TapGrid::Key& key, const std::string& directory, unsigned generation )
+{
+    const std::vector< unsigned > order_sizes( _sources_in_order, _sources_in_order + _order );
+    
+    std::string path;
+    if ( !directory.empty() )
+    {
+        path = TapGrid::get_file_name( directory.c_str(), key );
+        TapGrid* grid = TapGrid::load( path.c_str(), key, order_sizes );
+        if ( grid != nullptr ) {
+            SSRVERB_LOG_INFO( "Loaded ISM tap grid %s", path.c_str() );
+            return grid;
+        }
+    }
+    
+    TapGrid* grid = new TapGrid( key, order_sizes );
+    
+    // Own room and buffers, the ones of the audio thread are in use.
+    Room room( key.room[0], key.room[1], key.room[2] );
+    Room::MirroedSources mirror_sources = Room::prepare_mirror_vector( _order );
+    Vector3D* one_order = new Vector3D[_sources_in_order[_order-1]];
+    Vector3D receiver( key.receiver[0], key.receiver[1], key.receiver[2] );
+    
+    TapGrid::Image* images = new TapGrid::Image[_sources_in_order[_order-1]];
+    float* buffer = new float[4 * _sources_in_order[_order-1]];
+    
+    bool outdated = false;
+    for ( unsigned cell = 0; cell < grid->get_n_cells() && !outdated; cell++ )
+    {
+        float x, y;
+        grid->get_cell_center( cell, x, y );
+        Vector3D source( x, y, key.source_height );
+        
+        room.mirror_point( source, _order, mirror_sources );
+        const float direct_distance = ( receiver - source ).get_length();
+        
+        for ( unsigned ord = 0; ord < _order; ord++ ) {
+            Room::extract_order( ord+1, mirror_sources, _order, one_order );
+            _measure_images( ord, key.sample_rate, 1, &receiver, &direct_distance, one_order, &images, buffer );
+            grid->set_images( cell, ord, images );
+        }
+        
+        // Give up once the grid would be outdated anyway.
+        std::lock_guard< std::mutex > lock( _tap_grid_mtx );
+        outdated = _tap_grid_quit || _tap_grid_generation != generation;
+    }
+    
+    delete [] images;
+    delete [] buffer;
+    delete [] one_order;
+    Room::dispose_mirror_vector( mirror_sources, _order );
+    
+    if ( outdated ) {
+        delete grid;
+        return nullptr;
+    }
+    
+    if ( !path.empty() && !grid->save( path.c_str() ) ) SSRVERB_LOG_WARNING( "Could not save ISM tap grid %s", path.c_str() );
+    
+    return grid;
+}
+
 void SSRverb::ISMverb::set_tracked_source( unsigned int source_id )
 {
-    _tracked_source_id = source_id;
+    _tracked_source_id.store( source_id );
 }
 
 void SSRverb::ISMverb::set_tracking( bool status )
@@ -381,6 +1071,88 @@ bool SSRverb::ISMverb::get_tracking()
     return _tracking_active.load();
 }
 
+bool SSRverb::ISMverb::is_idle()
+{
+    return _silence.is_idle();
+}
+
+void SSRverb::ISMverb::set_idle_detection( bool status )
+{
+    _silence.set_enabled( status );
+}
+
+void SSRverb::ISMverb::set_profiler( DspProfiler* profiler )
+{
+    _profiler = profiler;
+}
+
+bool SSRverb::ISMverb::_order_running( unsigned ord, unsigned active_order )
+{
+    // Switched on, or still fading out.
+    return ord < active_order || _order_gains[ord] > 0.f;
+}
+
+void SSRverb::ISMverb::set_active_order( unsigned order )
+{
+    _active_order.store( std::min( std::max( order, 1u ), _order ) );
+}
+
+void SSRverb::ISMverb::switch_active_order( unsigned order )
+{
+    set_active_order( order );
+    
+    const unsigned active_order = _active_order.load();
+    for ( unsigned ord = 0; ord < _order; ord++ ) {
+        _order_gains[ord] = ord < active_order ? 1.f : 0.f;
+        _order_warmup[ord] = ord < active_order ? 0 : _max_delay;
+    }
+    
+    // Orders switched on kept their old taps.
+    _has_changed.store( true );
+}
+
+unsigned SSRverb::ISMverb::get_active_order()
+{
+    return _active_order.load();
+}
+
+unsigned SSRverb::ISMverb::get_tap_budget( unsigned order )
+{
+    // Every mirror source is panned between two reverb sources of every receiver.
+    return 2 * _n_receivers * Room::get_n_mirr_src( std::min( order, _order ) );
+}
+
+unsigned long SSRverb::ISMverb::get_n_updates()
+{
+    return _n_updates;
+}
+
+unsigned SSRverb::ISMverb::get_n_taps()
+{
+    const unsigned active_order = _active_order.load();
+    unsigned n_taps = 0;
+    
+    for ( unsigned ord = 0; ord < _order; ord++ ) {
+        if ( !_order_running( ord, active_order ) ) continue;
+        for ( unsigned rev = 0; rev < _n_outputs; rev++ ) n_taps += _delay_counters[rev][ord];
+    }
+    return n_taps;
+}
+
+void SSRverb::ISMverb::update_taps()
+{
+    _has_changed.store( false );
+    _has_moved.store( false );
+    _has_rotated.store( false );
+    _update_delays();
+}
+
+void SSRverb::ISMverb::update_rotation()
+{
+    _has_rotated.store( false );
+    _rotate_taps();
+}
+
 void SSRverb::ISMverb::set_t60( float t60_value, unsigned band_idx )
 {
     // Estimate using sabine.
@@ -10,15 +10,16 @@
 #include <sndfile.h>
 
 SSRverb::JackISMverb::JackISMverb( float x, float y, float z, unsigned order ) :
-    ReverbBase("SSRverb::JackISMverb", 8),
-    _ism(x, y, z, order, _sample_rate, _block_size)
+    ReverbBase("SSRverb::JackISMverb", 8, 64),
+    _ism(x, y, z, order, _sample_rate, _internal_block_size)
 {
     _ism.set_tracked_source(9);
     _ism.set_receiver(Vector3D{x/2.f, y/2.f, z/2.f});
     _ism.set_source(Vector3D{x/3.f, y/3.f, z/3.f});
 
-    set_update_callback( SSRverb::ISMverb::update_src_pos, &_ism );
-    
+    _set_scene_update( SSRverb::ISMverb::update_changed_src_pos, &_ism );
+    _ism.set_profiler( &_profiler );
+    _set_engine( &_ism );
 }
 
 void SSRverb::JackISMverb::activate()
@@ -33,13 +34,15 @@ SSRverb::JackISMverb::~JackISMverb()
     deactivate();
 }
 
-void SSRverb::JackISMverb::render_audio(
-                           laproque::nframes_t n_frames
-                           , laproque::sample_t **in_buffers
-                           , laproque::sample_t **out_buffers
-                           )
+void SSRverb::JackISMverb::_end_cycle( DeadlineWatchdog::Overrun* record )
 {
-    _ism.process( in_buffers[0], out_buffers, n_frames );
+    const unsigned long n_updates = _ism.get_n_updates();
+    
+    if ( record != nullptr ) {
+        record->ism_update = n_updates != _last_n_updates;
+        record->n_taps = std::min( _ism.get_n_taps(), 65535u );
+    }
+    _last_n_updates = n_updates;
 }
 
 void SSRverb::JackISMverb::set_src_pos( Vector3D new_pos )
@@ -52,6 +55,12 @@ void SSRverb::JackISMverb::set_rec_pos( Vector3D new_pos )
     ReverbBase::set_rec_pos( new_pos );
 }
 
+void SSRverb::JackISMverb::set_rec_orientation( float azimuth )
+{
+    _ism.set_receiver_orientation( azimuth );
+    ReverbBase::set_rec_orientation( azimuth );
+}
+
 void SSRverb::JackISMverb::set_tracked_source( unsigned id )
 {
     _ism.set_tracked_source( id );
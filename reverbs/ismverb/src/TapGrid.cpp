@@ -0,0 +1,179 @@
+//
+//  TapGrid.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "TapGrid.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+const char TAP_GRID_MAGIC[4] = { 'S', 'S', 'R', 'G' };
+const uint32_t TAP_GRID_VERSION = 2;
+
+/** File header. The cells follow right after it. */
+struct FileHeader
+{
+    char magic[4];
+    uint32_t version;
+    SSRverb::TapGrid::Key key;
+    uint32_t n_cells;
+    uint64_t cell_size;
+};
+
+}
+
+SSRverb::TapGrid::TapGrid( const Key& key, const std::vector< unsigned >& order_sizes )
+: _key( key )
+{
+    _setup_layout( order_sizes );
+    
+    const size_t size = _cell_size * get_n_cells();
+    _data = new uint8_t[size];
+    memset( _data, 0, size );
+}
+
+SSRverb::TapGrid::~TapGrid()
+{
+    delete [] _data;
+}
+
+void SSRverb::TapGrid::_setup_layout( const std::vector< unsigned >& order_sizes )
+{
+    // Cells are square as far as possible and never larger than the spacing.
+    _n_x = std::max( 1u, unsigned( ceilf( _key.room[0] / _key.spacing ) ) );
+    _n_y = std::max( 1u, unsigned( ceilf( _key.room[1] / _key.spacing ) ) );
+    
+    _order_sizes = order_sizes;
+    _order_offsets.resize( order_sizes.size() );
+    _cell_size = 0;
+    for ( unsigned ord = 0; ord < order_sizes.size(); ord++ ) {
+        _order_offsets[ord] = _cell_size;
+        _cell_size += order_sizes[ord] * sizeof(Image);
+    }
+}
+
+SSRverb::TapGrid* SSRverb::TapGrid::load( const char* path, const Key& key, const std::vector< unsigned >& order_sizes )
+{
+    FILE* file = fopen( path, "rb" );
+    if ( file == nullptr ) return nullptr;
+    
+    FileHeader header;
+    TapGrid* grid = new TapGrid();
+    grid->_key = key;
+    grid->_setup_layout( order_sizes );
+    
+    // Reject files of other keys, versions or layouts, e.g. hash collisions or truncated writes.
+    bool valid = fread( &header, sizeof(header), 1, file ) == 1
+              && memcmp( header.magic, TAP_GRID_MAGIC, sizeof(TAP_GRID_MAGIC) ) == 0
+              && header.version == TAP_GRID_VERSION
+              && memcmp( &header.key, &key, sizeof(Key) ) == 0
+              && header.n_cells == grid->get_n_cells()
+              && header.cell_size == grid->_cell_size;
+    
+    // Read into memory instead of mapping it, so lookups never fault pages in on the audio thread.
+    if ( valid ) {
+        grid->_data = new uint8_t[grid->_cell_size * grid->get_n_cells()];
+        valid = fread( grid->_data, grid->_cell_size, grid->get_n_cells(), file ) == grid->get_n_cells()
+             && fgetc( file ) == EOF;
+    }
+    fclose( file );
+    
+    if ( !valid ) {
+        delete grid;
+        return nullptr;
+    }
+    
+    return grid;
+}
+
+bool SSRverb::TapGrid::save( const char* path )
+{
+    FileHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, TAP_GRID_MAGIC, sizeof(TAP_GRID_MAGIC) );
+    header.version = TAP_GRID_VERSION;
+    header.key = _key;
+    header.n_cells = get_n_cells();
+    header.cell_size = _cell_size;
+    
+    // Written under a temporary name, so readers never load a half-written grid.
+    const std::string temporary = std::string( path ) + ".tmp";
+    FILE* file = fopen( temporary.c_str(), "wb" );
+    if ( file == nullptr ) return false;
+    
+    bool success = fwrite( &header, sizeof(header), 1, file ) == 1;
+    success &= fwrite( _data, _cell_size, get_n_cells(), file ) == get_n_cells();
+    success &= fclose( file ) == 0;
+    
+    if ( success ) success = rename( temporary.c_str(), path ) == 0;
+    if ( !success ) remove( temporary.c_str() );
+    
+    return success;
+}
+
+std::string SSRverb::TapGrid::get_file_name( const char* directory, const Key& key )
+{
+    // FNV-1a hash of the key. load() compares the whole key anyway.
+    uint64_t hash = 14695981039346656037ull;
+    const uint8_t* bytes = (const uint8_t*)&key;
+    for ( unsigned idx = 0; idx < sizeof(Key); idx++ ) {
+        hash ^= bytes[idx];
+        hash *= 1099511628211ull;
+    }
+    
+    char name[48];
+    snprintf( name, sizeof(name), "ismgrid-%016llx.bin", (unsigned long long)hash );
+    
+    std::string path( directory );
+    if ( !path.empty() && path.back() != '/' ) path += '/';
+    return path + name;
+}
+
+const SSRverb::TapGrid::Key& SSRverb::TapGrid::get_key()
+{
+    return _key;
+}
+
+bool SSRverb::TapGrid::matches( const Key& key, float source_z )
+{
+    return memcmp( &key, &_key, sizeof(Key) ) == 0
+        && fabsf( source_z - _key.source_height ) <= _key.spacing / 2.f;
+}
+
+unsigned SSRverb::TapGrid::get_n_cells()
+{
+    return _n_x * _n_y;
+}
+
+void SSRverb::TapGrid::get_cell_center( unsigned cell, float& x, float& y )
+{
+    x = ( float( cell % _n_x ) + .5f ) * _key.room[0] / _n_x;
+    y = ( float( cell / _n_x ) + .5f ) * _key.room[1] / _n_y;
+}
+
+int SSRverb::TapGrid::get_cell( float x, float y )
+{
+    if ( !( x > 0.f && x < _key.room[0] && y > 0.f && y < _key.room[1] ) ) return -1;
+    
+    const unsigned x_idx = std::min( unsigned( x / _key.room[0] * _n_x ), _n_x - 1 );
+    const unsigned y_idx = std::min( unsigned( y / _key.room[1] * _n_y ), _n_y - 1 );
+    return int( y_idx * _n_x + x_idx );
+}
+
+const SSRverb::TapGrid::Image* SSRverb::TapGrid::get_images( unsigned cell, unsigned ord )
+{
+    return (const Image*)( _data + cell * _cell_size + _order_offsets[ord] );
+}
+
+void SSRverb::TapGrid::set_images( unsigned cell, unsigned ord, const Image* images )
+{
+    memcpy( _data + cell * _cell_size + _order_offsets[ord], images, _order_sizes[ord] * sizeof(Image) );
+}
@@ -0,0 +1,77 @@
+//
+//  ConvolutionEngine.hpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#ifndef ConvolutionEngine_hpp
+#define ConvolutionEngine_hpp
+
+#include "reverbs/include/ReverbEngine.hpp"
+#include "reverbs/include/SilenceDetector.hpp"
+#include "reverbs/include/DspProfiler.hpp"
+#include "laproque/include/Convolver.hpp"
+
+namespace SSRverb {
+
+/**
+@class ConvolutionEngine
+Convolves the input with one impulse response per output channel.
+
+Convolution is partitioned, so process() must always be called with
+exactly the block size passed to the constructor or to prepare().
+*/
+class ConvolutionEngine : public ReverbEngine
+{
+public:
+    /**
+    @param imp_resps Arrays with the impulse response of every output channel. They are copied.
+    @param n_channels Number of output channels.
+    @param ir_length Number of samples of every impulse response.
+    @param block_size Number of frames processed at once.
+    */
+    ConvolutionEngine(  float** imp_resps
+                      , unsigned n_channels
+                      , unsigned long ir_length
+                      , unsigned block_size
+                      );
+    ~ConvolutionEngine();
+    
+    /**
+    @brief Repartitions the impulse responses in case the block size changed.
+    The impulse responses are not resampled.
+    */
+    void prepare( unsigned sample_rate, unsigned max_block_size );
+    
+    void process( float* input, float** outputs, unsigned n_frames );
+    
+    unsigned get_n_outputs();
+    
+    /** @returns True in case all convolvers only hold zeros and are skipped. */
+    bool is_idle();
+    
+    /** @brief Sets the profiler the convolution is recorded with. May be nullptr. */
+    void set_profiler( DspProfiler* profiler );
+    
+private:
+    const unsigned _n_channels;
+    const unsigned long _ir_length;
+    unsigned _block_size;
+    
+    float** _imp_resps;
+    laproque::Convolver** _convolvers;
+    
+    // Convolution is skipped once the input was silent for a full impulse response.
+    SilenceDetector _silence;
+    
+    DspProfiler* _profiler = nullptr;
+    
+    void _make_convolvers();
+    void _delete_convolvers();
+};
+
+} // namespace SSRverb
+
+#endif /* ConvolutionEngine_hpp */
@@ -10,8 +10,7 @@
 #define JackRandomizer_hpp
 
 #include "reverbs/include/ReverbBase.hpp"
-#include "laproque/include/Convolver.hpp"
-#include <array>
+#include "ConvolutionEngine.hpp"
 
 namespace SSRverb {
 
@@ -22,14 +21,9 @@ public:
     ~JackRandomizer();
     const static unsigned n_convolvers = 8;
     
-    void render_audio(
-                      laproque::nframes_t n_frames
-                      , laproque::sample_t **in_buffers
-                      , laproque::sample_t **out_buffers
-                      );
-    
 private:
-    std::array<laproque::Convolver*, n_convolvers> _convolvers;
+    // Stays empty in case the impulse response could not be read.
+    ConvolutionEngine* _convolution = nullptr;
 };
 
 } // namespace SSRverb
@@ -33,6 +33,9 @@ public:
     Randomizer( const char* file_path, unsigned n_sources = 8 );
     ~Randomizer();
     
+    /** @brief Fixes the seed of the random distribution, which is time based by default. */
+    void set_seed( unsigned seed );
+    
     /** @brief Starts the impulse response spatialization process. */
     void create_spacial_imp_resp( bool write_wavs = false );
     
@@ -40,11 +43,15 @@ public:
     
     long long get_ir_length();
     
+    /** @returns Sample rate of the impulse response file. */
+    unsigned get_sample_rate();
+    
 private:
     unsigned _n_sources;
     long long _ir_length;
     long long _max_padding;
     unsigned _sample_rate;
+    unsigned _seed;
     
     float* _source_angles;
     float* _mono_imp_resp = nullptr;
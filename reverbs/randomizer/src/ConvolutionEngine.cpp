@@ -0,0 +1,102 @@
+//
+//  ConvolutionEngine.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "ConvolutionEngine.hpp"
+#include <cstring>
+
+SSRverb::ConvolutionEngine::ConvolutionEngine(  float** imp_resps
+                                              , unsigned n_channels
+                                              , unsigned long ir_length
+                                              , unsigned block_size
+                                              )
+: _n_channels( n_channels ), _ir_length( ir_length ), _block_size( block_size )
+{
+    _imp_resps = new float*[_n_channels];
+    for ( unsigned chan = 0; chan < _n_channels; chan++ ) {
+        _imp_resps[chan] = new float[_ir_length];
+        memcpy( _imp_resps[chan], imp_resps[chan], _ir_length * sizeof(float) );
+    }
+    
+    _make_convolvers();
+}
+
+SSRverb::ConvolutionEngine::~ConvolutionEngine()
+{
+    _delete_convolvers();
+    
+    for ( unsigned chan = 0; chan < _n_channels; chan++ ) {
+        delete [] _imp_resps[chan];
+    }
+    delete [] _imp_resps;
+}
+
+void SSRverb::ConvolutionEngine::_make_convolvers()
+{
+    _convolvers = new laproque::Convolver*[_n_channels];
+    for ( unsigned chan = 0; chan < _n_channels; chan++ ) {
+        _convolvers[chan] = new laproque::Convolver( _imp_resps[chan], _ir_length, _block_size );
+    }
+    
+    // After this many silent samples the convolvers only hold zeros.
+    _silence.set_hold_length( _ir_length + _block_size );
+    _silence.set_tail_length( _ir_length + _block_size );
+    _silence.reset();
+}
+
+void SSRverb::ConvolutionEngine::_delete_convolvers()
+{
+    for ( unsigned chan = 0; chan < _n_channels; chan++ ) {
+        delete _convolvers[chan];
+    }
+    delete [] _convolvers;
+}
+
+void SSRverb::ConvolutionEngine::prepare( unsigned sample_rate, unsigned max_block_size )
+{
+    if ( max_block_size == _block_size ) return;
+    
+    _delete_convolvers();
+    _block_size = max_block_size;
+    _make_convolvers();
+}
+
+void SSRverb::ConvolutionEngine::process( float* input, float** outputs, unsigned n_frames )
+{
+    if ( _silence.check_input( input, n_frames ) )
+    {
+        for ( unsigned chan = 0; chan < _n_channels; chan++ ) {
+            memset( outputs[chan], 0, n_frames * sizeof(float) );
+        }
+        return;
+    }
+    
+    {
+        SSRVERB_PROFILE_SCOPE( _profiler, DspProfiler::CONVOLUTION );
+        
+        for ( unsigned chan = 0; chan < _n_channels; chan++ ) {
+            _convolvers[chan]->process( input, outputs[chan] );
+        }
+    }
+    
+    _silence.check_output( outputs, _n_channels, n_frames );
+}
+
+unsigned SSRverb::ConvolutionEngine::get_n_outputs()
+{
+    return _n_channels;
+}
+
+bool SSRverb::ConvolutionEngine::is_idle()
+{
+    return _silence.is_idle();
+}
+
+void SSRverb::ConvolutionEngine::set_profiler( DspProfiler* profiler )
+{
+    _profiler = profiler;
+}
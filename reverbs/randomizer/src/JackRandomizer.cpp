@@ -8,10 +8,16 @@
 
 #include "JackRandomizer.hpp"
 #include "Randomizer.hpp"
+#include "reverbs/include/Logger.hpp"
 #include <sndfile.h>
+#include <cstring>
 
 
-SSRverb::JackRandomizer::JackRandomizer(const char* wav_path) : SSRverb::ReverbBase("JackRandomizer", 8 )
+// Larger partitions keep the convolution cost down, at the price of
+// latency for JACK periods shorter than this.
+const unsigned CONV_BLOCK_SIZE = 256;
+
+SSRverb::JackRandomizer::JackRandomizer(const char* wav_path) : SSRverb::ReverbBase("JackRandomizer", 8, CONV_BLOCK_SIZE )
 {
     SNDFILE* audio_file;
     SF_INFO audio_format;
@@ -19,7 +25,7 @@ SSRverb::JackRandomizer::JackRandomizer(const char* wav_path) : SSRverb::ReverbB
     
     // Open audio file.
     audio_file = sf_open( wav_path, SFM_READ, &audio_format);
-    if ( !audio_file ) printf("File %s not found.\n", wav_path);
+    if ( !audio_file ) SSRVERB_LOG_ERROR( "File %s not found.", wav_path );
     // Read audio data.
     else {
         imp_resp = new float[audio_format.frames];
@@ -29,10 +35,9 @@ SSRverb::JackRandomizer::JackRandomizer(const char* wav_path) : SSRverb::ReverbB
         ir_randomizer.create_spacial_imp_resp();
         float** spacial_irs = ir_randomizer.get_spac_imp_resps();
 
-        for (unsigned idx = 0; idx < n_convolvers; idx++)
-        {
-            _convolvers[idx] = new laproque::Convolver(spacial_irs[idx], audio_format.frames, _block_size);
-        }
+        _convolution = new ConvolutionEngine( spacial_irs, n_convolvers, audio_format.frames, _internal_block_size );
+        _convolution->set_profiler( &_profiler );
+        _set_engine( _convolution );
         
         delete [] imp_resp;
     }
@@ -40,17 +45,6 @@ SSRverb::JackRandomizer::JackRandomizer(const char* wav_path) : SSRverb::ReverbB
 
 SSRverb::JackRandomizer::~JackRandomizer()
 {
-    for ( unsigned idx = 0; idx < n_convolvers; idx++ ) {
-        delete _convolvers[idx];
-    }
-}
-
-void SSRverb::JackRandomizer::render_audio(
-                           laproque::nframes_t n_frames
-                           , laproque::sample_t **in_buffers
-                           , laproque::sample_t **out_buffers )
-{
-    for ( unsigned idx = 0; idx < n_convolvers; idx++ ) {
-        _convolvers[idx]->process(in_buffers[0], out_buffers[idx]);
-    }
+    deactivate();
+    delete _convolution;
 }
@@ -11,10 +11,12 @@
 #include <algorithm>
 
 #include "Randomizer.hpp"
+#include "reverbs/include/Logger.hpp"
 
 SSRverb::Randomizer::Randomizer( const char* file_path, unsigned n_sources )
 {
     _n_sources = n_sources;
+    _seed = unsigned( time(0) );
     
     _source_angles = new float[_n_sources];
     for ( unsigned src = 0; src < _n_sources; src++ )
@@ -204,7 +206,7 @@ void SSRverb::Randomizer::create_spacial_imp_resp( bool write_wavs )
 
 void SSRverb::Randomizer::_distribute_samples()
 {
-    std::mt19937 generator( time(0) );
+    std::mt19937 generator( _seed );
     std::uniform_real_distribution<float> az_dist(0, 2.f*M_PI);
     std::uniform_real_distribution<float> el_dist( -M_PI, M_PI );
     
@@ -257,7 +259,7 @@ void SSRverb::Randomizer::_energy_equalization( float** equalized, long long win
     const long long step_size = floor(win_size / 2);
     const long long n_windows = ceil( float(_ir_length) / float(step_size) ) + 1;
     
-    printf("Equalizing... win_size: %04lli\tstep_size: %04lli\tn_wins: %04lli\n", win_size, step_size, n_windows );
+    SSRVERB_LOG_DEBUG( "Equalizing... win_size: %04lli\tstep_size: %04lli\tn_wins: %04lli", win_size, step_size, n_windows );
     
     // Set result array to 0 because result is summed up later.
     for ( src = 0; src < _n_sources; src++ ) {
@@ -386,7 +388,7 @@ std::vector<long long> SSRverb::Randomizer::_find_peaks( float *data_start, floa
         for ( long long idx = 1; idx < data_end-data_start-1; idx++) {
             if ( data_start[idx] > threshold ) {
                 if ( data_start[idx] > data_start[idx-1] && data_start[idx] > data_start[idx+1] ) {
-                    printf("%f < %f > %f\n", data_start[idx-1], data_start[idx], data_start[idx+1]);
+                    SSRVERB_LOG_DEBUG( "Peak: %f < %f > %f", data_start[idx-1], data_start[idx], data_start[idx+1] );
                     results.push_back( idx );
                 }
             }
@@ -424,7 +426,7 @@ void SSRverb::Randomizer::_remove_direct()
     }
     
     auto peaks = _find_peaks( abs_ir, abs_ir+_ir_length, 0.333f, 1 );
-    printf( "Direct peak detected at: %lli = %.5f ms\n", peaks[0], peaks[0] / float(_sample_rate)  );
+    SSRVERB_LOG_INFO( "Direct peak detected at: %lli = %.5f ms", peaks[0], 1000.f * peaks[0] / float(_sample_rate) );
     
     // Set zeros until direct.
     for ( idx = 0; idx < peaks[0]; idx++ ) {
@@ -450,3 +452,13 @@ long long SSRverb::Randomizer::get_ir_length()
     return _ir_length;
 }
 
+void SSRverb::Randomizer::set_seed( unsigned seed )
+{
+    _seed = seed;
+}
+
+unsigned SSRverb::Randomizer::get_sample_rate()
+{
+    return _sample_rate;
+}
+
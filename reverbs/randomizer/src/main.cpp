@@ -11,9 +11,9 @@
 
 int main( int argc, char** argv )
 {
-    if ( argc != 2 )
+    if ( argc != 2 && argc != 3 )
     {
-        printf( "Usage: %s <PATH TO MONO IR.>\n", argv[0] );
+        printf( "Usage: %s <PATH TO MONO IR.> [PATH TO RECORD SCENE TRACE TO]\n", argv[0] );
         return 1;
     }
 
@@ -25,6 +25,8 @@ int main( int argc, char** argv )
     reverb.clear_scene();
     reverb.setup_rev_sources();
 
+    if ( argc == 3 ) reverb.start_scene_trace( argv[2] );
+    
     reverb.activate();
 
     printf("Hit ENTER to close. ");
@@ -0,0 +1,151 @@
+//
+//  DeadlineWatchdog.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "reverbs/include/DeadlineWatchdog.hpp"
+
+#include <time.h>
+#include <math.h>
+#include <chrono>
+
+SSRverb::DeadlineWatchdog::DeadlineWatchdog( float threshold )
+{
+    _threshold.store( threshold );
+}
+
+SSRverb::DeadlineWatchdog::~DeadlineWatchdog()
+{
+    stop_export();
+}
+
+void SSRverb::DeadlineWatchdog::set_threshold( float threshold )
+{
+    _threshold.store( threshold );
+}
+
+float SSRverb::DeadlineWatchdog::get_threshold()
+{
+    return _threshold.load();
+}
+
+bool SSRverb::DeadlineWatchdog::is_late( double duration_s, double deadline_s )
+{
+    return duration_s > _threshold.load() * deadline_s;
+}
+
+void SSRverb::DeadlineWatchdog::push( const Overrun& record )
+{
+    _n_overruns.fetch_add( 1, std::memory_order_relaxed );
+    
+    unsigned write_pos = _write_pos.load( std::memory_order_relaxed );
+    if ( write_pos - _read_pos.load( std::memory_order_acquire ) >= _capacity ) {
+        _n_dropped.fetch_add( 1, std::memory_order_relaxed );
+        return;
+    }
+    
+    _ring[write_pos % _capacity] = record;
+    _write_pos.store( write_pos + 1, std::memory_order_release );
+}
+
+std::vector< SSRverb::DeadlineWatchdog::Overrun > SSRverb::DeadlineWatchdog::pop_all()
+{
+    std::vector< Overrun > records;
+    
+    unsigned read_pos = _read_pos.load( std::memory_order_relaxed );
+    unsigned write_pos = _write_pos.load( std::memory_order_acquire );
+    
+    for ( ; read_pos != write_pos; read_pos++ ) {
+        records.push_back( _ring[read_pos % _capacity] );
+    }
+    _read_pos.store( read_pos, std::memory_order_release );
+    
+    return records;
+}
+
+void SSRverb::DeadlineWatchdog::start_export( const char* file_path, unsigned interval_ms )
+{
+    stop_export();
+    
+    _exporting = true;
+    std::string path( file_path != nullptr ? file_path : "" );
+    
+    _export_thread = std::thread( [this, path, interval_ms]()
+    {
+        unsigned long n_reported_dropped = _n_dropped.load();
+        
+        std::unique_lock< std::mutex > lock( _export_mtx );
+        while ( _exporting )
+        {
+            _export_cv.wait_for( lock, std::chrono::milliseconds( interval_ms ) );
+            _export( path, n_reported_dropped );
+        }
+    });
+}
+
+void SSRverb::DeadlineWatchdog::stop_export()
+{
+    if ( !_export_thread.joinable() ) return;
+    
+    {
+        std::lock_guard< std::mutex > lock( _export_mtx );
+        _exporting = false;
+    }
+    _export_cv.notify_all();
+    _export_thread.join();
+}
+
+void SSRverb::DeadlineWatchdog::_export( const std::string& path, unsigned long& n_reported_dropped )
+{
+    const std::vector< Overrun > records = pop_all();
+    const unsigned long n_dropped = _n_dropped.load();
+    if ( records.empty() && n_dropped == n_reported_dropped ) return;
+    
+    // Opened per export, so the file can be rotated meanwhile.
+    FILE* file = path.empty() ? stderr : fopen( path.c_str(), "a" );
+    if ( file == nullptr ) return;
+    
+    for ( unsigned idx = 0; idx < records.size(); idx++ ) print( file, records[idx] );
+    if ( n_dropped != n_reported_dropped ) {
+        fprintf( file, "%lu late cycles dropped, the ring was full\n", n_dropped - n_reported_dropped );
+        n_reported_dropped = n_dropped;
+    }
+    
+    if ( file == stderr ) fflush( file );
+    else fclose( file );
+}
+
+unsigned long SSRverb::DeadlineWatchdog::get_n_overruns()
+{
+    return _n_overruns.load();
+}
+
+unsigned long SSRverb::DeadlineWatchdog::get_n_dropped()
+{
+    return _n_dropped.load();
+}
+
+void SSRverb::DeadlineWatchdog::print( FILE* file, const Overrun& record )
+{
+    time_t seconds = time_t( record.time );
+    struct tm local;
+    localtime_r( &seconds, &local );
+    
+    char time_string[32];
+    strftime( time_string, sizeof( time_string ), "%Y-%m-%d %H:%M:%S", &local );
+    
+    fprintf( file, "%s.%03d period=%u deadline=%.0fus duration=%.0fus (%.0f%%) stage=%s"
+            , time_string, int( fmod( record.time, 1.0 ) * 1000.0 )
+            , record.period_frames, record.deadline_us, record.duration_us
+            , 100.f * record.duration_us / record.deadline_us
+            , DspProfiler::get_stage_name( DspProfiler::Stage( record.worst_stage ) ) );
+    
+    if ( record.worst_stage < DspProfiler::N_STAGES ) fprintf( file, "(%.0fus)", record.worst_stage_us );
+    
+    fprintf( file, " ism_update=%s param_swap=%s taps=%u quality=%u\n"
+            , record.ism_update ? "yes" : "no", record.param_swap ? "yes" : "no"
+            , record.n_taps, record.quality_level );
+}
@@ -0,0 +1,206 @@
+//
+//  DspProfiler.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "reverbs/include/DspProfiler.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+const char* PROFILER_STAGE_NAMES[SSRverb::DspProfiler::N_STAGES] = {
+    "cycle",
+    "fdn",
+    "ism_update",
+    "ism_filterbanks",
+    "ism_delays",
+    "mix",
+    "convolution"
+};
+
+SSRverb::DspProfiler::DspProfiler( const char* name )
+: _name( name )
+{
+    for ( unsigned stage = 0; stage < N_STAGES; stage++ ) {
+        for ( unsigned bucket = 0; bucket < n_buckets; bucket++ ) {
+            _counters[stage].histogram[bucket].store( 0 );
+        }
+    }
+    reset_cycle();
+    
+    _start_ticks = now();
+    _start_ns = _monotonic_ns();
+}
+
+SSRverb::DspProfiler::~DspProfiler()
+{
+    stop_export();
+}
+
+uint64_t SSRverb::DspProfiler::_monotonic_ns()
+{
+    timespec time_spec;
+    clock_gettime( CLOCK_MONOTONIC, &time_spec );
+    return uint64_t( time_spec.tv_sec ) * 1000000000ull + time_spec.tv_nsec;
+}
+
+double SSRverb::DspProfiler::_ns_per_tick()
+{
+    // Calibrate the tick rate against the monotonic clock since construction.
+    uint64_t ticks = now() - _start_ticks;
+    uint64_t ns = _monotonic_ns() - _start_ns;
+    
+    if ( ticks == 0 || ns < 1000000 ) return 1.0;
+    return double( ns ) / double( ticks );
+}
+
+void SSRverb::DspProfiler::record( Stage stage, uint64_t ticks )
+{
+    Counters& counters = _counters[stage];
+    _cycle_ticks[stage] += ticks;
+    
+    // Single writer. Plain load and store avoid locked instructions.
+    counters.count.store( counters.count.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    counters.sum.store( counters.sum.load( std::memory_order_relaxed ) + ticks, std::memory_order_relaxed );
+    
+    if ( ticks < counters.min.load( std::memory_order_relaxed ) ) {
+        counters.min.store( ticks, std::memory_order_relaxed );
+    }
+    if ( ticks > counters.max.load( std::memory_order_relaxed ) ) {
+        counters.max.store( ticks, std::memory_order_relaxed );
+    }
+    
+    unsigned bucket = ticks ? 64 - __builtin_clzll( ticks ) : 0;
+    if ( bucket >= n_buckets ) bucket = n_buckets - 1;
+    counters.histogram[bucket].store( counters.histogram[bucket].load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+}
+
+SSRverb::DspProfiler::Stage SSRverb::DspProfiler::get_cycle_worst( double& duration_ns )
+{
+    Stage worst = N_STAGES;
+    uint64_t worst_ticks = 0;
+    
+    // The cycle itself contains all other stages.
+    for ( unsigned stage = CYCLE + 1; stage < N_STAGES; stage++ ) {
+        if ( _cycle_ticks[stage] > worst_ticks ) {
+            worst_ticks = _cycle_ticks[stage];
+            worst = Stage( stage );
+        }
+    }
+    
+    duration_ns = worst_ticks * _ns_per_tick();
+    return worst;
+}
+
+void SSRverb::DspProfiler::reset_cycle()
+{
+    for ( unsigned stage = 0; stage < N_STAGES; stage++ ) _cycle_ticks[stage] = 0;
+}
+
+SSRverb::DspProfiler::StageStats SSRverb::DspProfiler::get_stats( Stage stage )
+{
+    Counters& counters = _counters[stage];
+    const double ns_per_tick = _ns_per_tick();
+    
+    StageStats stats;
+    stats.count = counters.count.load( std::memory_order_relaxed );
+    
+    uint64_t sum = counters.sum.load( std::memory_order_relaxed );
+    stats.mean_ns = stats.count ? sum * ns_per_tick / stats.count : 0.0;
+    stats.min_ns = stats.count ? counters.min.load( std::memory_order_relaxed ) * ns_per_tick : 0.0;
+    stats.max_ns = counters.max.load( std::memory_order_relaxed ) * ns_per_tick;
+    
+    for ( unsigned bucket = 0; bucket < n_buckets; bucket++ ) {
+        stats.histogram[bucket] = counters.histogram[bucket].load( std::memory_order_relaxed );
+        stats.bucket_limits_ns[bucket] = double( 1ull << bucket ) * ns_per_tick;
+    }
+    
+    return stats;
+}
+
+const char* SSRverb::DspProfiler::get_stage_name( Stage stage )
+{
+    return stage < N_STAGES ? PROFILER_STAGE_NAMES[stage] : "unknown";
+}
+
+bool SSRverb::DspProfiler::write_stats( const char* file_path )
+{
+    // Write to a temporary file first, so readers never see partial files.
+    std::string tmp_path = std::string( file_path ) + ".tmp";
+    FILE* file = fopen( tmp_path.c_str(), "w" );
+    if ( file == nullptr ) return false;
+    
+    const size_t path_length = strlen( file_path );
+    const bool json = path_length >= 5 && !strcmp( file_path + path_length - 5, ".json" );
+    
+    StageStats stats;
+    unsigned stage, bucket, last_bucket;
+    
+    if ( json ) fprintf( file, "{\n  \"name\": \"%s\",\n  \"stages\": [\n", _name.c_str() );
+    else fprintf( file, "# %s\n# stage count min_us mean_us max_us\n", _name.c_str() );
+    
+    for ( stage = 0; stage < N_STAGES; stage++ )
+    {
+        stats = get_stats( Stage( stage ) );
+        
+        if ( !json ) {
+            fprintf( file, "%s %llu %.3f %.3f %.3f\n", PROFILER_STAGE_NAMES[stage], (unsigned long long)stats.count
+                    , stats.min_ns / 1000.0, stats.mean_ns / 1000.0, stats.max_ns / 1000.0 );
+            continue;
+        }
+        
+        fprintf( file, "    { \"stage\": \"%s\", \"count\": %llu, \"min_us\": %.3f, \"mean_us\": %.3f, \"max_us\": %.3f, \"histogram\": ["
+                , PROFILER_STAGE_NAMES[stage], (unsigned long long)stats.count
+                , stats.min_ns / 1000.0, stats.mean_ns / 1000.0, stats.max_ns / 1000.0 );
+        
+        // Skip the empty buckets at the end.
+        last_bucket = 0;
+        for ( bucket = 0; bucket < n_buckets; bucket++ ) {
+            if ( stats.histogram[bucket] ) last_bucket = bucket + 1;
+        }
+        for ( bucket = 0; bucket < last_bucket; bucket++ ) {
+            fprintf( file, "%s{ \"below_us\": %.3f, \"count\": %llu }", bucket ? ", " : " "
+                    , stats.bucket_limits_ns[bucket] / 1000.0, (unsigned long long)stats.histogram[bucket] );
+        }
+        fprintf( file, " ] }%s\n", stage + 1 < N_STAGES ? "," : "" );
+    }
+    
+    if ( json ) fprintf( file, "  ]\n}\n" );
+    fclose( file );
+    
+    return rename( tmp_path.c_str(), file_path ) == 0;
+}
+
+void SSRverb::DspProfiler::start_export( const char* file_path, unsigned interval_ms )
+{
+    stop_export();
+    
+    _exporting = true;
+    std::string path( file_path );
+    
+    _export_thread = std::thread( [this, path, interval_ms]()
+    {
+        std::unique_lock< std::mutex > lock( _export_mtx );
+        while ( _exporting )
+        {
+            _export_cv.wait_for( lock, std::chrono::milliseconds( interval_ms ) );
+            write_stats( path.c_str() );
+        }
+    });
+}
+
+void SSRverb::DspProfiler::stop_export()
+{
+    if ( !_export_thread.joinable() ) return;
+    
+    {
+        std::lock_guard< std::mutex > lock( _export_mtx );
+        _exporting = false;
+    }
+    _export_cv.notify_all();
+    _export_thread.join();
+}
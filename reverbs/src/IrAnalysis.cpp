@@ -0,0 +1,181 @@
+//
+//  IrAnalysis.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "IrAnalysis.hpp"
+#include "laproque/include/Filterbank.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+SSRverb::IrAnalysis::IrAnalysis( unsigned sample_rate, std::vector< float > co_freqs, float dynamic_range_db )
+: _sample_rate( sample_rate )
+, _co_freqs( co_freqs )
+, _dynamic_range_db( dynamic_range_db )
+{}
+
+unsigned SSRverb::IrAnalysis::get_n_bands()
+{
+    return unsigned( _co_freqs.size() ) + 1;
+}
+
+void SSRverb::IrAnalysis::split_bands( const float* signal, unsigned long n_samples, std::vector< std::vector< float > >& bands )
+{
+    const unsigned long block_size = 1024;
+    const unsigned n_bands = get_n_bands();
+    
+    laproque::Filterbank filterbank( _co_freqs, _sample_rate );
+    std::vector< float > input( block_size );
+    std::vector< float* > band_ptrs( n_bands );
+    
+    bands.assign( n_bands, std::vector< float >( n_samples + block_size ) );
+    
+    for ( unsigned long start = 0; start < n_samples; start += block_size )
+    {
+        const unsigned long n_frames = std::min( block_size, n_samples - start );
+        std::copy( signal + start, signal + start + n_frames, input.begin() );
+        
+        for ( unsigned band = 0; band < n_bands; band++ ) band_ptrs[band] = bands[band].data() + start;
+        filterbank.process( input.data(), band_ptrs.data(), n_frames );
+    }
+    
+    for ( unsigned band = 0; band < n_bands; band++ ) bands[band].resize( n_samples );
+}
+
+std::vector< float > SSRverb::IrAnalysis::get_t60s( const float* signal, unsigned long n_samples )
+{
+    std::vector< std::vector< float > > bands;
+    std::vector< float > curve;
+    std::vector< float > t60s;
+    
+    split_bands( signal, n_samples, bands );
+    for ( unsigned band = 0; band < bands.size(); band++ ) {
+        decay_curve( bands[band].data(), n_samples, curve );
+        t60s.push_back( estimate_t60( curve, _sample_rate ) );
+    }
+    return t60s;
+}
+
+SSRverb::IrAnalysis::Comparison SSRverb::IrAnalysis::compare( const float* reference, const float* signal, unsigned long n_samples )
+{
+    Comparison result;
+    result.max_abs_error = max_abs_error( reference, signal, n_samples );
+    
+    std::vector< std::vector< float > > ref_bands, sig_bands;
+    std::vector< float > ref_curve, sig_curve;
+    
+    split_bands( reference, n_samples, ref_bands );
+    split_bands( signal, n_samples, sig_bands );
+    
+    for ( unsigned band = 0; band < ref_bands.size(); band++ )
+    {
+        decay_curve( ref_bands[band].data(), n_samples, ref_curve );
+        decay_curve( sig_bands[band].data(), n_samples, sig_curve );
+        
+        // Below the dynamic range the curves mostly show the end of the signal.
+        for ( unsigned long idx = 0; idx < n_samples && ref_curve[idx] > -_dynamic_range_db; idx++ ) {
+            result.max_decay_diff_db = std::max( result.max_decay_diff_db, fabsf( ref_curve[idx] - sig_curve[idx] ) );
+        }
+        
+        const float ref_t60 = estimate_t60( ref_curve, _sample_rate );
+        const float sig_t60 = estimate_t60( sig_curve, _sample_rate );
+        if ( ref_t60 > 0.f ) {
+            result.max_t60_diff = std::max( result.max_t60_diff, fabsf( sig_t60 - ref_t60 ) / ref_t60 );
+        }
+        else if ( sig_t60 > 0.f ) {
+            // The reference is too short to fit a decay. The signal should be too.
+            result.max_t60_diff = std::max( result.max_t60_diff, 1.f );
+        }
+    }
+    
+    return result;
+}
+
+float SSRverb::IrAnalysis::max_abs_error( const float* reference, const float* signal, unsigned long n_samples )
+{
+    float max_error = 0.f;
+    for ( unsigned long idx = 0; idx < n_samples; idx++ ) {
+        max_error = std::max( max_error, fabsf( reference[idx] - signal[idx] ) );
+    }
+    return max_error;
+}
+
+void SSRverb::IrAnalysis::decay_curve( const float* signal, unsigned long n_samples, std::vector< float >& curve_db )
+{
+    curve_db.resize( n_samples );
+    
+    // Accumulate in double, float loses the end of long decays.
+    double energy = 0.0;
+    for ( unsigned long idx = n_samples; idx > 0; idx-- ) {
+        energy += double( signal[idx-1] ) * signal[idx-1];
+        curve_db[idx-1] = float( energy );
+    }
+    
+    const double total = energy > 0.0 ? energy : 1.0;
+    for ( unsigned long idx = 0; idx < n_samples; idx++ ) {
+        curve_db[idx] = curve_db[idx] > 0.f ? float( 10.0 * log10( curve_db[idx] / total ) ) : -300.f;
+    }
+}
+
+float SSRverb::IrAnalysis::estimate_t60( const std::vector< float >& curve_db, unsigned sample_rate )
+{
+    float t60 = _fit_decay( curve_db, -5.f, -35.f, sample_rate );
+    if ( t60 == 0.f ) t60 = _fit_decay( curve_db, -5.f, -25.f, sample_rate );
+    return t60;
+}
+
+void SSRverb::IrAnalysis::echo_density(  const float* signal, unsigned long n_samples, unsigned sample_rate
+                                       , std::vector< float >& density, float window_length, float hop_length )
+{
+    const unsigned long window = std::max( 1ul, (unsigned long)( window_length * sample_rate ) );
+    const unsigned long hop = std::max( 1ul, (unsigned long)( hop_length * sample_rate ) );
+    
+    // Fraction of gaussian samples outside one standard deviation, erfc( 1 / sqrt(2) ).
+    const float gaussian_fraction = .3173f;
+    
+    density.clear();
+    for ( unsigned long start = 0; start + window <= n_samples; start += hop )
+    {
+        double energy = 0.0;
+        for ( unsigned long idx = start; idx < start + window; idx++ ) energy += double( signal[idx] ) * signal[idx];
+        const float deviation = float( sqrt( energy / window ) );
+        
+        unsigned long n_outside = 0;
+        for ( unsigned long idx = start; idx < start + window; idx++ ) {
+            if ( fabsf( signal[idx] ) > deviation ) n_outside++;
+        }
+        density.push_back( float( n_outside ) / window / gaussian_fraction );
+    }
+}
+
+float SSRverb::IrAnalysis::_fit_decay( const std::vector< float >& curve_db, float start_db, float end_db, unsigned sample_rate )
+{
+    unsigned long start = 0;
+    while ( start < curve_db.size() && curve_db[start] > start_db ) start++;
+    
+    unsigned long end = start;
+    while ( end < curve_db.size() && curve_db[end] > end_db ) end++;
+    
+    if ( end >= curve_db.size() || end - start < 2 ) return 0.f;
+    
+    // Least squares line through the curve in the evaluation range.
+    double sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
+    const double n_points = double( end - start );
+    
+    for ( unsigned long idx = start; idx < end; idx++ ) {
+        const double time = double( idx ) / sample_rate;
+        sum_x += time;
+        sum_y += curve_db[idx];
+        sum_xx += time * time;
+        sum_xy += time * curve_db[idx];
+    }
+    
+    const double slope = ( n_points * sum_xy - sum_x * sum_y ) / ( n_points * sum_xx - sum_x * sum_x );
+    if ( slope >= 0.0 ) return 0.f;
+    
+    return float( -60.0 / slope );
+}
@@ -0,0 +1,273 @@
+//
+//  Logger.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "reverbs/include/Logger.hpp"
+
+#include <chrono>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+const char* LOGGER_LEVEL_NAMES[SSRverb::Logger::N_LEVELS] = {
+    "DEBUG", "INFO", "WARNING", "ERROR"
+};
+
+// Time between two checks of the ring by the log thread.
+const unsigned LOGGER_POLL_MS = 10;
+
+SSRverb::Logger& SSRverb::Logger::get()
+{
+    static Logger logger;
+    return logger;
+}
+
+SSRverb::Logger::Logger()
+{
+    _ring = new Record[_capacity];
+    for ( unsigned pos = 0; pos < _capacity; pos++ ) {
+        _ring[pos].sequence.store( pos );
+    }
+    _output.store( stderr );
+    
+    _thread = std::thread( &Logger::_run, this );
+}
+
+SSRverb::Logger::~Logger()
+{
+    _running.store( false );
+    if ( _thread.joinable() ) _thread.join();
+    _drain();
+    
+    delete [] _ring;
+}
+
+void SSRverb::Logger::set_level( Level level )
+{
+    _level.store( level );
+}
+
+SSRverb::Logger::Level SSRverb::Logger::get_level()
+{
+    return Level( _level.load() );
+}
+
+void SSRverb::Logger::set_rate_limit( unsigned max_per_second )
+{
+    _max_per_second.store( max_per_second );
+}
+
+void SSRverb::Logger::set_output( FILE* file )
+{
+    _output.store( file );
+}
+
+void SSRverb::Logger::flush()
+{
+    _drain();
+}
+
+unsigned long SSRverb::Logger::get_n_dropped()
+{
+    return _n_dropped.load();
+}
+
+const char* SSRverb::Logger::get_level_name( Level level )
+{
+    return level < N_LEVELS ? LOGGER_LEVEL_NAMES[level] : "UNKNOWN";
+}
+
+bool SSRverb::Logger::_pass_rate_limit( RateLimit& rate_limit, unsigned& suppressed )
+{
+    const uint64_t now_ms = std::chrono::duration_cast< std::chrono::milliseconds >(
+                                std::chrono::steady_clock::now().time_since_epoch() ).count();
+    
+    // Start a new window every second.
+    uint64_t window_start = rate_limit.window_start.load( std::memory_order_relaxed );
+    if ( now_ms - window_start >= 1000 ) {
+        if ( rate_limit.window_start.compare_exchange_strong( window_start, now_ms ) ) {
+            rate_limit.count.store( 0 );
+        }
+    }
+    
+    if ( rate_limit.count.fetch_add( 1 ) >= _max_per_second.load( std::memory_order_relaxed ) ) {
+        rate_limit.suppressed.fetch_add( 1 );
+        return false;
+    }
+    
+    suppressed = rate_limit.suppressed.exchange( 0 );
+    return true;
+}
+
+SSRverb::Logger::Record* SSRverb::Logger::_claim()
+{
+    unsigned pos = _write_pos.load( std::memory_order_relaxed );
+    
+    // Bounded multi producer queue. A slot is free when its sequence equals the position.
+    while ( true )
+    {
+        Record& record = _ring[pos % _capacity];
+        int diff = int( record.sequence.load( std::memory_order_acquire ) - pos );
+        
+        if ( diff == 0 ) {
+            if ( _write_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+                return &record;
+            }
+        }
+        else if ( diff < 0 ) {
+            _n_dropped.fetch_add( 1, std::memory_order_relaxed );
+            return nullptr;
+        }
+        else {
+            pos = _write_pos.load( std::memory_order_relaxed );
+        }
+    }
+}
+
+void SSRverb::Logger::_publish( Record* record )
+{
+    timespec wall_time;
+    clock_gettime( CLOCK_REALTIME, &wall_time );
+    record->time = wall_time.tv_sec + wall_time.tv_nsec * 1e-9;
+    
+    // Slot was claimed at position sequence, mark it as readable.
+    record->sequence.store( record->sequence.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+void SSRverb::Logger::_store_string( Record& record, Arg& arg, const char* value )
+{
+    arg.type = 's';
+    arg.offset = record.n_chars;
+    
+    if ( value == nullptr ) value = "(null)";
+    
+    // Strings are truncated once the record is full.
+    while ( *value != '\0' && record.n_chars < _max_chars - 1 ) {
+        record.chars[record.n_chars++] = *value++;
+    }
+    if ( record.n_chars < _max_chars ) record.chars[record.n_chars++] = '\0';
+    else record.chars[_max_chars - 1] = '\0';
+}
+
+void SSRverb::Logger::_drain()
+{
+    std::lock_guard< std::mutex > lock( _consumer_mtx );
+    FILE* file = _output.load();
+    bool written = false;
+    
+    while ( true )
+    {
+        Record& record = _ring[_read_pos % _capacity];
+        if ( record.sequence.load( std::memory_order_acquire ) != _read_pos + 1 ) break;
+        
+        _write( record, file );
+        written = true;
+        
+        record.sequence.store( _read_pos + _capacity, std::memory_order_release );
+        _read_pos++;
+    }
+    
+    unsigned long n_dropped = _n_dropped.load();
+    if ( n_dropped != _n_dropped_reported ) {
+        fprintf( file, "%lu log messages dropped\n", n_dropped - _n_dropped_reported );
+        _n_dropped_reported = n_dropped;
+        written = true;
+    }
+    
+    if ( written ) fflush( file );
+}
+
+void SSRverb::Logger::_write( const Record& record, FILE* file )
+{
+    time_t seconds = time_t( record.time );
+    struct tm local;
+    localtime_r( &seconds, &local );
+    
+    char time_string[32];
+    strftime( time_string, sizeof( time_string ), "%Y-%m-%d %H:%M:%S", &local );
+    
+    fprintf( file, "[%s.%03d] %s: ", time_string, int( fmod( record.time, 1.0 ) * 1000.0 )
+            , get_level_name( record.level ) );
+    
+    // Substitute every conversion with its stored argument.
+    const char* format = record.format;
+    char spec[32];
+    unsigned n_used = 0;
+    
+    while ( *format != '\0' )
+    {
+        if ( *format != '%' ) {
+            fputc( *format++, file );
+            continue;
+        }
+        if ( format[1] == '%' ) {
+            fputc( '%', file );
+            format += 2;
+            continue;
+        }
+        
+        // Copy flags, width and precision, skip length modifiers.
+        unsigned spec_length = 0;
+        spec[spec_length++] = *format++;
+        while ( *format != '\0' && strchr( "-+ #0123456789.*", *format ) && spec_length < sizeof( spec ) - 4 ) {
+            spec[spec_length++] = *format++;
+        }
+        while ( *format != '\0' && strchr( "hlLqjzt", *format ) ) format++;
+        
+        const char conversion = *format;
+        if ( conversion == '\0' ) break;
+        format++;
+        
+        if ( n_used == record.n_args ) {
+            fputs( "(missing)", file );
+            continue;
+        }
+        const Arg& arg = record.args[n_used++];
+        
+        if ( strchr( "diouxXc", conversion ) )
+        {
+            spec[spec_length++] = 'l';
+            spec[spec_length++] = 'l';
+            spec[spec_length++] = conversion == 'c' ? 'c' : conversion;
+            spec[spec_length] = '\0';
+            
+            long long value = arg.type == 'd' ? (long long)arg.d : arg.i;
+            if ( conversion == 'c' ) fprintf( file, "%c", int( value ) );
+            else fprintf( file, spec, value );
+        }
+        else if ( strchr( "eEfFgGaA", conversion ) )
+        {
+            spec[spec_length++] = conversion;
+            spec[spec_length] = '\0';
+            
+            double value = arg.type == 'd' ? arg.d : arg.type == 'u' ? double( arg.u ) : double( arg.i );
+            fprintf( file, spec, value );
+        }
+        else if ( conversion == 's' )
+        {
+            spec[spec_length++] = 's';
+            spec[spec_length] = '\0';
+            fprintf( file, spec, arg.type == 's' ? record.chars + arg.offset : "(?)" );
+        }
+        else
+        {
+            fprintf( file, "%p", arg.p );
+        }
+    }
+    
+    if ( record.suppressed ) fprintf( file, " (%u similar messages suppressed)", record.suppressed );
+    fputc( '\n', file );
+}
+
+void SSRverb::Logger::_run()
+{
+    while ( _running.load() )
+    {
+        _drain();
+        std::this_thread::sleep_for( std::chrono::milliseconds( LOGGER_POLL_MS ) );
+    }
+}
@@ -0,0 +1,174 @@
+//
+//  OfflineRenderer.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "reverbs/include/OfflineRenderer.hpp"
+#include "reverbs/include/Denormals.hpp"
+
+#include <sndfile.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+SSRverb::OfflineRenderer::OfflineRenderer( EngineFactory factory, unsigned block_size, float tail_length )
+: _factory( factory ), _block_size( std::max( block_size, 1u ) ), _tail_length( std::max( tail_length, 0.f ) )
+{
+}
+
+SSRverb::OfflineRenderer::Result SSRverb::OfflineRenderer::render( const Job& job )
+{
+    Result result{ false, "", 0, 0, 0.0, 0.0, 0.0 };
+    auto job_start = std::chrono::steady_clock::now();
+    
+    SF_INFO in_format{};
+    SNDFILE* in_file = sf_open( job.input_path.c_str(), SFM_READ, &in_format );
+    if ( in_file == nullptr ) {
+        result.message = std::string( "Could not open input: " ) + sf_strerror( nullptr );
+        return result;
+    }
+    result.sample_rate = in_format.samplerate;
+    
+    std::unique_ptr< ReverbEngine > engine = _factory( in_format.samplerate, _block_size );
+    if ( !engine ) {
+        sf_close( in_file );
+        result.message = "No engine available for " + std::to_string( in_format.samplerate ) + " Hz";
+        return result;
+    }
+    const unsigned n_in = in_format.channels;
+    const unsigned n_out = engine->get_n_outputs();
+    
+    // Keep the container of the input. FLAC does not store floats.
+    SF_INFO out_format{};
+    out_format.samplerate = in_format.samplerate;
+    out_format.channels = n_out;
+    out_format.format = in_format.format & SF_FORMAT_TYPEMASK;
+    out_format.format |= out_format.format == SF_FORMAT_FLAC ? SF_FORMAT_PCM_24 : SF_FORMAT_FLOAT;
+    
+    SNDFILE* out_file = sf_open( job.output_path.c_str(), SFM_WRITE, &out_format );
+    if ( out_file == nullptr ) {
+        sf_close( in_file );
+        result.message = std::string( "Could not open output: " ) + sf_strerror( nullptr );
+        return result;
+    }
+    
+    std::vector< float > in_interleaved( _block_size * n_in );
+    std::vector< float > input( _block_size );
+    std::vector< float > samples( _block_size * n_out );
+    std::vector< float > out_interleaved( _block_size * n_out );
+    std::vector< float* > outputs( n_out );
+    for ( unsigned out = 0; out < n_out; out++ ) {
+        outputs[out] = samples.data() + out * _block_size;
+    }
+    
+    const unsigned long n_tail = (unsigned long)( _tail_length * in_format.samplerate );
+    unsigned long n_tail_done = 0;
+    std::chrono::duration< double > process_time( 0.0 );
+    
+    DenormalGuard denormal_guard;
+    
+    while ( true )
+    {
+        const sf_count_t n_got = sf_readf_float( in_file, in_interleaved.data(), _block_size );
+        
+        // A short read is only the end of the input if libsndfile reports no error.
+        if ( n_got < 0 || sf_error( in_file ) != SF_ERR_NO_ERROR ) {
+            result.message = std::string( "Could not read input: " ) + sf_strerror( in_file );
+            break;
+        }
+        const unsigned n_read = (unsigned)n_got;
+        unsigned n_valid = n_read;
+        
+        // Input ended, continue with silence for the tail.
+        if ( n_read == 0 ) {
+            if ( n_tail_done == n_tail ) break;
+            n_valid = (unsigned)std::min( (unsigned long)_block_size, n_tail - n_tail_done );
+            n_tail_done += n_valid;
+        }
+        
+        // Mix down to mono, pad partial blocks with zeros.
+        for ( unsigned idx = 0; idx < _block_size; idx++ )
+        {
+            float sum = 0.f;
+            if ( idx < n_read ) {
+                for ( unsigned chan = 0; chan < n_in; chan++ ) sum += in_interleaved[idx * n_in + chan];
+            }
+            input[idx] = sum / n_in;
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        engine->process( input.data(), outputs.data(), _block_size );
+        process_time += std::chrono::steady_clock::now() - start;
+        
+        for ( unsigned idx = 0; idx < n_valid; idx++ ) {
+            for ( unsigned out = 0; out < n_out; out++ ) {
+                out_interleaved[idx * n_out + out] = outputs[out][idx];
+            }
+        }
+        if ( sf_writef_float( out_file, out_interleaved.data(), n_valid ) != sf_count_t( n_valid ) ) {
+            result.message = std::string( "Could not write output: " ) + sf_strerror( out_file );
+            break;
+        }
+        result.n_frames += n_valid;
+    }
+    
+    sf_close( in_file );
+    sf_close( out_file );
+    
+    std::chrono::duration< double > wall_time = std::chrono::steady_clock::now() - job_start;
+    result.process_time = process_time.count();
+    result.wall_time = wall_time.count();
+    result.realtime_factor = result.wall_time > 0.0 ? result.n_frames / double( result.sample_rate ) / result.wall_time : 0.0;
+    result.success = result.message.empty();
+    
+    return result;
+}
+
+std::vector< SSRverb::OfflineRenderer::Result > SSRverb::OfflineRenderer::render_all(
+                                                   const std::vector< Job >& jobs
+                                                 , unsigned n_threads
+                                                 , std::function< void( unsigned, const Result& ) > on_done
+                                                 )
+{
+    std::vector< Result > results( jobs.size() );
+    
+    if ( n_threads == 0 ) n_threads = std::max( std::thread::hardware_concurrency(), 1u );
+    n_threads = std::min( n_threads, (unsigned)jobs.size() );
+    
+    // Every worker takes the next job until none are left.
+    std::atomic< unsigned > next_job{ 0 };
+    auto worker = [&]() {
+        unsigned job;
+        while ( ( job = next_job.fetch_add( 1 ) ) < jobs.size() ) {
+            results[job] = render( jobs[job] );
+            if ( on_done ) on_done( job, results[job] );
+        }
+    };
+    
+    std::vector< std::thread > threads;
+    for ( unsigned thr = 0; thr < n_threads; thr++ ) {
+        threads.push_back( std::thread( worker ) );
+    }
+    for ( unsigned thr = 0; thr < threads.size(); thr++ ) {
+        threads[thr].join();
+    }
+    
+    return results;
+}
+
+std::string SSRverb::OfflineRenderer::make_output_path( const std::string& input_path, const std::string& out_dir )
+{
+    size_t name_start = input_path.find_last_of( '/' );
+    name_start = name_start == std::string::npos ? 0 : name_start + 1;
+    
+    size_t ext_start = input_path.find_last_of( '.' );
+    if ( ext_start == std::string::npos || ext_start < name_start ) ext_start = input_path.size();
+    
+    std::string dir = out_dir.empty() ? input_path.substr( 0, name_start ) : out_dir + "/";
+    
+    return dir + input_path.substr( name_start, ext_start - name_start ) + "_reverb" + input_path.substr( ext_start );
+}
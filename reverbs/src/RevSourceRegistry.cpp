@@ -0,0 +1,55 @@
+//
+//  RevSourceRegistry.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "RevSourceRegistry.hpp"
+
+constexpr const char* SSRverb::RevSourceRegistry::prefix;
+
+std::vector< unsigned short > SSRverb::RevSourceRegistry::get_ids()
+{
+    std::lock_guard< std::mutex > lock( _mtx );
+    return _ids;
+}
+
+bool SSRverb::RevSourceRegistry::contains( unsigned short id )
+{
+    std::lock_guard< std::mutex > lock( _mtx );
+    return _index.count( id ) != 0;
+}
+
+unsigned SSRverb::RevSourceRegistry::get_n_sources()
+{
+    std::lock_guard< std::mutex > lock( _mtx );
+    return unsigned( _ids.size() );
+}
+
+std::vector< unsigned short > SSRverb::RevSourceRegistry::take_all()
+{
+    std::vector< unsigned short > ids;
+    std::lock_guard< std::mutex > lock( _mtx );
+    ids.swap( _ids );
+    _index.clear();
+    return ids;
+}
+
+void SSRverb::RevSourceRegistry::_add( unsigned short id )
+{
+    if ( _index.emplace( id, unsigned( _ids.size() ) ).second ) _ids.push_back( id );
+}
+
+void SSRverb::RevSourceRegistry::_remove( unsigned short id )
+{
+    std::unordered_map< unsigned short, unsigned >::iterator rev = _index.find( id );
+    if ( rev == _index.end() ) return;
+    
+    // Keep the order of the remaining reverb sources, they are placed by index.
+    const unsigned position = rev->second;
+    _index.erase( rev );
+    _ids.erase( _ids.begin() + position );
+    for ( unsigned later = position; later < _ids.size(); later++ ) _index[_ids[later]] = later;
+}
@@ -7,30 +7,280 @@
 //
 
 #include "reverbs/include/ReverbBase.hpp"
+#include "reverbs/include/Denormals.hpp"
+#include "reverbs/include/Logger.hpp"
+#include <cstring>
+#include <chrono>
+#include <time.h>
+#include <math.h>
 
 SSRverb::ReverbBase::ReverbBase(  const char* name
                  , unsigned n_rev_sources
+                 , unsigned block_size
                  )
-: JackPlugin( name, 1, n_rev_sources )
+: JackPlugin( name, _n_inputs, n_rev_sources ),
+  _internal_block_size( block_size ),
+  _profiler( name )
 {
     _n_rev_sources = n_rev_sources;
-    set_update_callback( ReverbBase::track_rev_sources, this );
+    
+    // Start the log thread here rather than from a time critical thread.
+    Logger::get();
+    
+    // Late cycles are written out as they come, so the ring never stays full.
+    _watchdog.start_export();
+    
+    set_update_callback( ReverbBase::_on_scene_update, this );
     set_reference_callback( SSRverb::ReverbBase::track_reference, this );
+    
+    // Allocate re-blocking buffers once, they only depend on the internal block size.
+    _in_fifo = new float*[_n_inputs];
+    _in_ptrs = new float*[_n_inputs];
+    for ( unsigned in = 0; in < _n_inputs; in++ ) {
+        _in_fifo[in] = new float[_internal_block_size];
+    }
+    
+    _out_fifo = new float*[_n_rev_sources];
+    _out_ptrs = new float*[_n_rev_sources];
+    for ( unsigned out = 0; out < _n_rev_sources; out++ ) {
+        _out_fifo[out] = new float[_internal_block_size];
+    }
+    
+    _setup_reblocking( _block_size );
+    
+    jack_set_buffer_size_callback( _jack_client, ReverbBase::_buffer_size_callback, this );
+    jack_set_latency_callback( _jack_client, ReverbBase::_latency_callback, this );
+    
+    _placement_thread = std::thread( &ReverbBase::_placement_loop, this );
+}
+
+void SSRverb::ReverbBase::render_audio(
+                          laproque::nframes_t n_frames
+                          , laproque::sample_t **in_buffers
+                          , laproque::sample_t **out_buffers
+                          )
+{
+    DenormalGuard denormal_guard;
+    
+    auto start = std::chrono::steady_clock::now();
+    {
+        SSRVERB_PROFILE_SCOPE( &_profiler, DspProfiler::CYCLE );
+        _render_blocks( n_frames, in_buffers, out_buffers );
+    }
+    double duration = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    double deadline = double( n_frames ) / _sample_rate;
+    
+    if ( !_watchdog.is_late( duration, deadline ) ) {
+        _end_cycle( nullptr );
+        _profiler.reset_cycle();
+        return;
+    }
+    
+    timespec wall_time;
+    clock_gettime( CLOCK_REALTIME, &wall_time );
+    
+    DeadlineWatchdog::Overrun record{};
+    record.time = wall_time.tv_sec + wall_time.tv_nsec * 1e-9;
+    record.period_frames = n_frames;
+    record.deadline_us = deadline * 1e6;
+    record.duration_us = duration * 1e6;
+    
+    double stage_ns;
+    record.worst_stage = _profiler.get_cycle_worst( stage_ns );
+    record.worst_stage_us = stage_ns * 1e-3;
+    
+    _end_cycle( &record );
+    _profiler.reset_cycle();
+    _watchdog.push( record );
+}
+
+void SSRverb::ReverbBase::_render_blocks(
+                          laproque::nframes_t n_frames
+                          , laproque::sample_t **in_buffers
+                          , laproque::sample_t **out_buffers
+                          )
+{
+    unsigned in, out, n_done, n_ready;
+    
+    // Period is a multiple of the internal block size. Process in place.
+    if ( !_buffered.load() )
+    {
+        for ( n_done = 0; n_done + _internal_block_size <= n_frames; n_done += _internal_block_size )
+        {
+            for ( in = 0; in < _n_inputs; in++ ) _in_ptrs[in] = in_buffers[in] + n_done;
+            for ( out = 0; out < _n_rev_sources; out++ ) _out_ptrs[out] = out_buffers[out] + n_done;
+            
+            process_block( _internal_block_size, _in_ptrs, _out_ptrs );
+        }
+        return;
+    }
+    
+    // Otherwise pass samples through FIFOs, delayed by one internal block.
+    n_done = 0;
+    while ( n_done < n_frames )
+    {
+        n_ready = std::min( _internal_block_size - _fifo_pos, n_frames - n_done );
+        
+        for ( in = 0; in < _n_inputs; in++ ) {
+            memcpy( _in_fifo[in] + _fifo_pos, in_buffers[in] + n_done, n_ready * sizeof(float) );
+        }
+        for ( out = 0; out < _n_rev_sources; out++ ) {
+            memcpy( out_buffers[out] + n_done, _out_fifo[out] + _fifo_pos, n_ready * sizeof(float) );
+        }
+        
+        _fifo_pos += n_ready;
+        n_done += n_ready;
+        
+        if ( _fifo_pos == _internal_block_size ) {
+            process_block( _internal_block_size, _in_fifo, _out_fifo );
+            _fifo_pos = 0;
+        }
+    }
+}
+
+void SSRverb::ReverbBase::process_block(
+                          unsigned n_frames
+                          , laproque::sample_t **in_buffers
+                          , laproque::sample_t **out_buffers
+                          )
+{
+    if ( _engine != nullptr ) {
+        _engine->process( in_buffers[0], out_buffers, n_frames );
+        return;
+    }
+    
+    for ( unsigned out = 0; out < _n_rev_sources; out++ ) {
+        memset( out_buffers[out], 0, n_frames * sizeof(float) );
+    }
+}
+
+void SSRverb::ReverbBase::_set_engine( ReverbEngine* engine )
+{
+    _engine = engine;
+    if ( _engine != nullptr ) _engine->prepare( _sample_rate, _internal_block_size );
+}
+
+SSRverb::ReverbEngine* SSRverb::ReverbBase::get_engine()
+{
+    return _engine;
+}
+
+void SSRverb::ReverbBase::_setup_reblocking( unsigned period_size )
+{
+    bool buffered = period_size % _internal_block_size != 0;
+    
+    // Start from silence in the FIFOs.
+    for ( unsigned in = 0; in < _n_inputs; in++ ) {
+        memset( _in_fifo[in], 0, _internal_block_size * sizeof(float) );
+    }
+    for ( unsigned out = 0; out < _n_rev_sources; out++ ) {
+        memset( _out_fifo[out], 0, _internal_block_size * sizeof(float) );
+    }
+    _fifo_pos = 0;
+    
+    _buffered.store( buffered );
+    _latency.store( buffered ? _internal_block_size : 0 );
+}
+
+int SSRverb::ReverbBase::_buffer_size_callback( jack_nframes_t n_frames, void* arg )
+{
+    SSRverb::ReverbBase* rev_base = (SSRverb::ReverbBase*)arg;
+    
+    rev_base->_setup_reblocking( n_frames );
+    jack_recompute_total_latencies( rev_base->_jack_client );
+    
+    return 0;
+}
+
+void SSRverb::ReverbBase::_latency_callback( jack_latency_callback_mode_t mode, void* arg )
+{
+    SSRverb::ReverbBase* rev_base = (SSRverb::ReverbBase*)arg;
+    
+    const char* client_name = jack_get_client_name( rev_base->_jack_client );
+    char port_name[100];
+    jack_latency_range_t range{ 0, 0 };
+    jack_port_t* port;
+    
+    // Latency of the input side, forwarded to the other side plus own latency.
+    sprintf( port_name, "%s:in_1", client_name );
+    jack_port_t* in_port = jack_port_by_name( rev_base->_jack_client, port_name );
+    
+    if ( mode == JackCaptureLatency )
+    {
+        if ( in_port != nullptr ) jack_port_get_latency_range( in_port, mode, &range );
+        range.min += rev_base->_latency.load();
+        range.max += rev_base->_latency.load();
+        
+        for ( unsigned prt = 1; prt <= rev_base->_n_rev_sources; prt++ ) {
+            sprintf( port_name, "%s:out_%i", client_name, prt );
+            port = jack_port_by_name( rev_base->_jack_client, port_name );
+            if ( port != nullptr ) jack_port_set_latency_range( port, mode, &range );
+        }
+    }
+    else
+    {
+        jack_latency_range_t out_range;
+        range.min = ~jack_nframes_t(0);
+        
+        for ( unsigned prt = 1; prt <= rev_base->_n_rev_sources; prt++ ) {
+            sprintf( port_name, "%s:out_%i", client_name, prt );
+            port = jack_port_by_name( rev_base->_jack_client, port_name );
+            if ( port == nullptr ) continue;
+            
+            jack_port_get_latency_range( port, mode, &out_range );
+            range.min = std::min( range.min, out_range.min );
+            range.max = std::max( range.max, out_range.max );
+        }
+        if ( range.min > range.max ) range.min = range.max;
+        
+        range.min += rev_base->_latency.load();
+        range.max += rev_base->_latency.load();
+        
+        if ( in_port != nullptr ) jack_port_set_latency_range( in_port, mode, &range );
+    }
+}
+
+unsigned SSRverb::ReverbBase::get_internal_block_size()
+{
+    return _internal_block_size;
+}
+
+unsigned SSRverb::ReverbBase::get_latency()
+{
+    return _latency.load();
+}
+
+SSRverb::DspProfiler* SSRverb::ReverbBase::get_profiler()
+{
+    return &_profiler;
+}
+
+SSRverb::DeadlineWatchdog* SSRverb::ReverbBase::get_watchdog()
+{
+    return &_watchdog;
+}
+
+void SSRverb::ReverbBase::set_watchdog_threshold( float threshold )
+{
+    _watchdog.set_threshold( threshold );
 }
 
 void SSRverb::ReverbBase::setup_rev_sources()
 {
     _mtx.lock();
     if ( is_connected() ) {
-        move_reference( _rec_pos[0], _rec_pos[1] );
+        const Vector3D rec_pos = _get_rec_pos();
+        const float rotation = _get_rec_orientation();
+        move_reference( rec_pos[0], rec_pos[1] );
         
+        const float radius = _radius.load();
         float x_pos, y_pos;
         char src_name[10];
         for ( unsigned rev = 0; rev < _n_rev_sources; rev++ )
         {
             sprintf( src_name, "rev_%i", rev+1 );
-            x_pos = _rec_pos[0] + _radius * cosf( 2.f*M_PI/_n_rev_sources * rev );
-            y_pos = _rec_pos[1] + _radius * sinf( 2.f*M_PI/_n_rev_sources * rev );
+            x_pos = rec_pos[0] + radius * cosf( 2.f*M_PI/_n_rev_sources * rev + rotation );
+            y_pos = rec_pos[1] + radius * sinf( 2.f*M_PI/_n_rev_sources * rev + rotation );
             
             
             //printf("Setting up reveb source %i at (%f, %f)\n", rev+1, x_pos, y_pos);
@@ -41,92 +291,242 @@ void SSRverb::ReverbBase::setup_rev_sources()
     _mtx.unlock();
 }
 
-void SSRverb::ReverbBase::_update_rev_sources()
+bool SSRverb::ReverbBase::_update_rev_sources( Vector3D center, float rotation )
 {
-    _mtx.lock();
-    if ( is_connected() && _rev_srcs_set.load() ) {
-        float x_pos, y_pos;
-        char src_name[10];
-        printf("Updating reverb sources to reference = (%f, %f)\n", _rec_pos[0], _rec_pos[1]);
-        for ( unsigned rev = 0; rev < _rev_source_ids.size(); rev++ )
-        //for ( unsigned rev = 0; rev < _n_rev_sources; rev++ )
-        {
-            sprintf( src_name, "rev_%i", rev );
-            x_pos = _rec_pos[0] + _radius * cosf( 2.f*M_PI/_n_rev_sources * rev );
-            y_pos = _rec_pos[1] + _radius * sinf( 2.f*M_PI/_n_rev_sources * rev );
-            
-            move_source( _rev_source_ids[rev], x_pos, y_pos );
-            //move_source( rev+1, x_pos, y_pos );
-            printf("Moving reveb source %i to (%f, %f)\n", rev+1, x_pos, y_pos);
+    if ( !is_connected() || !_rev_srcs_set.load() ) return false;
+    
+    std::vector< unsigned short > ids = _rev_registry.get_ids();
+    
+    const float radius = _radius.load();
+    SSRVERB_LOG_DEBUG( "Moving %u reverb sources around (%f, %f)", unsigned( ids.size() ), center[0], center[1] );
+    
+    // All moves are sent back to back, without holding the lock.
+    for ( unsigned rev = 0; rev < ids.size(); rev++ )
+    {
+        move_source(  ids[rev]
+                    , center[0] + radius * cosf( 2.f*M_PI/_n_rev_sources * rev + rotation )
+                    , center[1] + radius * sinf( 2.f*M_PI/_n_rev_sources * rev + rotation )
+                    );
+    }
+    return true;
+}
+
+void SSRverb::ReverbBase::_request_placement( Vector3D center, float rotation, bool forced )
+{
+    std::lock_guard< std::mutex > lock( _placement_mtx );
+    _placement_target = center;
+    _placement_rotation = rotation;
+    _placement_forced |= forced;
+    _placement_pending = true;
+    _placement_cv.notify_one();
+}
+
+void SSRverb::ReverbBase::_placement_loop()
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point last_placement = clock::now() - std::chrono::hours( 1 );
+    Vector3D placed( NAN, NAN, NAN );
+    float placed_rotation = NAN;
+    
+    std::unique_lock< std::mutex > lock( _placement_mtx );
+    
+    while ( true )
+    {
+        _placement_cv.wait( lock, [this]() { return _placement_pending || _placement_quit; } );
+        if ( _placement_quit ) return;
+        
+        // Wait out the minimum interval. Requests arriving meanwhile replace the target.
+        const float rate = std::max( _placement_rate.load(), 1e-3f );
+        const clock::time_point next = last_placement + std::chrono::duration_cast< clock::duration >( std::chrono::duration< float >( 1.f / rate ) );
+        if ( _placement_cv.wait_until( lock, next, [this]() { return _placement_quit; } ) ) return;
+        
+        const Vector3D target = _placement_target;
+        const float rotation = _placement_rotation;
+        const bool forced = _placement_forced;
+        _placement_pending = false;
+        _placement_forced = false;
+        lock.unlock();
+        
+        // Distance to a NAN position is NAN, so the first placement always happens.
+        const bool moved = forced || rotation != placed_rotation || !( placed.distance_to( target ) < _placement_dead_band.load() );
+        if ( moved && _update_rev_sources( target, rotation ) ) {
+            placed = target;
+            placed_rotation = rotation;
+            last_placement = clock::now();
+            _n_placements++;
         }
+        
+        lock.lock();
     }
-    _mtx.unlock();
+}
+
+void SSRverb::ReverbBase::_stop_placement()
+{
+    {
+        std::lock_guard< std::mutex > lock( _placement_mtx );
+        _placement_quit = true;
+    }
+    _placement_cv.notify_one();
+    if ( _placement_thread.joinable() ) _placement_thread.join();
+}
+
+void SSRverb::ReverbBase::set_placement_dead_band( float dead_band )
+{
+    _placement_dead_band.store( dead_band );
+}
+
+void SSRverb::ReverbBase::set_placement_rate( float max_rate )
+{
+    _placement_rate.store( max_rate );
+}
+
+unsigned long SSRverb::ReverbBase::get_n_placements()
+{
+    return _n_placements.load();
 }
 
 void SSRverb::ReverbBase::end()
 {
     deactivate();
+    _stop_placement();
     stop();
+    _scene_trace.stop();
+}
+
+bool SSRverb::ReverbBase::start_scene_trace( const char* path )
+{
+    const bool success = _scene_trace.start( path );
+    if ( !success ) SSRVERB_LOG_ERROR( "Could not open scene trace %s", path );
+    return success;
+}
+
+void SSRverb::ReverbBase::stop_scene_trace()
+{
+    _scene_trace.stop();
+}
+
+void SSRverb::ReverbBase::_set_scene_update( SceneUpdate callback, void* data )
+{
+    _scene_update = callback;
+    _scene_update_data = data;
+}
+
+void SSRverb::ReverbBase::_on_scene_update( ssrface::Scene* scene_ptr, void* io_data )
+{
+    SSRverb::ReverbBase* rev_base = (SSRverb::ReverbBase*)io_data;
+    
+    rev_base->_scene_trace.record_update( scene_ptr );
+    
+    rev_base->_scene_diff.update( scene_ptr );
+    const SceneDiff& diff = rev_base->_scene_diff;
+    if ( diff.is_empty() ) return;
+    
+    rev_base->track_rev_sources( scene_ptr, diff );
+    
+    if ( rev_base->_scene_update ) rev_base->_scene_update( scene_ptr, diff, rev_base->_scene_update_data );
+}
+
+void SSRverb::ReverbBase::track_rev_sources( ssrface::Scene* scene_ptr, const SceneDiff& diff )
+{
+    _rev_registry.track( scene_ptr, diff );
 }
 
 void SSRverb::ReverbBase::remove_rev_sources()
 {
     if ( is_connected() && _rev_srcs_set.load() ) {
-        for ( unsigned rev = 0; rev < _rev_source_ids.size(); rev++) {
-        //for ( unsigned rev = 0; rev < _n_rev_sources; rev++ ) {
-            delete_source( _rev_source_ids[rev] );
-            //delete_source( rev+1 );
-            printf("Deleting reverb source %i\n", rev+1);
-        }
+        // The registry is emptied under its lock, the sources are deleted without it.
         _rev_srcs_set.store( false );
-        _rev_source_ids.clear();
+        std::vector< unsigned short > ids = _rev_registry.take_all();
+        for ( unsigned rev = 0; rev < ids.size(); rev++) {
+            delete_source( ids[rev] );
+            SSRVERB_LOG_DEBUG( "Deleting reverb source %i", rev+1 );
+        }
     }
 }
-
+    
 void SSRverb::ReverbBase::set_rec_pos( Vector3D new_pos )
 {
-    _rec_pos = new_pos;
+    _positions.modify( [&new_pos]( Positions& positions ) {
+        for ( int dim = 0; dim < 3; dim++ ) positions.receiver[dim] = new_pos[dim];
+    } );
     move_reference( new_pos[0], new_pos[1] );
 }
-
+    
+void SSRverb::ReverbBase::set_rec_orientation( float azimuth )
+{
+    _positions.modify( [azimuth]( Positions& positions ) {
+        positions.receiver_azimuth = azimuth;
+    } );
+    if ( _rev_srcs_set.load() ) _request_placement( _get_rec_pos(), azimuth, false );
+}
+    
 void SSRverb::ReverbBase::set_src_pos( Vector3D new_pos )
 {
-    _src_pos = new_pos;
+    _positions.modify( [&new_pos]( Positions& positions ) {
+        for ( int dim = 0; dim < 3; dim++ ) positions.source[dim] = new_pos[dim];
+    } );
 }
-
+    
 void SSRverb::ReverbBase::set_tracked_source( unsigned source_id )
 {
-    _tracked_source_id = source_id;
+    _tracked_source_id.store( source_id );
 }
-
+    
+SSRverb::Vector3D SSRverb::ReverbBase::_get_rec_pos()
+{
+    const Positions positions = _positions.load();
+    return Vector3D( positions.receiver[0], positions.receiver[1], positions.receiver[2] );
+}
+    
+SSRverb::Vector3D SSRverb::ReverbBase::_get_src_pos()
+{
+    const Positions positions = _positions.load();
+    return Vector3D( positions.source[0], positions.source[1], positions.source[2] );
+}
+    
+float SSRverb::ReverbBase::_get_rec_orientation()
+{
+    return _positions.load().receiver_azimuth;
+}
+    
 void SSRverb::ReverbBase::set_radius( float new_radius )
 {
-    _radius = new_radius;
-    _update_rev_sources();
+    _radius.store( new_radius );
+    _request_placement( _get_rec_pos(), _get_rec_orientation(), true );
 }
-
+    
 std::vector< unsigned short > SSRverb::ReverbBase::get_rev_ids()
 {
-    return _rev_source_ids;
+    // Changed on the SceneManager thread by track_rev_sources().
+    return _rev_registry.get_ids();
 }
-
+    
 bool SSRverb::ReverbBase::is_rev_source( unsigned short id )
 {
-    if ( std::find( _rev_source_ids.begin(), _rev_source_ids.end(), id ) != _rev_source_ids.end() ) {
-        return true;
-    }
-    else return false;
+    return _rev_registry.contains( id );
 }
-
+    
 SSRverb::ReverbBase::~ReverbBase()
 {
     //printf("ReverbBase destructor called..");
+    _stop_placement();
     remove_rev_sources();
     stop();
     disconnect();
     deactivate();
+        
+    for ( unsigned in = 0; in < _n_inputs; in++ ) {
+        delete [] _in_fifo[in];
+    }
+    for ( unsigned out = 0; out < _n_rev_sources; out++ ) {
+        delete [] _out_fifo[out];
+    }
+    delete [] _in_fifo;
+    delete [] _out_fifo;
+    delete [] _in_ptrs;
+    delete [] _out_ptrs;
 }
-
+    
 void SSRverb::ReverbBase::connect_to_ssr()
 {
     if ( is_active() && _rev_srcs_set.load() )
@@ -138,8 +538,9 @@ void SSRverb::ReverbBase::connect_to_ssr()
             sprintf(out_port_name, "%s:out_%i", jack_get_client_name(_jack_client), prt );
             sprintf(in_port_name, "BinauralRenderer:in_%i", prt+1 );
             success = jack_connect( _jack_client, out_port_name, in_port_name);
-            printf("Connecting: %s <-> %s\t%s\n", out_port_name, in_port_name, success == 0 ? "Succeeded" : "Failed" );
-            
+            if ( success == 0 ) SSRVERB_LOG_INFO( "Connected: %s <-> %s", out_port_name, in_port_name );
+            else SSRVERB_LOG_WARNING( "Connecting %s <-> %s failed", out_port_name, in_port_name );
+                
     //        sprintf(in_port_name, "WFS-Renderer:in_%i", prt+1 );
     //        jack_connect( _jack_client, out_port_name, in_port_name);
     //        sprintf(in_port_name, "AAP-Renderer:in_%i", prt+1 );
@@ -149,3 +550,4 @@ void SSRverb::ReverbBase::connect_to_ssr()
         }
     }
 }
+    
\ No newline at end of file
@@ -0,0 +1,55 @@
+//
+//  SceneDiff.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "SceneDiff.hpp"
+
+const std::vector< SSRverb::SceneDiff::Change >& SSRverb::SceneDiff::get_added() const
+{
+    return _added;
+}
+
+const std::vector< SSRverb::SceneDiff::Change >& SSRverb::SceneDiff::get_moved() const
+{
+    return _moved;
+}
+
+const std::vector< unsigned short >& SSRverb::SceneDiff::get_removed() const
+{
+    return _removed;
+}
+
+bool SSRverb::SceneDiff::is_empty() const
+{
+    return _added.empty() && _moved.empty() && _removed.empty();
+}
+
+const SSRverb::SceneDiff::Change* SSRverb::SceneDiff::find( unsigned short id ) const
+{
+    std::unordered_map< unsigned short, Entry >::const_iterator entry = _entries.find( id );
+    return entry == _entries.end() ? nullptr : &entry->second.position;
+}
+
+const SSRverb::SceneDiff::Change* SSRverb::SceneDiff::find_changed( unsigned short id ) const
+{
+    std::unordered_map< unsigned short, Entry >::const_iterator entry = _entries.find( id );
+    if ( entry == _entries.end() || entry->second.changed != _generation ) return nullptr;
+    return &entry->second.position;
+}
+
+unsigned SSRverb::SceneDiff::get_n_sources() const
+{
+    return unsigned( _entries.size() );
+}
+
+void SSRverb::SceneDiff::clear()
+{
+    _entries.clear();
+    _added.clear();
+    _moved.clear();
+    _removed.clear();
+}
@@ -0,0 +1,315 @@
+//
+//  SceneTrace.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "SceneTrace.hpp"
+
+#include <cstring>
+#include <thread>
+#include <algorithm>
+
+const char SCENE_TRACE_MAGIC[4]{ 'S', 'S', 'R', 'T' };
+
+std::vector< unsigned short > SSRverb::TraceScene::get_source_ids()
+{
+    std::vector< unsigned short > ids;
+    for ( auto& source : _sources ) ids.push_back( source.first );
+    return ids;
+}
+
+ssrface::Source* SSRverb::TraceScene::get_source( unsigned short id )
+{
+    std::map< unsigned short, ssrface::Source >::iterator source = _sources.find( id );
+    return source == _sources.end() ? nullptr : &source->second;
+}
+
+ssrface::Source* SSRverb::TraceScene::get_reference()
+{
+    return &_reference;
+}
+
+void SSRverb::TraceScene::set_source( unsigned short id, float x, float y )
+{
+    ssrface::Source& source = _sources[id];
+    source.id = id;
+    source.x = x;
+    source.y = y;
+}
+
+void SSRverb::TraceScene::set_name( unsigned short id, const std::string& name )
+{
+    _sources[id].id = id;
+    _sources[id].name = name;
+}
+
+void SSRverb::TraceScene::remove_source( unsigned short id )
+{
+    _sources.erase( id );
+}
+
+void SSRverb::TraceScene::set_reference( float x, float y )
+{
+    _reference.x = x;
+    _reference.y = y;
+}
+
+SSRverb::SceneTraceRecorder::~SceneTraceRecorder()
+{
+    stop();
+}
+
+bool SSRverb::SceneTraceRecorder::start( const char* path )
+{
+    stop();
+    
+    std::lock_guard< std::mutex > lock( _mtx );
+    
+    _file = fopen( path, "wb" );
+    if ( !_file ) return false;
+    
+    fwrite( SCENE_TRACE_MAGIC, 1, sizeof(SCENE_TRACE_MAGIC), _file );
+    _write( VERSION );
+    
+    _last_time = std::chrono::steady_clock::now();
+    _positions.clear();
+    _n_events = 0;
+    return true;
+}
+
+void SSRverb::SceneTraceRecorder::stop()
+{
+    std::lock_guard< std::mutex > lock( _mtx );
+    
+    if ( _file ) {
+        fclose( _file );
+        _file = nullptr;
+    }
+}
+
+bool SSRverb::SceneTraceRecorder::is_recording()
+{
+    std::lock_guard< std::mutex > lock( _mtx );
+    return _file != nullptr;
+}
+
+unsigned long SSRverb::SceneTraceRecorder::get_n_events()
+{
+    std::lock_guard< std::mutex > lock( _mtx );
+    return _n_events;
+}
+
+uint32_t SSRverb::SceneTraceRecorder::_time_delta()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const long long delta = std::chrono::duration_cast< std::chrono::microseconds >( now - _last_time ).count();
+    _last_time = now;
+    
+    return uint32_t( std::min( delta, (long long)UINT32_MAX ) );
+}
+
+void SSRverb::SceneTraceRecorder::record_update( ssrface::Scene* scene )
+{
+    std::lock_guard< std::mutex > lock( _mtx );
+    if ( !_file ) return;
+    
+    std::vector< unsigned short > ids = scene->get_source_ids();
+    std::map< unsigned short, std::pair< float, float > > positions;
+    std::vector< ssrface::Source* > moved;
+    
+    for ( unsigned idx = 0; idx < ids.size(); idx++ )
+    {
+        ssrface::Source* source = scene->get_source( ids[idx] );
+        if ( source == nullptr ) continue;
+        
+        const std::pair< float, float > position( source->x, source->y );
+        std::map< unsigned short, std::pair< float, float > >::iterator known = _positions.find( ids[idx] );
+        
+        if ( known == _positions.end() )
+        {
+            const uint8_t length = uint8_t( std::min( source->name.size(), size_t(255) ) );
+            _write( uint8_t( NAME ) );
+            _write( uint16_t( ids[idx] ) );
+            _write( length );
+            fwrite( source->name.data(), 1, length, _file );
+        }
+        
+        if ( known == _positions.end() || known->second != position ) moved.push_back( source );
+        positions[ids[idx]] = position;
+    }
+    
+    for ( auto& known : _positions ) {
+        if ( positions.count( known.first ) ) continue;
+        _write( uint8_t( REMOVE ) );
+        _write( uint16_t( known.first ) );
+    }
+    _positions.swap( positions );
+    
+    _write( uint8_t( UPDATE ) );
+    _write( _time_delta() );
+    _write( uint16_t( moved.size() ) );
+    for ( unsigned idx = 0; idx < moved.size(); idx++ ) {
+        _write( uint16_t( moved[idx]->id ) );
+        _write( moved[idx]->x );
+        _write( moved[idx]->y );
+    }
+    
+    _n_events++;
+}
+
+void SSRverb::SceneTraceRecorder::record_reference( ssrface::Scene* scene )
+{
+    std::lock_guard< std::mutex > lock( _mtx );
+    if ( !_file ) return;
+    
+    ssrface::Source* reference = scene->get_reference();
+    if ( reference == nullptr ) return;
+    
+    _write( uint8_t( REFERENCE ) );
+    _write( _time_delta() );
+    _write( reference->x );
+    _write( reference->y );
+    
+    _n_events++;
+}
+
+bool SSRverb::SceneTracePlayer::load( const char* path )
+{
+    _events.clear();
+    rewind();
+    
+    FILE* file = fopen( path, "rb" );
+    if ( !file ) return false;
+    
+    char magic[sizeof(SCENE_TRACE_MAGIC)];
+    uint16_t version = 0;
+    if (   fread( magic, 1, sizeof(magic), file ) != sizeof(magic) || memcmp( magic, SCENE_TRACE_MAGIC, sizeof(magic) )
+        || !_read( file, version ) || version != SceneTraceRecorder::VERSION )
+    {
+        fclose( file );
+        return false;
+    }
+    
+    std::map< unsigned short, std::string > names;
+    std::vector< unsigned short > removed;
+    double time = 0.0;
+    bool valid = true;
+    uint8_t type;
+    
+    while ( valid && _read( file, type ) )
+    {
+        uint16_t id, n_moved;
+        uint32_t delta;
+        uint8_t length;
+        char name[256];
+        Event event;
+        
+        switch ( type )
+        {
+            case SceneTraceRecorder::NAME:
+                valid = _read( file, id ) && _read( file, length ) && fread( name, 1, length, file ) == length;
+                names[id] = std::string( name, length );
+                break;
+            
+            case SceneTraceRecorder::REMOVE:
+                valid = _read( file, id );
+                removed.push_back( id );
+                break;
+            
+            case SceneTraceRecorder::UPDATE:
+                valid = _read( file, delta ) && _read( file, n_moved );
+                event.changed.resize( n_moved );
+                for ( unsigned idx = 0; valid && idx < n_moved; idx++ ) {
+                    valid = _read( file, id ) && _read( file, event.changed[idx].x ) && _read( file, event.changed[idx].y );
+                    event.changed[idx].id = id;
+                    event.changed[idx].name = names[id];
+                }
+                event.removed.swap( removed );
+                break;
+            
+            case SceneTraceRecorder::REFERENCE:
+                event.changed.resize( 1 );
+                valid = _read( file, delta ) && _read( file, event.changed[0].x ) && _read( file, event.changed[0].y );
+                break;
+            
+            default:
+                valid = false;
+        }
+        
+        if ( valid && ( type == SceneTraceRecorder::UPDATE || type == SceneTraceRecorder::REFERENCE ) ) {
+            time += delta * 1e-6;
+            event.time = time;
+            event.type = SceneTraceRecorder::RecordType( type );
+            _events.push_back( event );
+        }
+    }
+    
+    fclose( file );
+    
+    // A truncated last record, e.g. of a crashed session, is dropped.
+    return !_events.empty() || valid;
+}
+
+const std::vector< SSRverb::SceneTracePlayer::Event >& SSRverb::SceneTracePlayer::get_events()
+{
+    return _events;
+}
+
+double SSRverb::SceneTracePlayer::get_duration()
+{
+    return _events.empty() ? 0.0 : _events.back().time;
+}
+
+void SSRverb::SceneTracePlayer::rewind()
+{
+    _next_event = 0;
+    _scene = TraceScene();
+}
+
+double SSRverb::SceneTracePlayer::get_next_time()
+{
+    return _next_event < _events.size() ? _events[_next_event].time : -1.0;
+}
+
+bool SSRverb::SceneTracePlayer::step( Callback callback )
+{
+    if ( _next_event >= _events.size() ) return false;
+    
+    const Event& event = _events[_next_event++];
+    
+    if ( event.type == SceneTraceRecorder::REFERENCE ) {
+        _scene.set_reference( event.changed[0].x, event.changed[0].y );
+    }
+    else {
+        for ( unsigned idx = 0; idx < event.removed.size(); idx++ ) _scene.remove_source( event.removed[idx] );
+        for ( unsigned idx = 0; idx < event.changed.size(); idx++ ) {
+            const ssrface::Source& source = event.changed[idx];
+            if ( _scene.get_source( source.id ) == nullptr ) _scene.set_name( source.id, source.name );
+            _scene.set_source( source.id, source.x, source.y );
+        }
+    }
+    
+    if ( callback ) callback( event, &_scene );
+    return true;
+}
+
+void SSRverb::SceneTracePlayer::play( float speed, Callback callback )
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    while ( _next_event < _events.size() )
+    {
+        if ( speed > 0.f ) {
+            std::this_thread::sleep_until( start + std::chrono::microseconds( (long long)( get_next_time() / speed * 1e6 ) ) );
+        }
+        step( callback );
+    }
+}
+
+SSRverb::TraceScene* SSRverb::SceneTracePlayer::get_scene()
+{
+    return &_scene;
+}
@@ -0,0 +1,97 @@
+//
+//  SilenceDetector.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+
+#include "reverbs/include/SilenceDetector.hpp"
+#include <math.h>
+
+SSRverb::SilenceDetector::SilenceDetector( float threshold_db )
+{
+    _threshold_db = threshold_db;
+    // Threshold is compared against the mean square of a block.
+    _threshold = powf( 10.f, threshold_db / 10.f );
+}
+
+float SSRverb::SilenceDetector::_mean_square( const float* data, unsigned n_frames )
+{
+    float energy = 0.f;
+    for ( unsigned idx = 0; idx < n_frames; idx++ ) {
+        energy += data[idx] * data[idx];
+    }
+    return n_frames ? energy / n_frames : 0.f;
+}
+
+bool SSRverb::SilenceDetector::check_input( const float* input, unsigned n_frames )
+{
+    if ( !_enabled.load() || _mean_square( input, n_frames ) > _threshold )
+    {
+        // Wake up immediately, the block is processed as usual.
+        _n_silent = 0;
+        _idle.store( false );
+        return false;
+    }
+    
+    _n_silent += n_frames;
+    return _idle.load();
+}
+
+bool SSRverb::SilenceDetector::check_output( float** outputs, unsigned n_channels, unsigned n_frames )
+{
+    if ( !_enabled.load() || _idle.load() || _n_silent < _hold_length.load() ) return false;
+    
+    bool decayed = _n_silent >= _tail_length.load();
+    
+    if ( !decayed )
+    {
+        float energy = 0.f;
+        for ( unsigned chn = 0; chn < n_channels; chn++ ) {
+            energy += _mean_square( outputs[chn], n_frames );
+        }
+        decayed = energy < _threshold;
+    }
+    
+    if ( decayed ) _idle.store( true );
+    
+    return decayed;
+}
+
+void SSRverb::SilenceDetector::set_hold_length( unsigned long n_samples )
+{
+    _hold_length.store( n_samples );
+}
+
+void SSRverb::SilenceDetector::set_tail_length( unsigned long n_samples )
+{
+    _tail_length.store( n_samples );
+}
+
+void SSRverb::SilenceDetector::reset()
+{
+    _n_silent = 0;
+    _idle.store( false );
+}
+
+void SSRverb::SilenceDetector::set_enabled( bool status )
+{
+    _enabled.store( status );
+}
+
+bool SSRverb::SilenceDetector::is_idle()
+{
+    return _idle.load();
+}
+
+float SSRverb::SilenceDetector::get_threshold_db()
+{
+    return _threshold_db;
+}
+
+unsigned long SSRverb::SilenceDetector::decay_length( float t60, unsigned sample_rate, float threshold_db )
+{
+    // Time until a decay of 60 dB per T60 reaches the threshold.
+    return (unsigned long)( ceilf( t60 * sample_rate * fabsf( threshold_db ) / 60.f ) );
+}
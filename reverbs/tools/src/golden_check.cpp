@@ -0,0 +1,354 @@
+//
+//  golden_check.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+//  Renders an impulse and a noise burst through every engine with fixed seeds
+//  and compares the outputs against reference files recorded with --record.
+//  Record the references with the reference build, then run the check against
+//  optimized builds, other block sizes and several threads.
+//
+
+#include "reverbs/include/IrAnalysis.hpp"
+#include "reverbs/fdnverb/include/FDN.hpp"
+#include "reverbs/fdnverb/include/DynamicFDNEngine.hpp"
+#include "reverbs/ismverb/include/ISMverb.hpp"
+#include "reverbs/randomizer/include/Randomizer.hpp"
+#include "reverbs/randomizer/include/ConvolutionEngine.hpp"
+
+#include <sndfile.h>
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <random>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+const unsigned GOLDEN_SEED = 1;
+const unsigned SAMPLE_RATE = 44100;
+const float SIGNAL_LENGTH = 3.f;
+const float BURST_LENGTH = .25f;
+
+/** @brief Allowed deviation from the reference. */
+struct Tolerance
+{
+    float max_abs_error;
+    float max_decay_diff_db;
+    float max_t60_diff;
+};
+
+struct Case
+{
+    std::string engine;
+    std::string signal;
+    Tolerance tolerance;
+};
+
+struct Settings
+{
+    std::string ref_dir = "reverbs/tools/golden";
+    std::string engine;
+    unsigned block_size = 256;
+    unsigned n_threads = 1;
+    bool record = false;
+};
+
+typedef std::vector< std::vector< float > > Channels;
+
+static std::string ir_path( const Settings& settings )
+{
+    return settings.ref_dir + "/conv_ir.wav";
+}
+
+static std::string reference_path( const Settings& settings, const Case& test )
+{
+    return settings.ref_dir + "/" + test.engine + "_" + test.signal + ".wav";
+}
+
+static bool write_file( const std::string& path, const Channels& channels )
+{
+    SF_INFO format{};
+    format.samplerate = SAMPLE_RATE;
+    format.channels = int( channels.size() );
+    format.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    
+    SNDFILE* file = sf_open( path.c_str(), SFM_WRITE, &format );
+    if ( !file ) return false;
+    
+    const unsigned long n_frames = channels[0].size();
+    std::vector< float > interleaved( n_frames * channels.size() );
+    for ( unsigned long idx = 0; idx < n_frames; idx++ ) {
+        for ( unsigned chn = 0; chn < channels.size(); chn++ ) {
+            interleaved[idx * channels.size() + chn] = channels[chn][idx];
+        }
+    }
+    
+    const bool success = sf_writef_float( file, interleaved.data(), n_frames ) == sf_count_t( n_frames );
+    sf_close( file );
+    return success;
+}
+
+static bool read_file( const std::string& path, Channels& channels )
+{
+    SF_INFO format{};
+    SNDFILE* file = sf_open( path.c_str(), SFM_READ, &format );
+    if ( !file ) return false;
+    
+    std::vector< float > interleaved( format.frames * format.channels );
+    const bool success = sf_readf_float( file, interleaved.data(), format.frames ) == format.frames;
+    sf_close( file );
+    
+    channels.assign( format.channels, std::vector< float >( format.frames ) );
+    for ( sf_count_t idx = 0; idx < format.frames; idx++ ) {
+        for ( int chn = 0; chn < format.channels; chn++ ) {
+            channels[chn][idx] = interleaved[idx * format.channels + chn];
+        }
+    }
+    return success;
+}
+
+// One second of decaying noise, the input of the Randomizer.
+static Channels make_convolution_ir()
+{
+    std::mt19937 generator( GOLDEN_SEED );
+    std::uniform_real_distribution< float > noise( -1.f, 1.f );
+    
+    Channels ir( 1, std::vector< float >( SAMPLE_RATE ) );
+    for ( unsigned idx = 0; idx < SAMPLE_RATE; idx++ ) {
+        ir[0][idx] = noise( generator ) * expf( -6.9f * idx / SAMPLE_RATE );
+    }
+    return ir;
+}
+
+static std::vector< float > make_signal( const std::string& signal )
+{
+    std::vector< float > input( (unsigned long)( SIGNAL_LENGTH * SAMPLE_RATE ), 0.f );
+    
+    if ( signal == "impulse" ) {
+        input[0] = 1.f;
+    }
+    else {
+        std::mt19937 generator( GOLDEN_SEED );
+        std::uniform_real_distribution< float > noise( -.5f, .5f );
+        for ( unsigned long idx = 0; idx < (unsigned long)( BURST_LENGTH * SAMPLE_RATE ); idx++ ) {
+            input[idx] = noise( generator );
+        }
+    }
+    return input;
+}
+
+static std::unique_ptr< SSRverb::ReverbEngine > make_engine(  const std::string& name, unsigned block_size
+                                                            , SSRverb::Randomizer* randomizer )
+{
+    std::unique_ptr< SSRverb::ReverbEngine > engine;
+    const SSRverb::Vector3D source( 1.7f, 2.3f, 1.7f );
+    const SSRverb::Vector3D receiver( 2.5f, 3.5f, 1.7f );
+    
+    if ( name == "fdn" )
+    {
+        SSRverb::FDN* fdn = new SSRverb::FDN( SAMPLE_RATE, 24, 8 );
+        fdn->set_seed( GOLDEN_SEED );
+        fdn->set_co_freqs( ISM_CO_FREQS );
+        engine.reset( fdn );
+    }
+    else if ( name == "ism" )
+    {
+        engine.reset( new SSRverb::ISMverb( 5.f, 7.f, 3.2f, 4, SAMPLE_RATE, block_size ) );
+    }
+    else if ( name == "dfdn" )
+    {
+        SSRverb::DynamicFDNEngine* dfdn = new SSRverb::DynamicFDNEngine( SAMPLE_RATE, block_size );
+        dfdn->set_seed( GOLDEN_SEED );
+        dfdn->set_governor( false );
+        engine.reset( dfdn );
+    }
+    else
+    {
+        engine.reset( new SSRverb::ConvolutionEngine(  randomizer->get_spac_imp_resps(), 8
+                                                     , randomizer->get_ir_length(), block_size ) );
+    }
+    
+    engine->set_room_size( 5.f, 7.f, 3.2f );
+    engine->set_t60( 2.f, 0 );
+    engine->set_t60( 1.f, 1 );
+    engine->set_t60( .3f, 2 );
+    engine->set_src_pos( source );
+    engine->set_rec_pos( receiver );
+    engine->prepare( SAMPLE_RATE, block_size );
+    return engine;
+}
+
+static Channels render( const Case& test, unsigned block_size, SSRverb::Randomizer* randomizer )
+{
+    std::unique_ptr< SSRverb::ReverbEngine > engine = make_engine( test.engine, block_size, randomizer );
+    std::vector< float > input = make_signal( test.signal );
+    const unsigned long n_frames = input.size();
+    const unsigned n_outputs = engine->get_n_outputs();
+    
+    // Block based engines need full blocks.
+    input.resize( ( n_frames + block_size - 1 ) / block_size * block_size, 0.f );
+    
+    Channels outputs( n_outputs, std::vector< float >( input.size() ) );
+    std::vector< float* > output_ptrs( n_outputs );
+    
+    for ( unsigned long start = 0; start < input.size(); start += block_size ) {
+        for ( unsigned out = 0; out < n_outputs; out++ ) output_ptrs[out] = outputs[out].data() + start;
+        engine->process( input.data() + start, output_ptrs.data(), block_size );
+    }
+    
+    for ( unsigned out = 0; out < n_outputs; out++ ) outputs[out].resize( n_frames );
+    return outputs;
+}
+
+// Runs one case. Returns false on failure, the report is written to message.
+static bool run_case( const Case& test, const Settings& settings, SSRverb::Randomizer* randomizer, std::string& message )
+{
+    const Channels result = render( test, settings.block_size, randomizer );
+    char line[256];
+    
+    if ( settings.record )
+    {
+        if ( !write_file( reference_path( settings, test ), result ) ) {
+            message = "could not write " + reference_path( settings, test );
+            return false;
+        }
+        message = "recorded";
+        return true;
+    }
+    
+    Channels reference;
+    if ( !read_file( reference_path( settings, test ), reference ) ) {
+        message = "could not read " + reference_path( settings, test ) + ", record it with --record";
+        return false;
+    }
+    if ( reference.size() != result.size() || reference[0].size() != result[0].size() ) {
+        message = "channel count or length differs from the reference";
+        return false;
+    }
+    
+    SSRverb::IrAnalysis analysis( SAMPLE_RATE, ISM_CO_FREQS );
+    SSRverb::IrAnalysis::Comparison worst;
+    
+    for ( unsigned chn = 0; chn < result.size(); chn++ )
+    {
+        SSRverb::IrAnalysis::Comparison comparison = analysis.compare( reference[chn].data(), result[chn].data(), result[chn].size() );
+        worst.max_abs_error = std::max( worst.max_abs_error, comparison.max_abs_error );
+        worst.max_decay_diff_db = std::max( worst.max_decay_diff_db, comparison.max_decay_diff_db );
+        worst.max_t60_diff = std::max( worst.max_t60_diff, comparison.max_t60_diff );
+    }
+    
+    const bool passed = worst.max_abs_error <= test.tolerance.max_abs_error
+                     && worst.max_decay_diff_db <= test.tolerance.max_decay_diff_db
+                     && worst.max_t60_diff <= test.tolerance.max_t60_diff;
+    
+    snprintf(  line, sizeof(line), "max error %.3g (%.3g), decay %.3f dB (%.3f), T60 %.2f %% (%.2f) %s"
+             , worst.max_abs_error, test.tolerance.max_abs_error
+             , worst.max_decay_diff_db, test.tolerance.max_decay_diff_db
+             , worst.max_t60_diff * 100.f, test.tolerance.max_t60_diff * 100.f
+             , passed ? "ok" : "FAILED" );
+    message = line;
+    return passed;
+}
+
+static void print_usage( const char* name )
+{
+    printf( "Usage: %s [options]\n", name );
+    printf( "  --record              Writes the reference files instead of checking against them.\n" );
+    printf( "  --ref-dir <dir>       Directory of the reference files, reverbs/tools/golden by default.\n" );
+    printf( "  --engine <name>       Only fdn, ism, dfdn or conv.\n" );
+    printf( "  --block-size <frames> Frames processed at once, 256 by default.\n" );
+    printf( "  --threads <n>         Cases rendered in parallel.\n" );
+}
+
+int main( int argc, char** argv )
+{
+    Settings settings;
+    
+    for ( int arg = 1; arg < argc; arg++ )
+    {
+        if ( !strcmp( argv[arg], "--record" ) ) settings.record = true;
+        else if ( !strcmp( argv[arg], "--ref-dir" ) && arg+1 < argc ) settings.ref_dir = argv[++arg];
+        else if ( !strcmp( argv[arg], "--engine" ) && arg+1 < argc ) settings.engine = argv[++arg];
+        else if ( !strcmp( argv[arg], "--block-size" ) && arg+1 < argc ) settings.block_size = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--threads" ) && arg+1 < argc ) settings.n_threads = atoi( argv[++arg] );
+        else {
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    
+    if ( settings.block_size == 0 || settings.n_threads == 0 ) {
+        print_usage( argv[0] );
+        return 1;
+    }
+    
+    // The ISM has no feedback, differences stay local. Feedback in the FDNs spreads them.
+    const Tolerance fir_tolerance{ 1e-4f, .5f, .02f };
+    const Tolerance fdn_tolerance{ 1e-3f, 1.f, .05f };
+    
+    std::vector< Case > cases;
+    const char* signals[]{ "impulse", "burst" };
+    for ( const char* signal : signals )
+    {
+        cases.push_back( { "fdn", signal, fdn_tolerance } );
+        cases.push_back( { "ism", signal, fir_tolerance } );
+        cases.push_back( { "dfdn", signal, fdn_tolerance } );
+        cases.push_back( { "conv", signal, fir_tolerance } );
+    }
+    if ( !settings.engine.empty() ) {
+        cases.erase( std::remove_if( cases.begin(), cases.end(), [&settings]( const Case& test )
+        {
+            return test.engine != settings.engine;
+        }), cases.end() );
+    }
+    
+    // The impulse response of the convolution is part of the references.
+    std::unique_ptr< SSRverb::Randomizer > randomizer;
+    if ( settings.engine.empty() || settings.engine == "conv" )
+    {
+        if ( settings.record && !write_file( ir_path( settings ), make_convolution_ir() ) ) {
+            printf( "Could not write %s.\n", ir_path( settings ).c_str() );
+            return 1;
+        }
+        Channels ir;
+        if ( !read_file( ir_path( settings ), ir ) ) {
+            printf( "Could not read %s, record it with --record.\n", ir_path( settings ).c_str() );
+            return 1;
+        }
+        randomizer.reset( new SSRverb::Randomizer( ir_path( settings ).c_str() ) );
+        randomizer->set_seed( GOLDEN_SEED );
+        randomizer->create_spacial_imp_resp();
+    }
+    
+    std::atomic< unsigned > next_case{ 0 };
+    std::atomic< unsigned > n_failed{ 0 };
+    std::mutex print_mtx;
+    
+    auto worker = [&]()
+    {
+        std::string message;
+        for ( unsigned idx = next_case++; idx < cases.size(); idx = next_case++ )
+        {
+            if ( !run_case( cases[idx], settings, randomizer.get(), message ) ) n_failed++;
+            
+            std::lock_guard< std::mutex > lock( print_mtx );
+            printf( "%s/%s: %s\n", cases[idx].engine.c_str(), cases[idx].signal.c_str(), message.c_str() );
+            fflush( stdout );
+        }
+    };
+    
+    std::vector< std::thread > threads;
+    for ( unsigned thr = 0; thr < settings.n_threads; thr++ ) threads.push_back( std::thread( worker ) );
+    for ( unsigned thr = 0; thr < threads.size(); thr++ ) threads[thr].join();
+    
+    printf( "%u cases, %u failed\n", unsigned( cases.size() ), n_failed.load() );
+    return n_failed ? 1 : 0;
+}
@@ -0,0 +1,591 @@
+//
+//  mock_ssr.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+//  Local stand-in for the TCP/IP interface of the SoundScape Renderer. Speaks
+//  the part of the XML protocol the SceneManager uses: sources are created,
+//  moved and deleted, the reference is moved, and all clients receive the
+//  resulting updates. Synthetic sources moving on circles generate load.
+//
+//  With --drive a SceneManager is connected in the same process, sets up
+//  reverberation sources like ReverbBase and feeds their registry and an
+//  engine without JACK through the tracking callback, so the tracking path
+//  can be stress-tested on one machine.
+//
+
+#include "reverbs/include/SceneTrace.hpp"
+#include "reverbs/include/SceneDiff.hpp"
+#include "reverbs/include/RevSourceRegistry.hpp"
+#include "reverbs/fdnverb/include/DynamicFDNEngine.hpp"
+#include "reverbs/ismverb/include/ISMverb.hpp"
+#include "ssrface/include/SceneManager.hpp"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdarg>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <math.h>
+
+struct Settings
+{
+    unsigned short port = 4711;
+    unsigned n_sources = 200;
+    float rate = 100.f;
+    float duration = 0.f;
+    bool batch = false;
+    std::string drive;
+    unsigned n_rev_sources = 8;
+    std::string trace_path;
+    unsigned block_size = 64;
+    unsigned sample_rate = 44100;
+};
+
+struct MockSource
+{
+    std::string name;
+    float x;
+    float y;
+};
+
+/**
+ Single threaded SSR stand-in. Messages are XML documents terminated by a
+ binary zero, like those of the SSR.
+ */
+class MockSsr
+{
+public:
+    MockSsr( const Settings& settings ) : _settings( settings ) {}
+    
+    ~MockSsr()
+    {
+        for ( unsigned cl = 0; cl < _clients.size(); cl++ ) close( _clients[cl].fd );
+        if ( _listen_fd >= 0 ) close( _listen_fd );
+    }
+    
+    bool listen_on( unsigned short port )
+    {
+        _listen_fd = socket( AF_INET, SOCK_STREAM, 0 );
+        if ( _listen_fd < 0 ) return false;
+        
+        int reuse = 1;
+        setsockopt( _listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse) );
+        
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons( port );
+        address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+        
+        if ( bind( _listen_fd, (sockaddr*)&address, sizeof(address) ) < 0 || listen( _listen_fd, 8 ) < 0 ) return false;
+        fcntl( _listen_fd, F_SETFL, O_NONBLOCK );
+        return true;
+    }
+    
+    /** @brief Adds the sources moved by the load generator. */
+    void add_synthetic_sources( unsigned n_sources )
+    {
+        for ( unsigned src = 0; src < n_sources; src++ )
+        {
+            const unsigned short id = _next_id++;
+            _sources[id] = MockSource{ "src_" + std::to_string( src+1 ), 0.f, 0.f };
+            _synthetic.push_back( id );
+        }
+        _move_synthetic( 0.0 );
+    }
+    
+    /** @returns ID of the first synthetic source, 0 if there is none. */
+    unsigned short get_first_synthetic()
+    {
+        return _synthetic.empty() ? 0 : _synthetic[0];
+    }
+    
+    /** @brief Serves the clients and generates load until stopped or the duration is over. */
+    void run( float duration )
+    {
+        typedef std::chrono::steady_clock clock;
+        const clock::time_point start = clock::now();
+        const std::chrono::duration< double > tick_interval( _settings.rate > 0.f ? 1.0 / _settings.rate : 1e9 );
+        clock::time_point next_tick = start + std::chrono::duration_cast< clock::duration >( tick_interval );
+        clock::time_point next_report = start + std::chrono::seconds( 1 );
+        
+        while ( _running.load() )
+        {
+            const clock::time_point now = clock::now();
+            if ( duration > 0.f && now - start > std::chrono::duration< double >( duration ) ) break;
+            
+            if ( now >= next_tick ) {
+                const std::chrono::duration< double > elapsed = now - start;
+                _move_synthetic( elapsed.count() );
+                next_tick += std::chrono::duration_cast< clock::duration >( tick_interval );
+                // Fall behind rather than bursting when the clients are too slow.
+                if ( next_tick < now ) next_tick = now;
+            }
+            if ( now >= next_report ) {
+                printf( "mock_ssr: %u clients, %u sources, %lu messages sent, %lu requests, %.1f kB/s\n"
+                       , unsigned( _clients.size() ), unsigned( _sources.size() ), _n_sent, _n_requests, _n_bytes / 1000.0 );
+                fflush( stdout );
+                _n_bytes = 0;
+                next_report += std::chrono::seconds( 1 );
+            }
+            
+            _poll( std::min( next_tick, next_report ) );
+        }
+    }
+    
+    void stop()
+    {
+        _running.store( false );
+    }
+    
+private:
+    struct Client
+    {
+        int fd;
+        std::string in;
+        std::string out;
+    };
+    
+    const Settings& _settings;
+    int _listen_fd = -1;
+    std::vector< Client > _clients;
+    std::atomic< bool > _running{ true };
+    
+    std::map< unsigned short, MockSource > _sources;
+    std::vector< unsigned short > _synthetic;
+    unsigned short _next_id = 1;
+    float _ref_x = 0.f;
+    float _ref_y = 0.f;
+    
+    unsigned long _n_sent = 0;
+    unsigned long _n_requests = 0;
+    unsigned long _n_bytes = 0;
+    
+    static std::string _format( const char* format, ... )
+    {
+        char buffer[512];
+        va_list args;
+        va_start( args, format );
+        vsnprintf( buffer, sizeof(buffer), format, args );
+        va_end( args );
+        return buffer;
+    }
+    
+    static std::string _position( float x, float y )
+    {
+        return _format( "<position x=\"%.4f\" y=\"%.4f\"/>", x, y );
+    }
+    
+    static std::string _source_element( unsigned short id, const MockSource& source, bool full )
+    {
+        if ( !full ) return _format( "<source id=\"%u\">", id ) + _position( source.x, source.y ) + "</source>";
+        
+        return _format( "<source id=\"%u\" name=\"%s\" model=\"point\" mute=\"false\" volume=\"0\">", id, source.name.c_str() )
+             + _position( source.x, source.y ) + "</source>";
+    }
+    
+    void _send( Client& client, const std::string& message )
+    {
+        client.out += message;
+        client.out += '\0';
+        _n_sent++;
+    }
+    
+    void _broadcast( const std::string& message )
+    {
+        for ( unsigned cl = 0; cl < _clients.size(); cl++ ) _send( _clients[cl], message );
+    }
+    
+    // The SSR sends the whole scene to new clients.
+    void _send_scene( Client& client )
+    {
+        for ( auto& source : _sources ) {
+            _send( client, "<update>" + _source_element( source.first, source.second, true ) + "</update>" );
+        }
+        _send( client, "<update><reference>" + _position( _ref_x, _ref_y ) + "</reference></update>" );
+    }
+    
+    void _move_synthetic( double time )
+    {
+        std::string batch;
+        
+        for ( unsigned idx = 0; idx < _synthetic.size(); idx++ )
+        {
+            const unsigned short id = _synthetic[idx];
+            MockSource& source = _sources[id];
+            
+            // Every source has its own circle and speed.
+            const float radius = 1.f + ( idx % 7 ) * .5f;
+            const float speed = .2f + ( idx % 5 ) * .1f;
+            const float angle = float( speed * time ) + 2.f * float( M_PI ) * idx / _synthetic.size();
+            source.x = _ref_x + radius * cosf( angle );
+            source.y = _ref_y + radius * sinf( angle );
+            
+            if ( _settings.batch ) batch += _source_element( id, source, false );
+            else _broadcast( "<update>" + _source_element( id, source, false ) + "</update>" );
+        }
+        
+        if ( _settings.batch && !batch.empty() ) _broadcast( "<update>" + batch + "</update>" );
+    }
+    
+    static bool _attribute( const std::string& element, const char* name, std::string& value )
+    {
+        const std::string key = std::string( " " ) + name + "=";
+        size_t pos = element.find( key );
+        if ( pos == std::string::npos ) return false;
+        
+        pos += key.size();
+        const char quote = element[pos];
+        const size_t end = element.find( quote, pos + 1 );
+        if ( end == std::string::npos ) return false;
+        
+        value = element.substr( pos + 1, end - pos - 1 );
+        return true;
+    }
+    
+    // Position of the first <position> element after pos.
+    static bool _read_position( const std::string& message, size_t pos, float& x, float& y )
+    {
+        const size_t start = message.find( "<position", pos );
+        if ( start == std::string::npos ) return false;
+        
+        const std::string element = message.substr( start, message.find( '>', start ) - start );
+        std::string value;
+        if ( _attribute( element, "x", value ) ) x = float( atof( value.c_str() ) );
+        if ( _attribute( element, "y", value ) ) y = float( atof( value.c_str() ) );
+        return true;
+    }
+    
+    void _handle_request( const std::string& message )
+    {
+        _n_requests++;
+        std::string value;
+        
+        if ( message.find( "<scene" ) != std::string::npos && message.find( "clear=" ) != std::string::npos )
+        {
+            for ( auto& source : _sources ) {
+                _broadcast( _format( "<update><delete><source id=\"%u\"/></delete></update>", source.first ) );
+            }
+            _sources.clear();
+            _synthetic.clear();
+        }
+        else if ( message.find( "<delete" ) != std::string::npos )
+        {
+            const size_t start = message.find( "<source", message.find( "<delete" ) );
+            if ( start == std::string::npos ) return;
+            if ( !_attribute( message.substr( start, message.find( '>', start ) - start ), "id", value ) ) return;
+            
+            const unsigned short id = (unsigned short)atoi( value.c_str() );
+            _sources.erase( id );
+            _synthetic.erase( std::remove( _synthetic.begin(), _synthetic.end(), id ), _synthetic.end() );
+            _broadcast( _format( "<update><delete><source id=\"%u\"/></delete></update>", id ) );
+        }
+        else if ( message.find( "<reference" ) != std::string::npos )
+        {
+            _read_position( message, message.find( "<reference" ), _ref_x, _ref_y );
+            _broadcast( "<update><reference>" + _position( _ref_x, _ref_y ) + "</reference></update>" );
+        }
+        else if ( message.find( "<source" ) != std::string::npos )
+        {
+            const size_t start = message.find( "<source" );
+            const std::string element = message.substr( start, message.find( '>', start ) - start );
+            
+            if ( _attribute( element, "new", value ) && value == "true" )
+            {
+                const unsigned short id = _next_id++;
+                MockSource& source = _sources[id];
+                if ( !_attribute( element, "name", source.name ) ) source.name = "";
+                source.x = source.y = 0.f;
+                _read_position( message, start, source.x, source.y );
+                _broadcast( "<update>" + _source_element( id, source, true ) + "</update>" );
+            }
+            else if ( _attribute( element, "id", value ) )
+            {
+                const unsigned short id = (unsigned short)atoi( value.c_str() );
+                std::map< unsigned short, MockSource >::iterator source = _sources.find( id );
+                if ( source == _sources.end() ) return;
+                
+                _read_position( message, start, source->second.x, source->second.y );
+                _broadcast( "<update>" + _source_element( id, source->second, false ) + "</update>" );
+            }
+        }
+    }
+    
+    void _poll( std::chrono::steady_clock::time_point until )
+    {
+        std::vector< pollfd > fds( 1 + _clients.size() );
+        fds[0] = { _listen_fd, POLLIN, 0 };
+        for ( unsigned cl = 0; cl < _clients.size(); cl++ ) {
+            fds[cl+1] = { _clients[cl].fd, short( POLLIN | ( _clients[cl].out.empty() ? 0 : POLLOUT ) ), 0 };
+        }
+        
+        const long long timeout = std::chrono::duration_cast< std::chrono::milliseconds >( until - std::chrono::steady_clock::now() ).count();
+        if ( poll( fds.data(), fds.size(), int( std::max( timeout, 0ll ) ) ) <= 0 ) return;
+        
+        if ( fds[0].revents & POLLIN ) {
+            int fd = accept( _listen_fd, nullptr, nullptr );
+            if ( fd >= 0 ) {
+                int no_delay = 1;
+                setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay) );
+                fcntl( fd, F_SETFL, O_NONBLOCK );
+                _clients.push_back( Client{ fd, "", "" } );
+                _send_scene( _clients.back() );
+            }
+        }
+        
+        char buffer[4096];
+        for ( unsigned cl = 0; cl < fds.size() - 1 && cl < _clients.size(); cl++ )
+        {
+            Client& client = _clients[cl];
+            bool closed = false;
+            
+            if ( fds[cl+1].revents & POLLIN ) {
+                const ssize_t n_read = recv( client.fd, buffer, sizeof(buffer), 0 );
+                if ( n_read <= 0 ) closed = true;
+                else client.in.append( buffer, n_read );
+                
+                for ( size_t end = client.in.find( '\0' ); end != std::string::npos; end = client.in.find( '\0' ) ) {
+                    _handle_request( client.in.substr( 0, end ) );
+                    client.in.erase( 0, end + 1 );
+                }
+            }
+            if ( !closed && ( fds[cl+1].revents & POLLOUT ) ) {
+                const ssize_t n_written = send( client.fd, client.out.data(), client.out.size(), MSG_NOSIGNAL );
+                if ( n_written < 0 ) closed = true;
+                else {
+                    client.out.erase( 0, n_written );
+                    _n_bytes += n_written;
+                }
+            }
+            if ( closed || ( fds[cl+1].revents & ( POLLERR | POLLHUP ) ) ) client.fd = -client.fd - 1;
+        }
+        
+        // Remove closed clients, marked by a negative descriptor.
+        for ( unsigned cl = 0; cl < _clients.size(); ) {
+            if ( _clients[cl].fd < 0 ) {
+                close( -_clients[cl].fd - 1 );
+                _clients.erase( _clients.begin() + cl );
+            }
+            else cl++;
+        }
+    }
+};
+
+/** State of the tracking path driven by --drive. */
+struct Driver
+{
+    SSRverb::ISMverb* ism;
+    SSRverb::SceneTraceRecorder trace;
+    SSRverb::SceneDiff diff;
+    SSRverb::RevSourceRegistry registry;
+    std::atomic< unsigned long > n_updates{ 0 };
+    std::atomic< unsigned long > n_references{ 0 };
+    std::atomic< double > callback_ns{ 0.0 };
+    std::atomic< double > registry_ns{ 0.0 };
+};
+
+static void on_update( ssrface::Scene* scene, void* data )
+{
+    Driver* driver = (Driver*)data;
+    auto start = std::chrono::steady_clock::now();
+    
+    driver->trace.record_update( scene );
+    
+    // Same path as ReverbBase, which only passes on the changes.
+    driver->diff.update( scene );
+    if ( !driver->diff.is_empty() )
+    {
+        auto registry_start = std::chrono::steady_clock::now();
+        driver->registry.track( scene, driver->diff );
+        std::chrono::duration< double, std::nano > registry_elapsed = std::chrono::steady_clock::now() - registry_start;
+        driver->registry_ns.store( driver->registry_ns.load() + registry_elapsed.count() );
+        
+        SSRverb::ISMverb::update_changed_src_pos( scene, driver->diff, driver->ism );
+    }
+    
+    std::chrono::duration< double, std::nano > elapsed = std::chrono::steady_clock::now() - start;
+    driver->callback_ns.store( driver->callback_ns.load() + elapsed.count() );
+    driver->n_updates++;
+}
+
+static void on_reference( ssrface::Scene* scene, void* data )
+{
+    Driver* driver = (Driver*)data;
+    driver->trace.record_reference( scene );
+    driver->n_references++;
+}
+
+// Processes the engine in real time while the SceneManager feeds the tracking callback.
+static int drive( const Settings& settings, unsigned short tracked_source )
+{
+    std::unique_ptr< SSRverb::ReverbEngine > engine;
+    Driver driver;
+    
+    if ( settings.drive == "dfdn" )
+    {
+        SSRverb::DynamicFDNEngine* dfdn = new SSRverb::DynamicFDNEngine( settings.sample_rate, settings.block_size );
+        dfdn->set_tracked_source( tracked_source );
+        driver.ism = dfdn->get_ism();
+        engine.reset( dfdn );
+    }
+    else
+    {
+        driver.ism = new SSRverb::ISMverb( 5.f, 7.f, 3.2f, 4, settings.sample_rate, settings.block_size );
+        driver.ism->set_tracked_source( tracked_source );
+        engine.reset( driver.ism );
+    }
+    engine->prepare( settings.sample_rate, settings.block_size );
+    
+    if ( !settings.trace_path.empty() && !driver.trace.start( settings.trace_path.c_str() ) ) {
+        printf( "Could not open %s.\n", settings.trace_path.c_str() );
+        return 1;
+    }
+    
+    ssrface::SceneManager manager;
+    manager.set_ssr_address( "127.0.0.1", settings.port );
+    manager.set_update_callback( on_update, &driver );
+    manager.set_reference_callback( on_reference, &driver );
+    if ( !manager.connect() ) {
+        printf( "Could not connect to the mock SSR.\n" );
+        return 1;
+    }
+    manager.run();
+    
+    // Reverberation sources on a circle around the reference, named like those of ReverbBase.
+    char src_name[10];
+    for ( unsigned rev = 0; rev < settings.n_rev_sources; rev++ )
+    {
+        snprintf( src_name, sizeof(src_name), "%s%u", SSRverb::RevSourceRegistry::prefix, rev+1 );
+        manager.setup_new_source( src_name, cosf( 2.f*M_PI/settings.n_rev_sources * rev ), sinf( 2.f*M_PI/settings.n_rev_sources * rev ), false );
+    }
+    
+    std::mt19937 generator( 1 );
+    std::uniform_real_distribution< float > noise( -.5f, .5f );
+    std::vector< float > input( settings.block_size );
+    const unsigned n_outputs = engine->get_n_outputs();
+    std::vector< std::vector< float > > outputs( n_outputs, std::vector< float >( settings.block_size ) );
+    std::vector< float* > output_ptrs( n_outputs );
+    for ( unsigned out = 0; out < n_outputs; out++ ) output_ptrs[out] = outputs[out].data();
+    
+    const double block_duration = double( settings.block_size ) / settings.sample_rate;
+    const unsigned long n_blocks = (unsigned long)( settings.duration / block_duration );
+    unsigned long n_tap_blocks = 0;
+    double total_ns = 0.0, tap_ns = 0.0, peak_ns = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    
+    for ( unsigned long blk = 0; blk < n_blocks; blk++ )
+    {
+        std::this_thread::sleep_until( start + std::chrono::microseconds( (long long)( blk * block_duration * 1e6 ) ) );
+        for ( unsigned idx = 0; idx < settings.block_size; idx++ ) input[idx] = noise( generator );
+        
+        const unsigned long n_tap_updates = driver.ism->get_n_updates();
+        auto block_start = std::chrono::steady_clock::now();
+        engine->process( input.data(), output_ptrs.data(), settings.block_size );
+        std::chrono::duration< double, std::nano > elapsed = std::chrono::steady_clock::now() - block_start;
+        
+        total_ns += elapsed.count();
+        peak_ns = std::max( peak_ns, elapsed.count() );
+        if ( driver.ism->get_n_updates() != n_tap_updates ) {
+            n_tap_blocks++;
+            tap_ns += elapsed.count();
+        }
+    }
+    
+    const std::vector< unsigned short > rev_ids = driver.registry.get_ids();
+    for ( unsigned rev = 0; rev < rev_ids.size(); rev++ ) manager.delete_source( rev_ids[rev] );
+    
+    manager.stop();
+    manager.disconnect();
+    driver.trace.stop();
+    
+    const unsigned long n_updates = driver.n_updates.load();
+    printf( "Tracking: %lu update callbacks (%.1f / s, %.2f us each), %lu reference callbacks\n"
+           , n_updates, n_updates / settings.duration, n_updates ? driver.callback_ns.load() / n_updates / 1000.0 : 0.0
+           , driver.n_references.load() );
+    printf( "Registry: %u of %u reverb sources tracked, %.2f us per update\n"
+           , unsigned( rev_ids.size() ), settings.n_rev_sources, n_updates ? driver.registry_ns.load() / n_updates / 1000.0 : 0.0 );
+    printf( "Engine %s: %lu blocks, %lu with tap updates (%.1f / s)\n"
+           , settings.drive.c_str(), n_blocks, n_tap_blocks, n_tap_blocks / settings.duration );
+    printf( "Block time: mean %.2f us, with tap update %.2f us, peak %.2f us (%.1f %% of the block)\n"
+           , n_blocks ? total_ns / n_blocks / 1000.0 : 0.0, n_tap_blocks ? tap_ns / n_tap_blocks / 1000.0 : 0.0
+           , peak_ns / 1000.0, peak_ns / ( block_duration * 1e9 ) * 100.0 );
+    return 0;
+}
+
+static void print_usage( const char* name )
+{
+    printf( "Usage: %s [options]\n", name );
+    printf( "  --port <n>             TCP port on the loopback interface, 4711 by default.\n" );
+    printf( "  --sources <n>          Synthetic moving sources, 200 by default.\n" );
+    printf( "  --rate <hz>            Moves per second of every source, 100 by default.\n" );
+    printf( "  --batch                Sends the moves of one tick in a single update.\n" );
+    printf( "  --duration <s>         Stops after this time. Runs until killed by default.\n" );
+    printf( "  --drive <dfdn|ism>     Connects a SceneManager and drives this engine through the tracking callback.\n" );
+    printf( "  --rev-sources <n>      Reverberation sources set up by the driver, 8 by default.\n" );
+    printf( "  --trace <file>         Records the scene updates seen by the driver, see replay_trace.\n" );
+    printf( "  --block-size <frames>  Block size of the driven engine, 64 by default.\n" );
+}
+
+int main( int argc, char** argv )
+{
+    Settings settings;
+    
+    for ( int arg = 1; arg < argc; arg++ )
+    {
+        if ( !strcmp( argv[arg], "--port" ) && arg+1 < argc ) settings.port = (unsigned short)atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--sources" ) && arg+1 < argc ) settings.n_sources = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--rate" ) && arg+1 < argc ) settings.rate = atof( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--batch" ) ) settings.batch = true;
+        else if ( !strcmp( argv[arg], "--duration" ) && arg+1 < argc ) settings.duration = atof( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--drive" ) && arg+1 < argc ) settings.drive = argv[++arg];
+        else if ( !strcmp( argv[arg], "--rev-sources" ) && arg+1 < argc ) settings.n_rev_sources = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--trace" ) && arg+1 < argc ) settings.trace_path = argv[++arg];
+        else if ( !strcmp( argv[arg], "--block-size" ) && arg+1 < argc ) settings.block_size = atoi( argv[++arg] );
+        else {
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    
+    if ( !settings.drive.empty() && settings.drive != "dfdn" && settings.drive != "ism" ) {
+        print_usage( argv[0] );
+        return 1;
+    }
+    if ( !settings.drive.empty() && settings.duration <= 0.f ) settings.duration = 10.f;
+    
+    MockSsr server( settings );
+    if ( !server.listen_on( settings.port ) ) {
+        printf( "Could not listen on port %u.\n", settings.port );
+        return 1;
+    }
+    server.add_synthetic_sources( settings.n_sources );
+    
+    if ( settings.drive.empty() ) {
+        server.run( settings.duration );
+        return 0;
+    }
+    
+    std::thread server_thread( [&server]() { server.run( 0.f ); } );
+    const int result = drive( settings, server.get_first_synthetic() );
+    server.stop();
+    server_thread.join();
+    
+    return result;
+}
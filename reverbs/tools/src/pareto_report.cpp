@@ -0,0 +1,304 @@
+//
+//  pareto_report.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+//  Sweeps FDN feedback path counts and ISM orders for one room. Each
+//  configuration is rendered like the DynamicFDN mixes it. From the impulse
+//  response the achieved T60 per band and the echo density are measured and
+//  put next to the processing cost. Configurations no other one beats in
+//  cost, T60 accuracy and echo density at once form the Pareto front.
+//
+
+#include "reverbs/include/IrAnalysis.hpp"
+#include "reverbs/fdnverb/include/FDN.hpp"
+#include "reverbs/ismverb/include/ISMverb.hpp"
+
+#include <time.h>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+const unsigned REPORT_SEED = 1;
+const unsigned N_BANDS = 3;
+const unsigned N_OUTPUTS = 8;
+
+// Echo density is judged on the early part of the response.
+const float EARLY_LENGTH = .1f;
+
+struct Settings
+{
+    float room[3]{ 5.f, 7.f, 3.2f };
+    float t60[N_BANDS]{ 2.f, 1.f, .3f };
+    std::vector< float > co_freqs = ISM_CO_FREQS;
+    std::vector< unsigned > n_fbpaths{ 0, 4, 8, 16, 24, 32, 64 };
+    std::vector< unsigned > ism_orders{ 0, 1, 2, 3, 4, 5, 6 };
+    unsigned sample_rate = 44100;
+    unsigned block_size = 256;
+    unsigned n_threads = 0;
+    float target_error = .1f;
+};
+
+struct Report
+{
+    unsigned n_fbpaths;
+    unsigned ism_order;
+    float t60[N_BANDS];
+    /** Largest deviation from the target T60 relative to the target. */
+    float t60_error;
+    /** Mean normalized echo density of the early part. */
+    float early_density;
+    /** First time the echo density reaches 1 in ms, -1 if never. */
+    float mixing_time;
+    /** Processing time relative to the duration of the response. */
+    float rtf;
+    bool pareto;
+};
+
+// CPU time of the calling thread, so parallel configurations do not bias each other.
+static double thread_time()
+{
+    timespec now;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now );
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static std::vector< std::vector< float > > render( const Settings& settings, unsigned n_fbpaths, unsigned ism_order, double& cpu_time )
+{
+    const float max_t60 = *std::max_element( settings.t60, settings.t60 + N_BANDS );
+    const unsigned block_size = settings.block_size;
+    const unsigned long n_blocks = (unsigned long)( ( 1.5f * max_t60 + .2f ) * settings.sample_rate / block_size ) + 1;
+    const unsigned long n_samples = n_blocks * block_size;
+    
+    std::unique_ptr< SSRverb::FDN > fdn;
+    std::unique_ptr< SSRverb::ISMverb > ism;
+    
+    if ( n_fbpaths > 0 ) {
+        fdn.reset( new SSRverb::FDN( settings.sample_rate, n_fbpaths, N_OUTPUTS ) );
+        fdn->set_seed( REPORT_SEED );
+        fdn->set_room_size( settings.room[0], settings.room[1], settings.room[2] );
+        fdn->set_co_freqs( settings.co_freqs );
+        fdn->set_idle_detection( false );
+    }
+    if ( ism_order > 0 ) {
+        ism.reset( new SSRverb::ISMverb(  settings.room[0], settings.room[1], settings.room[2]
+                                        , ism_order, settings.sample_rate, block_size ) );
+        ism->set_co_freqs( settings.co_freqs );
+        ism->set_idle_detection( false );
+        ism->set_source( SSRverb::Vector3D( settings.room[0] * .3f, settings.room[1] * .3f, 1.7f ) );
+        ism->set_receiver( SSRverb::Vector3D( settings.room[0] * .5f, settings.room[1] * .5f, 1.7f ) );
+    }
+    // ISMverb derives its wall reflectance from the target through Sabine's formula.
+    for ( unsigned band = 0; band < N_BANDS; band++ ) {
+        if ( fdn ) fdn->set_t60( settings.t60[band], band );
+        if ( ism ) ism->set_t60( settings.t60[band], band );
+    }
+    
+    std::vector< std::vector< float > > outputs( N_OUTPUTS, std::vector< float >( n_samples, 0.f ) );
+    std::vector< std::vector< float > > ism_outputs( N_OUTPUTS, std::vector< float >( block_size ) );
+    std::vector< float* > output_ptrs( N_OUTPUTS ), ism_ptrs( N_OUTPUTS );
+    for ( unsigned out = 0; out < N_OUTPUTS; out++ ) ism_ptrs[out] = ism_outputs[out].data();
+    
+    std::vector< float > input( block_size, 0.f );
+    // Equal mix of both, the default of the DynamicFDN. A single engine is used as is.
+    const float fdn_gain = ism ? .5f : 1.f;
+    const float ism_gain = fdn ? .5f : 1.f;
+    
+    cpu_time = 0.0;
+    for ( unsigned long blk = 0; blk < n_blocks; blk++ )
+    {
+        input[0] = blk == 0 ? 1.f : 0.f;
+        for ( unsigned out = 0; out < N_OUTPUTS; out++ ) output_ptrs[out] = outputs[out].data() + blk * block_size;
+        
+        const double start = thread_time();
+        if ( fdn ) fdn->process( input.data(), output_ptrs.data(), block_size );
+        if ( ism ) ism->process( input.data(), ism_ptrs.data(), block_size );
+        cpu_time += thread_time() - start;
+        
+        for ( unsigned out = 0; out < N_OUTPUTS; out++ ) {
+            for ( unsigned idx = 0; idx < block_size; idx++ ) {
+                output_ptrs[out][idx] = output_ptrs[out][idx] * fdn_gain + ( ism ? ism_outputs[out][idx] * ism_gain : 0.f );
+            }
+        }
+    }
+    
+    return outputs;
+}
+
+static Report measure( const Settings& settings, unsigned n_fbpaths, unsigned ism_order )
+{
+    Report report{};
+    report.n_fbpaths = n_fbpaths;
+    report.ism_order = ism_order;
+    
+    double cpu_time;
+    std::vector< std::vector< float > > outputs = render( settings, n_fbpaths, ism_order, cpu_time );
+    const unsigned long n_samples = outputs[0].size();
+    report.rtf = float( cpu_time * settings.sample_rate / n_samples );
+    
+    SSRverb::IrAnalysis analysis( settings.sample_rate, settings.co_freqs );
+    std::vector< float > density;
+    const float hop_length = .001f;
+    const unsigned long early_samples = std::min( n_samples, (unsigned long)( ( EARLY_LENGTH + .02f ) * settings.sample_rate ) );
+    float mixing_time_sum = 0.f;
+    unsigned n_mixed = 0;
+    
+    // Averages over the output channels.
+    for ( unsigned out = 0; out < N_OUTPUTS; out++ )
+    {
+        std::vector< float > t60s = analysis.get_t60s( outputs[out].data(), n_samples );
+        for ( unsigned band = 0; band < N_BANDS; band++ ) report.t60[band] += t60s[band] / N_OUTPUTS;
+        
+        SSRverb::IrAnalysis::echo_density( outputs[out].data(), early_samples, settings.sample_rate, density, .02f, hop_length );
+        float sum = 0.f;
+        for ( unsigned hop = 0; hop < density.size(); hop++ ) sum += density[hop];
+        report.early_density += density.empty() ? 0.f : sum / density.size() / N_OUTPUTS;
+        
+        std::vector< float >::iterator mixed = std::find_if( density.begin(), density.end(), []( float value ) { return value >= 1.f; } );
+        if ( mixed != density.end() ) {
+            // Densities are given at the window centers.
+            mixing_time_sum += ( ( mixed - density.begin() ) * hop_length + .01f ) * 1000.f;
+            n_mixed++;
+        }
+    }
+    report.mixing_time = n_mixed == N_OUTPUTS ? mixing_time_sum / N_OUTPUTS : -1.f;
+    
+    for ( unsigned band = 0; band < N_BANDS; band++ ) {
+        report.t60_error = std::max( report.t60_error, fabsf( report.t60[band] - settings.t60[band] ) / settings.t60[band] );
+    }
+    
+    return report;
+}
+
+// Marks the reports not dominated in cost, T60 error and early echo density.
+static void mark_pareto_front( std::vector< Report >& reports )
+{
+    for ( unsigned idx = 0; idx < reports.size(); idx++ )
+    {
+        reports[idx].pareto = true;
+        for ( unsigned other = 0; other < reports.size() && reports[idx].pareto; other++ )
+        {
+            const Report& a = reports[other];
+            const Report& b = reports[idx];
+            const bool no_worse = a.rtf <= b.rtf && a.t60_error <= b.t60_error && a.early_density >= b.early_density;
+            const bool better = a.rtf < b.rtf || a.t60_error < b.t60_error || a.early_density > b.early_density;
+            if ( other != idx && no_worse && better ) reports[idx].pareto = false;
+        }
+    }
+}
+
+static bool read_list( const char* arg, std::vector< unsigned >& values )
+{
+    values.clear();
+    for ( const char* pos = arg; *pos; ) {
+        char* end;
+        values.push_back( unsigned( strtoul( pos, &end, 10 ) ) );
+        if ( end == pos ) return false;
+        pos = *end == ',' ? end + 1 : end;
+    }
+    return !values.empty();
+}
+
+static bool read_floats( int argc, char** argv, int& arg, float* values, unsigned n_values )
+{
+    if ( arg + int(n_values) >= argc ) return false;
+    for ( unsigned val = 0; val < n_values; val++ ) values[val] = atof( argv[++arg] );
+    return true;
+}
+
+static void print_usage( const char* name )
+{
+    printf( "Usage: %s [options]\n", name );
+    printf( "  --room <x> <y> <z>          Room dimensions in m.\n" );
+    printf( "  --t60 <low> <mid> <high>    Target reverberation times in s.\n" );
+    printf( "  --co-freqs <low> <high>     Crossover frequencies of the bands in Hz.\n" );
+    printf( "  --paths <n,n,...>           FDN feedback path counts, 0 for none. Powers of 2 or 24.\n" );
+    printf( "  --orders <n,n,...>          ISM orders, 0 for none.\n" );
+    printf( "  --sample-rate <hz>          Sample rate.\n" );
+    printf( "  --block-size <frames>       Frames processed at once, at most 1024.\n" );
+    printf( "  --threads <n>               Configurations rendered in parallel, one per core by default.\n" );
+    printf( "  --target <error>            Largest accepted relative T60 error, 0.1 by default.\n" );
+}
+
+int main( int argc, char** argv )
+{
+    Settings settings;
+    
+    for ( int arg = 1; arg < argc; arg++ )
+    {
+        bool valid = true;
+        if ( !strcmp( argv[arg], "--room" ) ) valid = read_floats( argc, argv, arg, settings.room, 3 );
+        else if ( !strcmp( argv[arg], "--t60" ) ) valid = read_floats( argc, argv, arg, settings.t60, N_BANDS );
+        else if ( !strcmp( argv[arg], "--co-freqs" ) ) valid = read_floats( argc, argv, arg, settings.co_freqs.data(), 2 );
+        else if ( !strcmp( argv[arg], "--paths" ) && arg+1 < argc ) valid = read_list( argv[++arg], settings.n_fbpaths );
+        else if ( !strcmp( argv[arg], "--orders" ) && arg+1 < argc ) valid = read_list( argv[++arg], settings.ism_orders );
+        else if ( !strcmp( argv[arg], "--sample-rate" ) && arg+1 < argc ) settings.sample_rate = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--block-size" ) && arg+1 < argc ) settings.block_size = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--threads" ) && arg+1 < argc ) settings.n_threads = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--target" ) && arg+1 < argc ) settings.target_error = atof( argv[++arg] );
+        else valid = false;
+        
+        if ( !valid ) {
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    
+    // The FDN processes at most 1024 frames at once.
+    if ( settings.block_size == 0 || settings.block_size > 1024 || settings.sample_rate == 0 ) {
+        print_usage( argv[0] );
+        return 1;
+    }
+    
+    std::vector< Report > reports;
+    for ( unsigned paths : settings.n_fbpaths ) {
+        for ( unsigned order : settings.ism_orders ) {
+            if ( paths > 0 || order > 0 ) reports.push_back( Report{ paths, order } );
+        }
+    }
+    
+    unsigned n_threads = settings.n_threads;
+    if ( n_threads == 0 ) n_threads = std::max( std::thread::hardware_concurrency(), 1u );
+    
+    std::atomic< unsigned > next_report{ 0 };
+    auto worker = [&]()
+    {
+        for ( unsigned idx = next_report++; idx < reports.size(); idx = next_report++ ) {
+            reports[idx] = measure( settings, reports[idx].n_fbpaths, reports[idx].ism_order );
+        }
+    };
+    
+    std::vector< std::thread > threads;
+    for ( unsigned thr = 0; thr < n_threads; thr++ ) threads.push_back( std::thread( worker ) );
+    for ( unsigned thr = 0; thr < threads.size(); thr++ ) threads[thr].join();
+    
+    mark_pareto_front( reports );
+    std::sort( reports.begin(), reports.end(), []( const Report& a, const Report& b ) { return a.rtf < b.rtf; } );
+    
+    printf( "n_fbpaths,ism_order,rtf,t60_low,t60_mid,t60_high,t60_error,early_density,mixing_time_ms,pareto\n" );
+    for ( const Report& report : reports ) {
+        printf(  "%u,%u,%.5f,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%d\n"
+               , report.n_fbpaths, report.ism_order, report.rtf
+               , report.t60[0], report.t60[1], report.t60[2], report.t60_error
+               , report.early_density, report.mixing_time, report.pareto ? 1 : 0 );
+    }
+    
+    // Sorted by cost, the first one meeting the target is the cheapest.
+    for ( const Report& report : reports ) {
+        if ( report.t60_error <= settings.target_error ) {
+            fprintf(  stderr, "Cheapest configuration within %.0f %% of the target T60: %u feedback paths, ISM order %u, real-time factor %.5f\n"
+                    , settings.target_error * 100.f, report.n_fbpaths, report.ism_order, report.rtf );
+            return 0;
+        }
+    }
+    fprintf( stderr, "No configuration is within %.0f %% of the target T60.\n", settings.target_error * 100.f );
+    return 0;
+}
@@ -0,0 +1,196 @@
+//
+//  render_offline.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+//  Renders the reverb source outputs of sound files without JACK, as fast as
+//  the machine allows. Files are rendered in parallel.
+//
+
+#include "reverbs/include/OfflineRenderer.hpp"
+#include "reverbs/fdnverb/include/DynamicFDNEngine.hpp"
+#include "reverbs/ismverb/include/ISMverb.hpp"
+#include "reverbs/randomizer/include/Randomizer.hpp"
+#include "reverbs/randomizer/include/ConvolutionEngine.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <mutex>
+#include <chrono>
+
+struct Settings
+{
+    std::string engine = "dfdn";
+    std::string ir_path;
+    std::string out_dir;
+    float room[3]{ 5.f, 7.f, 3.2f };
+    float t60[3]{ 2.f, 1.f, .2f };
+    float src[3]{ 1.7f, 2.3f, 1.7f };
+    float rec[3]{ 2.5f, 3.5f, 1.7f };
+    unsigned ism_order = 4;
+    unsigned quality = 0;
+    unsigned block_size = 1024;
+    unsigned n_threads = 0;
+    float tail = 2.f;
+    bool fixed_seed = false;
+    unsigned seed = 0;
+};
+
+static void print_usage( const char* name )
+{
+    printf( "Usage: %s [options] <input files>\n", name );
+    printf( "  --engine <dfdn|ism|conv>  Reverberator, dfdn by default.\n" );
+    printf( "  --ir <file>               Mono impulse response for the conv engine.\n" );
+    printf( "  --room <x> <y> <z>        Room dimensions in m.\n" );
+    printf( "  --t60 <low> <mid> <high>  Reverberation times in s.\n" );
+    printf( "  --src <x> <y> <z>         Source position in m.\n" );
+    printf( "  --rec <x> <y> <z>         Receiver position in m.\n" );
+    printf( "  --order <n>               Reflection order of the ism engine.\n" );
+    printf( "  --quality <level>         Quality level of the dfdn engine, 0 is best.\n" );
+    printf( "  --block-size <frames>     Frames processed at once.\n" );
+    printf( "  --tail <s>                Seconds rendered after the end of the input.\n" );
+    printf( "  --threads <n>             Files rendered in parallel, one per core by default.\n" );
+    printf( "  --out-dir <dir>           Output directory, next to the input by default.\n" );
+    printf( "  --seed <n>                Seed of the random parts, for reproducible results.\n" );
+}
+
+static bool read_floats( int argc, char** argv, int& arg, float* values, unsigned n_values )
+{
+    if ( arg + int(n_values) >= argc ) return false;
+    for ( unsigned val = 0; val < n_values; val++ ) values[val] = atof( argv[++arg] );
+    return true;
+}
+
+static void configure( SSRverb::ReverbEngine& engine, const Settings& settings )
+{
+    engine.set_room_size( settings.room[0], settings.room[1], settings.room[2] );
+    for ( unsigned band = 0; band < 3; band++ ) engine.set_t60( settings.t60[band], band );
+    engine.set_src_pos( SSRverb::Vector3D( settings.src[0], settings.src[1], settings.src[2] ) );
+    engine.set_rec_pos( SSRverb::Vector3D( settings.rec[0], settings.rec[1], settings.rec[2] ) );
+}
+
+int main( int argc, char** argv )
+{
+    Settings settings;
+    std::vector< SSRverb::OfflineRenderer::Job > jobs;
+    std::vector< std::string > inputs;
+    
+    for ( int arg = 1; arg < argc; arg++ )
+    {
+        bool valid = true;
+        if ( !strcmp( argv[arg], "--engine" ) && arg+1 < argc ) settings.engine = argv[++arg];
+        else if ( !strcmp( argv[arg], "--ir" ) && arg+1 < argc ) settings.ir_path = argv[++arg];
+        else if ( !strcmp( argv[arg], "--room" ) ) valid = read_floats( argc, argv, arg, settings.room, 3 );
+        else if ( !strcmp( argv[arg], "--t60" ) ) valid = read_floats( argc, argv, arg, settings.t60, 3 );
+        else if ( !strcmp( argv[arg], "--src" ) ) valid = read_floats( argc, argv, arg, settings.src, 3 );
+        else if ( !strcmp( argv[arg], "--rec" ) ) valid = read_floats( argc, argv, arg, settings.rec, 3 );
+        else if ( !strcmp( argv[arg], "--order" ) && arg+1 < argc ) settings.ism_order = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--quality" ) && arg+1 < argc ) settings.quality = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--block-size" ) && arg+1 < argc ) settings.block_size = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--tail" ) && arg+1 < argc ) settings.tail = atof( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--threads" ) && arg+1 < argc ) settings.n_threads = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--out-dir" ) && arg+1 < argc ) settings.out_dir = argv[++arg];
+        else if ( !strcmp( argv[arg], "--seed" ) && arg+1 < argc ) {
+            settings.fixed_seed = true;
+            settings.seed = atoi( argv[++arg] );
+        }
+        else if ( argv[arg][0] == '-' ) valid = false;
+        else inputs.push_back( argv[arg] );
+        
+        if ( !valid ) {
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    
+    if ( inputs.empty() || settings.block_size == 0 || settings.ism_order == 0 ) {
+        print_usage( argv[0] );
+        return 1;
+    }
+    
+    // The impulse response is spatialized once and shared by all jobs.
+    std::unique_ptr< SSRverb::Randomizer > randomizer;
+    if ( settings.engine == "conv" )
+    {
+        if ( settings.ir_path.empty() ) {
+            printf( "The conv engine needs an impulse response, see --ir.\n" );
+            return 1;
+        }
+        randomizer.reset( new SSRverb::Randomizer( settings.ir_path.c_str() ) );
+        if ( settings.fixed_seed ) randomizer->set_seed( settings.seed );
+        randomizer->create_spacial_imp_resp();
+    }
+    else if ( settings.engine != "dfdn" && settings.engine != "ism" ) {
+        print_usage( argv[0] );
+        return 1;
+    }
+    
+    SSRverb::OfflineRenderer::EngineFactory factory =
+    [&settings, &randomizer]( unsigned sample_rate, unsigned block_size ) -> std::unique_ptr< SSRverb::ReverbEngine >
+    {
+        std::unique_ptr< SSRverb::ReverbEngine > engine;
+        
+        if ( settings.engine == "dfdn" )
+        {
+            SSRverb::DynamicFDNEngine* dfdn = new SSRverb::DynamicFDNEngine( sample_rate, block_size );
+            // Rendering is not bound to real-time. Keep the quality constant.
+            dfdn->set_governor( false );
+            dfdn->switch_quality_level( settings.quality );
+            if ( settings.fixed_seed ) dfdn->set_seed( settings.seed );
+            engine.reset( dfdn );
+        }
+        else if ( settings.engine == "ism" )
+        {
+            engine.reset( new SSRverb::ISMverb(  settings.room[0], settings.room[1], settings.room[2]
+                                               , settings.ism_order, sample_rate, block_size ) );
+        }
+        else
+        {
+            if ( randomizer->get_sample_rate() != sample_rate ) return nullptr;
+            engine.reset( new SSRverb::ConvolutionEngine(  randomizer->get_spac_imp_resps(), 8
+                                                         , randomizer->get_ir_length(), block_size ) );
+        }
+        
+        configure( *engine, settings );
+        engine->prepare( sample_rate, block_size );
+        return engine;
+    };
+    
+    for ( unsigned file = 0; file < inputs.size(); file++ ) {
+        jobs.push_back( { inputs[file], SSRverb::OfflineRenderer::make_output_path( inputs[file], settings.out_dir ) } );
+    }
+    
+    SSRverb::OfflineRenderer renderer( factory, settings.block_size, settings.tail );
+    std::mutex print_mtx;
+    auto start = std::chrono::steady_clock::now();
+    
+    auto results = renderer.render_all( jobs, settings.n_threads, [&]( unsigned job, const SSRverb::OfflineRenderer::Result& result )
+    {
+        std::lock_guard< std::mutex > lock( print_mtx );
+        if ( result.success ) {
+            printf( "%s -> %s: %.1f s audio in %.2f s (%.2f s processing), %.1fx real-time\n"
+                   , jobs[job].input_path.c_str(), jobs[job].output_path.c_str()
+                   , result.n_frames / double( result.sample_rate ), result.wall_time, result.process_time
+                   , result.realtime_factor );
+        }
+        else {
+            printf( "%s: %s\n", jobs[job].input_path.c_str(), result.message.c_str() );
+        }
+        fflush( stdout );
+    });
+    
+    std::chrono::duration< double > elapsed = std::chrono::steady_clock::now() - start;
+    
+    int n_failed = 0;
+    double audio_time = 0.0;
+    for ( unsigned job = 0; job < results.size(); job++ ) {
+        if ( !results[job].success ) n_failed++;
+        else audio_time += results[job].n_frames / double( results[job].sample_rate );
+    }
+    printf( "%u files, %.1f s audio in %.2f s, %.1fx real-time overall, %d failed\n"
+           , unsigned( results.size() ), audio_time, elapsed.count(), audio_time / elapsed.count(), n_failed );
+    
+    return n_failed ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+//
+//  replay_trace.cpp
+//  SSRverb - https://github.com/Buerner/SSRverb
+//
+//  Copyright © 2017 Martin Bürner. All rights reserved.
+//  Licensed under the MIT License. See LICENSE.md file in the project root for full license information.  
+//
+//  Replays a scene trace recorded with ReverbBase::start_scene_trace() against
+//  an engine without JACK and SSR. Scene updates are passed to the same
+//  callback as in the live reverberator, between the audio blocks they fell
+//  into, so the tracking load of a show can be profiled on any machine.
+//
+
+#include "reverbs/include/SceneTrace.hpp"
+#include "reverbs/include/SceneDiff.hpp"
+#include "reverbs/fdnverb/include/DynamicFDNEngine.hpp"
+#include "reverbs/ismverb/include/ISMverb.hpp"
+
+#include <chrono>
+#include <thread>
+#include <random>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+struct Settings
+{
+    std::string engine = "dfdn";
+    float speed = 0.f;
+    int tracked_source = -1;
+    unsigned block_size = 64;
+    unsigned sample_rate = 44100;
+    float dead_band = -1.f;
+    float max_rate = 100.f;
+    unsigned full_rate_orders = 2;
+    float extrapolation = 0.f;
+    float tap_grid = 0.f;
+};
+
+struct Statistics
+{
+    unsigned long n_updates = 0;
+    unsigned long n_reference_moves = 0;
+    unsigned long n_blocks = 0;
+    unsigned long n_tap_blocks = 0;
+    unsigned long n_grid_blocks = 0;
+    double total_ns = 0.0;
+    double tap_ns = 0.0;
+    double peak_ns = 0.0;
+};
+
+static void print_usage( const char* name )
+{
+    printf( "Usage: %s [options] <trace file>\n", name );
+    printf( "  --engine <dfdn|ism>    Engine the trace is replayed against, dfdn by default.\n" );
+    printf( "  --speed <factor>       1 replays in original time, 0 as fast as possible (default).\n" );
+    printf( "  --tracked <id>         SSR ID of the tracked source, the first one not named rev_* by default.\n" );
+    printf( "  --block-size <frames>  Internal block size, 64 by default.\n" );
+    printf( "  --sample-rate <hz>     Sample rate, 44100 by default.\n" );
+    printf( "  --dead-band <m>        Movement below which the ISM taps are kept, one sample of path difference by default.\n" );
+    printf( "  --max-rate <hz>        Maximum ISM tap update rate, 100 by default, 0 for no limit.\n" );
+    printf( "  --full-rate-orders <n> Orders updated on every move, higher ones are refreshed later. 2 by default.\n" );
+    printf( "  --extrapolation <s>    Look-ahead of the trajectory extrapolation, 0 (off) by default. Needs --speed 1.\n" );
+    printf( "  --tap-grid <m>         Cell size of precomputed ISM taps, 0 (off) by default. Built in the background, needs --speed 1.\n" );
+}
+
+// The first source which is not a reverb source.
+static int find_tracked_source( const std::vector< SSRverb::SceneTracePlayer::Event >& events )
+{
+    for ( const SSRverb::SceneTracePlayer::Event& event : events ) {
+        for ( const ssrface::Source& source : event.changed ) {
+            if ( event.type == SSRverb::SceneTraceRecorder::UPDATE && source.name.compare( 0, 4, "rev_" ) ) return source.id;
+        }
+    }
+    return -1;
+}
+
+int main( int argc, char** argv )
+{
+    Settings settings;
+    const char* trace_path = nullptr;
+    
+    for ( int arg = 1; arg < argc; arg++ )
+    {
+        if ( !strcmp( argv[arg], "--engine" ) && arg+1 < argc ) settings.engine = argv[++arg];
+        else if ( !strcmp( argv[arg], "--speed" ) && arg+1 < argc ) settings.speed = atof( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--tracked" ) && arg+1 < argc ) settings.tracked_source = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--block-size" ) && arg+1 < argc ) settings.block_size = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--sample-rate" ) && arg+1 < argc ) settings.sample_rate = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--dead-band" ) && arg+1 < argc ) settings.dead_band = atof( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--max-rate" ) && arg+1 < argc ) settings.max_rate = atof( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--full-rate-orders" ) && arg+1 < argc ) settings.full_rate_orders = atoi( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--extrapolation" ) && arg+1 < argc ) settings.extrapolation = atof( argv[++arg] );
+        else if ( !strcmp( argv[arg], "--tap-grid" ) && arg+1 < argc ) settings.tap_grid = atof( argv[++arg] );
+        else if ( argv[arg][0] != '-' && !trace_path ) trace_path = argv[arg];
+        else {
+            print_usage( argv[0] );
+            return 1;
+        }
+    }
+    
+    if ( !trace_path || settings.block_size == 0 || settings.sample_rate == 0 ) {
+        print_usage( argv[0] );
+        return 1;
+    }
+    
+    SSRverb::SceneTracePlayer player;
+    if ( !player.load( trace_path ) ) {
+        printf( "Could not read scene trace %s.\n", trace_path );
+        return 1;
+    }
+    
+    if ( settings.tracked_source < 0 ) settings.tracked_source = find_tracked_source( player.get_events() );
+    if ( settings.tracked_source < 0 ) {
+        printf( "The trace contains no source to track, see --tracked.\n" );
+        return 1;
+    }
+    
+    std::unique_ptr< SSRverb::ReverbEngine > engine;
+    SSRverb::ISMverb* ism;
+    
+    if ( settings.engine == "dfdn" )
+    {
+        SSRverb::DynamicFDNEngine* dfdn = new SSRverb::DynamicFDNEngine( settings.sample_rate, settings.block_size );
+        dfdn->set_tracked_source( settings.tracked_source );
+        ism = dfdn->get_ism();
+        engine.reset( dfdn );
+    }
+    else if ( settings.engine == "ism" )
+    {
+        ism = new SSRverb::ISMverb( 5.f, 7.f, 3.2f, 4, settings.sample_rate, settings.block_size );
+        ism->set_tracked_source( settings.tracked_source );
+        engine.reset( ism );
+    }
+    else {
+        print_usage( argv[0] );
+        return 1;
+    }
+    engine->prepare( settings.sample_rate, settings.block_size );
+    ism->set_update_dead_band( settings.dead_band );
+    ism->set_max_update_rate( settings.max_rate );
+    ism->set_full_rate_orders( settings.full_rate_orders );
+    ism->set_extrapolation( settings.extrapolation );
+    ism->enable_tap_grid( settings.tap_grid );
+    
+    // Noise keeps the engine from going idle.
+    std::mt19937 generator( 1 );
+    std::uniform_real_distribution< float > noise( -.5f, .5f );
+    std::vector< float > input( settings.block_size );
+    const unsigned n_outputs = engine->get_n_outputs();
+    std::vector< std::vector< float > > outputs( n_outputs, std::vector< float >( settings.block_size ) );
+    std::vector< float* > output_ptrs( n_outputs );
+    for ( unsigned out = 0; out < n_outputs; out++ ) output_ptrs[out] = outputs[out].data();
+    
+    Statistics stats;
+    SSRverb::SceneDiff diff;
+    SSRverb::SceneTracePlayer::Callback callback = [&stats, &diff, ism]( const SSRverb::SceneTracePlayer::Event& event, SSRverb::TraceScene* scene )
+    {
+        if ( event.type == SSRverb::SceneTraceRecorder::UPDATE ) {
+            // Same path as ReverbBase, which only passes on the changes.
+            diff.update( scene );
+            if ( !diff.is_empty() ) SSRverb::ISMverb::update_changed_src_pos( scene, diff, ism );
+            stats.n_updates++;
+        }
+        else {
+            // ReverbBase::track_reference only moves the reverb sources in the SSR. The engine is not involved.
+            stats.n_reference_moves++;
+        }
+    };
+    
+    const double block_duration = double( settings.block_size ) / settings.sample_rate;
+    const unsigned long n_blocks = (unsigned long)( player.get_duration() / block_duration ) + 1;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    for ( unsigned long blk = 0; blk < n_blocks; blk++ )
+    {
+        // Deliver the updates which arrived up to the start of this block.
+        const double audio_time = blk * block_duration;
+        while ( player.get_next_time() >= 0.0 && player.get_next_time() <= audio_time ) player.step( callback );
+        
+        if ( settings.speed > 0.f ) {
+            std::this_thread::sleep_until( start + std::chrono::microseconds( (long long)( audio_time / settings.speed * 1e6 ) ) );
+        }
+        
+        for ( unsigned idx = 0; idx < settings.block_size; idx++ ) input[idx] = noise( generator );
+        
+        const unsigned long n_tap_updates = ism->get_n_updates();
+        std::chrono::steady_clock::time_point block_start = std::chrono::steady_clock::now();
+        engine->process( input.data(), output_ptrs.data(), settings.block_size );
+        std::chrono::duration< double, std::nano > elapsed = std::chrono::steady_clock::now() - block_start;
+        
+        stats.n_blocks++;
+        stats.total_ns += elapsed.count();
+        stats.peak_ns = std::max( stats.peak_ns, elapsed.count() );
+        if ( ism->get_n_updates() != n_tap_updates ) {
+            stats.n_tap_blocks++;
+            stats.tap_ns += elapsed.count();
+            if ( ism->is_tap_grid_used() ) stats.n_grid_blocks++;
+        }
+    }
+    
+    const double duration = n_blocks * block_duration;
+    const unsigned long n_plain_blocks = stats.n_blocks - stats.n_tap_blocks;
+    
+    printf( "Trace: %.1f s, %lu scene updates (%.1f / s), %lu reference moves, tracked source %d\n"
+           , player.get_duration(), stats.n_updates, stats.n_updates / std::max( duration, 1e-9 )
+           , stats.n_reference_moves, settings.tracked_source );
+    printf( "Engine %s: %lu blocks, %lu with tap updates (%.1f / s), %lu of them from the tap grid\n"
+           , settings.engine.c_str(), stats.n_blocks, stats.n_tap_blocks, stats.n_tap_blocks / std::max( duration, 1e-9 ), stats.n_grid_blocks );
+    printf( "Block time: mean %.2f us, with tap update %.2f us, without %.2f us, peak %.2f us (%.1f %% of the block)\n"
+           , stats.total_ns / stats.n_blocks / 1000.0
+           , stats.n_tap_blocks ? stats.tap_ns / stats.n_tap_blocks / 1000.0 : 0.0
+           , n_plain_blocks ? ( stats.total_ns - stats.tap_ns ) / n_plain_blocks / 1000.0 : 0.0
+           , stats.peak_ns / 1000.0, stats.peak_ns / ( block_duration * 1e9 ) * 100.0 );
+    printf( "Real-time factor: %.4f\n", stats.total_ns * 1e-9 / duration );
+    
+    return 0;
+}